@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic time in nanoseconds
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// A cheap deterministic PRNG (xorshift64) so runs are comparable
+static inline uint64_t bench_rand(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+// Prints a result as one line of JSON, which is what `make bench` collects and
+// bench/compare.py reads. name and n together identify the result between
+// runs.
+static inline void bench_report(const char *name, uint64_t n, double ns_per_op)
+{
+	printf("{\"name\": \"%s\", \"n\": %llu, \"ns_per_op\": %.3f}\n",
+		name, (unsigned long long) n, ns_per_op);
+	fflush(stdout);
+}
+
+// Keeps the compiler from optimizing away a benchmarked result
+static inline void bench_consume(const void *p)
+{
+	__asm__ volatile("" : : "g"(p) : "memory");
+}
+
+#endif // BENCH_H
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Compares benchmark results against a saved baseline.
+
+Both files hold the lines of JSON that `make bench` writes. A result is a
+regression when it's slower than its baseline by more than the threshold.
+Exits with 1 if there are any.
+
+usage: bench/compare.py BASELINE RESULTS [--threshold FRACTION]
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            result = json.loads(line)
+            results[(result["name"], result["n"])] = result["ns_per_op"]
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("results")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="how much slower counts as a regression "
+                        "(default 0.10)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    results = load(args.results)
+
+    regressions = 0
+    print(f"{'benchmark':<40} {'n':>10} {'baseline':>12} {'now':>12} "
+          f"{'change':>8}")
+    for key in sorted(set(baseline) | set(results)):
+        name, n = key
+        before = baseline.get(key)
+        after = results.get(key)
+        if before is None or after is None:
+            status = "only in " + ("results" if before is None
+                                   else "baseline")
+            print(f"{name:<40} {n:>10} {status:>34}")
+            continue
+
+        change = after / before - 1 if before else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  faster"
+        print(f"{name:<40} {n:>10} {before:>10.2f}ns {after:>10.2f}ns "
+              f"{change:>+7.1%}{flag}")
+
+    if regressions:
+        print(f"{regressions} regression(s) over "
+              f"{args.threshold:.0%}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
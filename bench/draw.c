@@ -0,0 +1,50 @@
+// Times drawing frames offscreen while panning over a flat world, both from
+// scratch and by scrolling the last frame
+#include <SDL2/SDL.h>
+#include "../world.h"
+#include "../render.h"
+#include "../globals.h"
+#include "bench.h"
+
+#define FRAMES 600
+
+int main(void)
+{
+	g_surface = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+		0xFF0000, 0xFF00, 0xFF, 0);
+	if (!g_surface || render_init() < 0)
+		return 1;
+
+	World world = world_new();
+	if (!world || world_generate_flat(world) < 0)
+		return 1;
+
+	const struct {
+		const char *name;
+		enum RenderMode mode;
+	} modes[] = {
+		{"world_draw_full", RENDER_FULL},
+		{"world_draw_scroll", RENDER_SCROLL},
+	};
+
+	for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+		struct PlayerView view = {.center_x = -100, .width = 25};
+		if (sprites_update(&view) < 0)
+			return 1;
+
+		uint64_t start = bench_now();
+		for (int i = 0; i < FRAMES; ++i) {
+			// Walking speed, 5 tiles per second
+			view.center_x += 5.0 / 60;
+			if (render_frame(world, &view, modes[m].mode) < 0)
+				return 1;
+		}
+		bench_report(modes[m].name, FRAMES,
+			(double) (bench_now() - start) / FRAMES);
+	}
+
+	world_free(world);
+	render_free();
+	SDL_FreeSurface(g_surface);
+	return 0;
+}
@@ -0,0 +1,40 @@
+// Times entity_update_physics for worlds with more and more entities walking
+// over flat ground
+#include "../world.h"
+#include "../entity.h"
+#include "../physics.h"
+#include "bench.h"
+
+#define MAX_ENTITIES 10000
+#define TICKS 600
+
+int main(void)
+{
+	for (int n = 1; n <= MAX_ENTITIES; n *= 10) {
+		World world = world_new();
+		if (!world || world_generate_flat(world) < 0)
+			return 1;
+
+		uint64_t seed = 0x2545F4914F6CDD1Dull;
+		for (int i = 0; i < n; ++i) {
+			double x = (double) (bench_rand(&seed) % 400) - 200;
+			if (entity_spawn_cow(&world->entities, x, 2.0) ==
+				ENTITY_NONE)
+				return 1;
+			world->entities.desired_velocity_x[i] =
+				i & 1 ? 5.0 : -5.0;
+		}
+
+		uint64_t start = bench_now();
+		for (int tick = 0; tick < TICKS; ++tick)
+			for (int i = 0; i < n; ++i)
+				entity_update_physics(&world->entities, i,
+					world, 1.0 / 60);
+		// Reported per entity per tick
+		bench_report("entity_update_physics", n,
+			(double) (bench_now() - start) / TICKS / n);
+
+		world_free(world);
+	}
+	return 0;
+}
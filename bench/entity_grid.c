@@ -0,0 +1,57 @@
+// Times entity_query_rect for a screen-sized area in worlds with more and more
+// entities at the same density, which should take about as long however many
+// entities there are, and entity_moved for every entity after a tick's worth of
+// movement
+#include <math.h>
+#include "../entity.h"
+#include "bench.h"
+
+#define MAX_ENTITIES 100000
+// Entities per square tile
+#define DENSITY 0.05
+#define QUERIES 10000
+
+int main(void)
+{
+	struct EntityQuery result = {0};
+	for (int n = 1000; n <= MAX_ENTITIES; n *= 10) {
+		struct EntityPool pool;
+		entity_pool_init(&pool);
+		const uint64_t side = sqrt(n / DENSITY);
+		uint64_t seed = 0x2545F4914F6CDD1Dull;
+		for (int i = 0; i < n; ++i)
+			if (entity_spawn_cow(&pool,
+				(double) (bench_rand(&seed) % side),
+				(double) (bench_rand(&seed) % side)) ==
+				ENTITY_NONE)
+				return 1;
+
+		size_t found = 0;
+		uint64_t start = bench_now();
+		for (int q = 0; q < QUERIES; ++q) {
+			double x = bench_rand(&seed) % side;
+			double y = bench_rand(&seed) % side;
+			if (entity_query_rect(&pool, x, y, x + 40.0, y + 23.0,
+				&result) < 0)
+				return 1;
+			found += result.len;
+		}
+		bench_consume(&found);
+		bench_report("entity_query_rect", n,
+			(double) (bench_now() - start) / QUERIES);
+
+		// Reported per entity
+		start = bench_now();
+		for (size_t i = 0; i < pool.len; ++i) {
+			pool.x[i] += i & 1 ? 0.09 : -0.09;
+			if (entity_moved(&pool, i) < 0)
+				return 1;
+		}
+		bench_report("entity_moved", n,
+			(double) (bench_now() - start) / n);
+
+		entity_pool_free(&pool);
+	}
+	entity_query_free(&result);
+	return 0;
+}
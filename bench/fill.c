@@ -0,0 +1,41 @@
+// Fills a 1k x 1k region block by block (how world_fill_block used to work)
+// and then with world_fill_block
+#include "../world.h"
+#include "bench.h"
+
+#define SIZE 1024
+// Not chunk aligned, so the edges take the partial-chunk path
+#define X1 (-SIZE / 2 + 3)
+#define Y1 (-SIZE / 2 + 5)
+#define X2 (X1 + SIZE - 1)
+#define Y2 (Y1 + SIZE - 1)
+
+int main(void)
+{
+	World world = world_new();
+	uint64_t start = bench_now();
+	for (int64_t y = Y1; y <= Y2; ++y)
+		for (int64_t x = X1; x <= X2; ++x)
+			world_set_block(world, x, y, TILE_DIRT);
+	double per_block_ms = (bench_now() - start) / 1e6;
+	world_free(world);
+
+	// Time the fill into a world that already has its chunks, and into an
+	// empty one where they have to be created
+	world = world_new();
+	start = bench_now();
+	world_fill_block(world, X1, Y1, X2, Y2, TILE_DIRT);
+	double empty_ms = (bench_now() - start) / 1e6;
+	start = bench_now();
+	world_fill_block(world, X1, Y1, X2, Y2, TILE_GRASS);
+	double existing_ms = (bench_now() - start) / 1e6;
+	world_free(world);
+
+	// Reported per block
+	const double blocks = (double) SIZE * SIZE / 1e6;
+	bench_report("fill_set_block", SIZE * SIZE, per_block_ms / blocks);
+	bench_report("world_fill_block_new", SIZE * SIZE, empty_ms / blocks);
+	bench_report("world_fill_block_existing", SIZE * SIZE,
+		existing_ms / blocks);
+	return 0;
+}
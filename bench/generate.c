@@ -0,0 +1,22 @@
+// Times world_generate_flat into a new world
+#include "../world.h"
+#include "bench.h"
+
+#define RUNS 20
+
+int main(void)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < RUNS; ++i) {
+		World world = world_new();
+		if (!world)
+			return 1;
+		uint64_t start = bench_now();
+		if (world_generate_flat(world) < 0)
+			return 1;
+		total += bench_now() - start;
+		world_free(world);
+	}
+	bench_report("world_generate_flat", RUNS, (double) total / RUNS);
+	return 0;
+}
@@ -0,0 +1,72 @@
+// Times every HashMap operation at sizes from a thousand to ten million keys
+#include <stdlib.h>
+#include "../hashmap.h"
+#include "bench.h"
+
+#define MIN_KEYS 1000
+#define MAX_KEYS 10000000
+
+static size_t key_hash(const uint64_t *key)
+{
+	return SuperFastHash((const char *) key, sizeof(*key));
+}
+
+int main(void)
+{
+	uint64_t *keys = malloc(sizeof(*keys) * MAX_KEYS);
+	uint64_t *order = malloc(sizeof(*order) * MAX_KEYS);
+	if (!keys || !order)
+		return 1;
+
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	for (size_t i = 0; i < MAX_KEYS; ++i)
+		keys[i] = bench_rand(&seed);
+
+	for (size_t n = MIN_KEYS; n <= MAX_KEYS; n *= 10) {
+		// Lookups and removals visit the keys in a random order
+		for (size_t i = 0; i < n; ++i)
+			order[i] = bench_rand(&seed) % n;
+
+		HashMap map = hashmap_new(8);
+		if (!map)
+			return 1;
+
+		uint64_t start = bench_now();
+		for (size_t i = 0; i < n; ++i)
+			hashmap_put(map, &keys[i], sizeof(keys[i]), &keys[i],
+				key_hash(&keys[i]));
+		bench_report("hashmap_put", n, (double) (bench_now() - start)
+			/ n);
+
+		start = bench_now();
+		for (size_t i = 0; i < n; ++i) {
+			const uint64_t *key = &keys[order[i]];
+			bench_consume(hashmap_get(map, key, sizeof(*key),
+				key_hash(key)));
+		}
+		bench_report("hashmap_get", n, (double) (bench_now() - start)
+			/ n);
+
+		struct HashMapIterator it;
+		struct HashMapNode *node;
+		start = bench_now();
+		hashmap_iterator_init(&it, map);
+		while ((node = hashmap_iterate(&it)))
+			bench_consume(node);
+		bench_report("hashmap_iterate", n, (double) (bench_now() - start)
+			/ n);
+
+		start = bench_now();
+		for (size_t i = 0; i < n; ++i)
+			hashmap_remove(map, &keys[i], sizeof(keys[i]),
+				key_hash(&keys[i]));
+		bench_report("hashmap_remove", n, (double) (bench_now() - start)
+			/ n);
+
+		hashmap_free(map);
+	}
+
+	free(keys);
+	free(order);
+	return 0;
+}
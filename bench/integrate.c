@@ -0,0 +1,54 @@
+// Times integrate_entities with every kernel the CPU has, and a whole
+// world_update_physics tick, for more and more entities walking over flat
+// ground
+#include "../world.h"
+#include "../entity.h"
+#include "../physics.h"
+#include "../integrate.h"
+#include "bench.h"
+
+#define MAX_ENTITIES 100000
+#define TICKS 200
+
+int main(void)
+{
+	for (int n = 100; n <= MAX_ENTITIES; n *= 10) {
+		World world = world_new();
+		if (!world || world_generate_flat(world) < 0)
+			return 1;
+
+		uint64_t seed = 0x2545F4914F6CDD1Dull;
+		struct EntityPool *pool = &world->entities;
+		for (int i = 0; i < n; ++i) {
+			double x = (double) (bench_rand(&seed) % 400) - 200;
+			if (entity_spawn_cow(pool, x, 2.0) == ENTITY_NONE)
+				return 1;
+			pool->desired_velocity_x[i] = i & 1 ? 5.0 : -5.0;
+		}
+
+		// Reported per entity per tick
+		for (int kernel = 0; kernel < NUM_SIMD_LEVELS;
+			++kernel) {
+			if (!simd_supported(kernel))
+				continue;
+			char name[64];
+			snprintf(name, sizeof(name), "integrate_entities_%s",
+				simd_name(kernel));
+			uint64_t start = bench_now();
+			for (int tick = 0; tick < TICKS; ++tick)
+				integrate_entities(pool, 0, pool->len, 1.0 / 60,
+					kernel);
+			bench_report(name, n,
+				(double) (bench_now() - start) / TICKS / n);
+		}
+
+		uint64_t start = bench_now();
+		for (int tick = 0; tick < TICKS; ++tick)
+			world_update_physics(world, 1.0 / 60);
+		bench_report("world_update_physics", n,
+			(double) (bench_now() - start) / TICKS / n);
+
+		world_free(world);
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Times the job system with 1 thread up to one per core: a parallel loop that
+// builds chunks, and jobs that do nothing, which is the cost of running a job
+#include <SDL2/SDL.h>
+#include "../job.h"
+#include "../world.h"
+#include "bench.h"
+
+#define CHUNKS (1 << 14)
+#define EMPTY_JOBS (1 << 18)
+#define REPEATS 5
+
+/**
+ * Builds and compacts a chunk for every index in a range, which only
+ * allocates, so it runs on any number of threads at once
+ * @param data Unused
+ * @param begin The first index
+ * @param end The index after the last
+ */
+static void build_chunks(void *data, size_t begin, size_t end)
+{
+	(void) data;
+	for (size_t i = begin; i < end; ++i) {
+		Chunk chunk = chunk_new(i, 0);
+		if (!chunk)
+			exit(1);
+		for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+			for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+				chunk_set_tile(chunk, rx, ry,
+					(rx * ry + i) % 3 ? TILE_DIRT : TILE_LOG);
+		chunk_compact(chunk);
+		bench_consume(chunk);
+		chunk_free(chunk);
+	}
+}
+
+static void nothing(void *data)
+{
+	bench_consume(data);
+}
+
+/**
+ * Times both kinds of work on a job system with some number of threads
+ * @param threads The number of threads
+ * @param empty EMPTY_JOBS jobs that do nothing
+ * @return 0 on success and a negative value on error
+ */
+static int run(int threads, const struct Job *empty)
+{
+	JobSystem jobs = job_system_new(threads);
+	if (!jobs)
+		return -1;
+
+	uint64_t start = bench_now();
+	for (int i = 0; i < REPEATS; ++i)
+		if (job_parallel_for(jobs, CHUNKS, 0, build_chunks, NULL) < 0)
+			return -1;
+	bench_report("job_parallel_for_chunks", threads,
+		(double) (bench_now() - start) / REPEATS / CHUNKS);
+
+	struct JobCounter done;
+	job_counter_init(&done);
+	start = bench_now();
+	if (job_submit(jobs, empty, EMPTY_JOBS, &done) < 0)
+		return -1;
+	job_wait(jobs, &done);
+	bench_report("job_empty", threads,
+		(double) (bench_now() - start) / EMPTY_JOBS);
+
+	job_system_free(jobs);
+	return 0;
+}
+
+int main(void)
+{
+	static struct Job empty[EMPTY_JOBS];
+	for (int i = 0; i < EMPTY_JOBS; ++i)
+		empty[i] = (struct Job) {nothing, NULL};
+
+	// Powers of two below the core count, then one thread per core
+	int cores = SDL_GetCPUCount();
+	for (int threads = 1; threads < cores; threads *= 2)
+		if (run(threads, empty) < 0)
+			return 1;
+	if (run(cores, empty) < 0)
+		return 1;
+	return 0;
+}
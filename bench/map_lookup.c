@@ -0,0 +1,62 @@
+// Compares chunk lookups through the generic HashMap against ChunkMap
+#include <stdlib.h>
+#include "../hashmap.h"
+#include "../world.h"
+#include "bench.h"
+
+#define SIDE 256
+#define NUM_CHUNKS (SIDE * SIDE)
+#define NUM_LOOKUPS 10000000
+
+// The key the generic map was used with before ChunkMap existed
+static size_t generic_hash(const int64_t *key)
+{
+	return SuperFastHash((const char *) key, sizeof(int64_t) * 2);
+}
+
+int main(void)
+{
+	int64_t (*keys)[2] = malloc(sizeof(*keys) * NUM_CHUNKS);
+	struct ChunkKey *lookups = malloc(sizeof(*lookups) * NUM_LOOKUPS);
+	if (!keys || !lookups)
+		return 1;
+
+	HashMap generic = hashmap_new(NUM_CHUNKS);
+	ChunkMap typed = chunkmap_new(NUM_CHUNKS);
+	for (int i = 0; i < NUM_CHUNKS; ++i) {
+		keys[i][0] = i % SIDE - SIDE / 2;
+		keys[i][1] = i / SIDE - SIDE / 2;
+		hashmap_put(generic, keys[i], sizeof(keys[i]), keys[i],
+			generic_hash(keys[i]));
+		chunkmap_put(typed, (struct ChunkKey) {keys[i][0], keys[i][1]},
+			(Chunk) keys[i]);
+	}
+
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	for (int i = 0; i < NUM_LOOKUPS; ++i) {
+		int k = bench_rand(&seed) % NUM_CHUNKS;
+		lookups[i] = (struct ChunkKey) {keys[k][0], keys[k][1]};
+	}
+
+	uint64_t start = bench_now();
+	for (int i = 0; i < NUM_LOOKUPS; ++i) {
+		int64_t key[] = {lookups[i].cx, lookups[i].cy};
+		bench_consume(hashmap_get(generic, key, sizeof(key),
+			generic_hash(key)));
+	}
+	double generic_ns = (double) (bench_now() - start) / NUM_LOOKUPS;
+
+	start = bench_now();
+	for (int i = 0; i < NUM_LOOKUPS; ++i)
+		bench_consume(chunkmap_get(typed, lookups[i]));
+	double typed_ns = (double) (bench_now() - start) / NUM_LOOKUPS;
+
+	bench_report("chunk_lookup_hashmap", NUM_CHUNKS, generic_ns);
+	bench_report("chunk_lookup_chunkmap", NUM_CHUNKS, typed_ns);
+
+	hashmap_free(generic);
+	chunkmap_free(typed);
+	free(keys);
+	free(lookups);
+	return 0;
+}
@@ -0,0 +1,79 @@
+// Times saving a band of terrain chunks to region files and loading them back.
+// Each is reported twice: in nanoseconds per chunk, and in nanoseconds per MB
+// of encoded chunks, so MB per second is 1e9 over the second result. Saves
+// don't include the fsync that region_flush does after them.
+#include <stdlib.h>
+#include <unistd.h>
+#include "../world.h"
+#include "../terrain.h"
+#include "../region.h"
+#include "bench.h"
+
+// The same band as bench/terrain.c, which spans two regions
+#define CX1 0
+#define CX2 63
+#define CY1 (TERRAIN_BEDROCK_Y / CHUNK_LENGTH)
+#define CY2 (TERRAIN_MAX_HEIGHT / CHUNK_LENGTH)
+#define CHUNKS ((CX2 - CX1 + 1) * (CY2 - CY1 + 1))
+#define REPEATS 5
+
+int main(void)
+{
+	char dir[] = "/tmp/region_bench.XXXXXX";
+	if (!mkdtemp(dir))
+		return 1;
+	RegionStore store = region_store_open(dir);
+	Chunk *chunks = malloc(CHUNKS * sizeof(*chunks));
+	if (!store || !chunks)
+		return 1;
+	for (int64_t cy = CY1, i = 0; cy <= CY2; ++cy)
+		for (int64_t cx = CX1; cx <= CX2; ++cx, ++i)
+			if (!(chunks[i] = terrain_generate_chunk(1, cx, cy,
+				SIMD_SCALAR)))
+				return 1;
+
+	// The first pass creates the files and the rest rewrite in place
+	uint64_t save_ns = 0, load_ns = 0;
+	struct RegionStats stats;
+	for (int repeat = 0; repeat < REPEATS; ++repeat) {
+		uint64_t start = bench_now();
+		for (int i = 0; i < CHUNKS; ++i)
+			if (region_save_chunk(store, chunks[i]) < 0)
+				return 1;
+		save_ns += bench_now() - start;
+
+		start = bench_now();
+		for (int i = 0; i < CHUNKS; ++i) {
+			Chunk chunk;
+			if (region_load_chunk(store, chunks[i]->cx,
+				chunks[i]->cy, &chunk) < 0 || !chunk)
+				return 1;
+			bench_consume(chunk);
+			chunk_free(chunk);
+		}
+		load_ns += bench_now() - start;
+	}
+	region_store_stats(store, &stats);
+	const double mb = stats.bytes_written / 1e6;
+	bench_report("region_save_chunk", CHUNKS,
+		(double) save_ns / REPEATS / CHUNKS);
+	bench_report("region_load_chunk", CHUNKS,
+		(double) load_ns / REPEATS / CHUNKS);
+	bench_report("region_save_mb", CHUNKS, save_ns / mb);
+	bench_report("region_load_mb", CHUNKS, load_ns / mb);
+
+	for (int i = 0; i < CHUNKS; ++i)
+		chunk_free(chunks[i]);
+	free(chunks);
+	region_store_close(store);
+	char path[64];
+	for (int rx = CX1 >> REGION_SHIFT; rx <= CX2 >> REGION_SHIFT; ++rx)
+		for (int ry = CY1 >> REGION_SHIFT; ry <= CY2 >> REGION_SHIFT;
+			++ry) {
+			snprintf(path, sizeof(path), "%s/r.%d.%d.region", dir,
+				rx, ry);
+			unlink(path);
+		}
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,147 @@
+// Times saving a world of 100k modified chunks in the background while frames
+// keep changing it at 60 frames per second. Reports how long the snapshot
+// holds up the world's thread, how long the save takes to reach the disk, and
+// how long a frame's work takes with no save running and while one is, on
+// average and at worst. For comparison, saving the same chunks without the
+// saver stalls the world's thread for region_save_world's result.
+// Everything is in nanoseconds per save or per frame.
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../world.h"
+#include "../terrain.h"
+#include "../region.h"
+#include "../saver.h"
+#include "bench.h"
+
+// A band from the bedrock up past the surface wide enough for 100k chunks
+#define CX1 0
+#define CX2 9090
+#define CY1 (TERRAIN_BEDROCK_Y / CHUNK_LENGTH)
+#define CY2 (TERRAIN_MAX_HEIGHT / CHUNK_LENGTH)
+#define CHUNKS ((CX2 - CX1 + 1) * (CY2 - CY1 + 1))
+#define FRAME_NS (1000000000 / 60)
+// Blocks set at random places in the band every frame, some of which land in
+// shared chunks and copy them
+#define FRAME_EDITS 64
+#define IDLE_FRAMES 120
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+/**
+ * Marks every chunk of a world as modified
+ * @param world The world
+ */
+static void modify_all(World world)
+{
+	struct ChunkMapIterator it;
+	chunkmap_iterator_init(&it, world->chunkmap);
+	struct ChunkMapEntry *entry;
+	while ((entry = chunkmap_iterate(&it)))
+		entry->value->flags |= CHUNK_MODIFIED;
+}
+
+/**
+ * Does a frame's work on the world, then sleeps out the rest of the frame
+ * @param world The world
+ * @return How long the work took, or 0 on error
+ */
+static uint64_t frame(World world)
+{
+	const uint64_t start = bench_now();
+	for (int i = 0; i < FRAME_EDITS; ++i) {
+		int64_t x = CX1 * CHUNK_LENGTH + (int64_t) (bench_rand(&rng) %
+			((CX2 - CX1 + 1) * CHUNK_LENGTH));
+		int64_t y = CY1 * CHUNK_LENGTH + (int64_t) (bench_rand(&rng) %
+			((CY2 - CY1 + 1) * CHUNK_LENGTH));
+		if (world_set_block(world, x, y,
+			i & 1 ? TILE_LOG : TILE_AIR) < 0)
+			return 0;
+	}
+	if (world_compact_step(world, 64) < 0)
+		return 0;
+	const uint64_t work = bench_now() - start;
+
+	if (work < FRAME_NS) {
+		struct timespec rest = {0, FRAME_NS - work};
+		nanosleep(&rest, NULL);
+	}
+	return work ? work : 1;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/saver_bench.XXXXXX";
+	if (!mkdtemp(dir))
+		return 1;
+	RegionStore store = region_store_open(dir);
+	World world = world_new();
+	if (!store || !world)
+		return 1;
+	for (int64_t cy = CY1; cy <= CY2; ++cy) {
+		for (int64_t cx = CX1; cx <= CX2; ++cx) {
+			Chunk chunk = terrain_generate_chunk(1, cx, cy,
+				SIMD_SCALAR);
+			if (!chunk || world_put_chunk(world, chunk) < 0)
+				return 1;
+		}
+	}
+
+	// Saving synchronously, which also creates the region files
+	modify_all(world);
+	uint64_t start = bench_now();
+	if (region_save_world(store, world) < 0 || region_flush(store) < 0)
+		return 1;
+	bench_report("region_save_world", CHUNKS, bench_now() - start);
+
+	uint64_t total = 0;
+	for (int i = 0; i < IDLE_FRAMES; ++i) {
+		uint64_t work = frame(world);
+		if (!work)
+			return 1;
+		total += work;
+	}
+	bench_report("saver_frame_idle", CHUNKS, (double) total / IDLE_FRAMES);
+
+	Saver saver = saver_new(store);
+	if (!saver)
+		return 1;
+	modify_all(world);
+	start = bench_now();
+	if (saver_begin(saver, world) != 1)
+		return 1;
+	bench_report("saver_snapshot", CHUNKS, bench_now() - start);
+
+	// Frames go on until the save is collected, like in the game
+	uint64_t frames = 0, worst = 0;
+	total = 0;
+	while (saver->busy) {
+		uint64_t work = frame(world);
+		if (!work || saver_poll(saver) < 0)
+			return 1;
+		total += work;
+		if (work > worst)
+			worst = work;
+		++frames;
+	}
+	bench_report("saver_frame_saving", CHUNKS, (double) total / frames);
+	bench_report("saver_frame_saving_max", CHUNKS, worst);
+	bench_report("saver_latency", CHUNKS,
+		saver->stats.last_latency_us * 1000.0);
+
+	saver_free(saver);
+	world_free(world);
+	region_store_close(store);
+	char path[64];
+	for (int rx = CX1 >> REGION_SHIFT; rx <= CX2 >> REGION_SHIFT; ++rx)
+		for (int ry = CY1 >> REGION_SHIFT; ry <= CY2 >> REGION_SHIFT;
+			++ry) {
+			snprintf(path, sizeof(path), "%s/r.%d.%d.region", dir,
+				rx, ry);
+			unlink(path);
+		}
+	snprintf(path, sizeof(path), "%s/entities", dir);
+	unlink(path);
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,80 @@
+// Times terrain_generate_chunk with every kernel the CPU has, and
+// world_generate_terrain with 1 thread up to one per core. Both are reported
+// in nanoseconds of one core's time per chunk, so chunks per second per core
+// is 1e9 over the result.
+#include <SDL2/SDL.h>
+#include "../world.h"
+#include "../terrain.h"
+#include "../job.h"
+#include "bench.h"
+
+// A band of chunks from the bedrock up past the surface, which are all the
+// chunks that take any work to generate
+#define CX1 0
+#define CX2 63
+#define CY1 (TERRAIN_BEDROCK_Y / CHUNK_LENGTH)
+#define CY2 (TERRAIN_MAX_HEIGHT / CHUNK_LENGTH)
+#define CHUNKS ((CX2 - CX1 + 1) * (CY2 - CY1 + 1))
+#define REPEATS 5
+
+/**
+ * Times world_generate_terrain on a job system with some number of threads
+ * @param threads The number of threads
+ * @return 0 on success and a negative value on error
+ */
+static int run(int threads)
+{
+	JobSystem jobs = job_system_new(threads);
+	if (!jobs)
+		return -1;
+	uint64_t total = 0;
+	for (int i = 0; i < REPEATS; ++i) {
+		World world = world_new();
+		if (!world)
+			return -1;
+		uint64_t start = bench_now();
+		if (world_generate_terrain(world, jobs, i, CX1, CY1, CX2, CY2) < 0)
+			return -1;
+		total += bench_now() - start;
+		world_free(world);
+	}
+	bench_report("world_generate_terrain", threads,
+		(double) total * threads / REPEATS / CHUNKS);
+	job_system_free(jobs);
+	return 0;
+}
+
+int main(void)
+{
+	for (int level = 0; level < NUM_SIMD_LEVELS; ++level) {
+		if (!simd_supported(level))
+			continue;
+		char name[64];
+		snprintf(name, sizeof(name), "terrain_generate_chunk_%s",
+			simd_name(level));
+		uint64_t start = bench_now();
+		for (int i = 0; i < REPEATS; ++i) {
+			for (int64_t cy = CY1; cy <= CY2; ++cy) {
+				for (int64_t cx = CX1; cx <= CX2; ++cx) {
+					Chunk chunk = terrain_generate_chunk(
+						i, cx, cy, level);
+					if (!chunk)
+						return 1;
+					bench_consume(chunk);
+					chunk_free(chunk);
+				}
+			}
+		}
+		bench_report(name, CHUNKS,
+			(double) (bench_now() - start) / REPEATS / CHUNKS);
+	}
+
+	// Powers of two below the core count, then one thread per core
+	int cores = SDL_GetCPUCount();
+	for (int threads = 1; threads < cores; threads *= 2)
+		if (run(threads) < 0)
+			return 1;
+	if (run(cores) < 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,56 @@
+// Times world_get_block over a generated world, in row order and at random
+#include <stdlib.h>
+#include "../world.h"
+#include "bench.h"
+
+// The region read from, all of which world_generate_flat fills
+#define WIDTH 512
+#define HEIGHT 256
+#define X1 (-WIDTH / 2)
+#define Y1 (-HEIGHT)
+#define NUM_RANDOM 10000000
+
+int main(void)
+{
+	World world = world_new();
+	if (!world || world_generate_flat(world) < 0)
+		return 1;
+
+	int64_t (*points)[2] = malloc(sizeof(*points) * NUM_RANDOM);
+	if (!points)
+		return 1;
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	for (int i = 0; i < NUM_RANDOM; ++i) {
+		points[i][0] = X1 + (int64_t) (bench_rand(&seed) % WIDTH);
+		points[i][1] = Y1 + (int64_t) (bench_rand(&seed) % HEIGHT);
+	}
+
+	uint64_t start = bench_now();
+	for (int64_t y = Y1; y < Y1 + HEIGHT; ++y)
+		for (int64_t x = X1; x < X1 + WIDTH; ++x)
+			bench_consume((void *) (uintptr_t)
+				world_get_block(world, x, y));
+	bench_report("world_get_block_sequential", WIDTH * HEIGHT,
+		(double) (bench_now() - start) / (WIDTH * HEIGHT));
+
+	struct WorldCursor cursor;
+	world_cursor_init(&cursor, world);
+	start = bench_now();
+	for (int64_t y = Y1; y < Y1 + HEIGHT; ++y)
+		for (int64_t x = X1; x < X1 + WIDTH; ++x)
+			bench_consume((void *) (uintptr_t)
+				world_cursor_get_block(&cursor, x, y));
+	bench_report("world_cursor_get_block_sequential", WIDTH * HEIGHT,
+		(double) (bench_now() - start) / (WIDTH * HEIGHT));
+
+	start = bench_now();
+	for (int i = 0; i < NUM_RANDOM; ++i)
+		bench_consume((void *) (uintptr_t)
+			world_get_block(world, points[i][0], points[i][1]));
+	bench_report("world_get_block_random", NUM_RANDOM,
+		(double) (bench_now() - start) / NUM_RANDOM);
+
+	free(points);
+	world_free(world);
+	return 0;
+}
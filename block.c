@@ -0,0 +1,39 @@
+#include "block.h"
+
+// Each array is one column of BLOCK_LIST, indexed by BlockID
+
+const char *const block_names[NUM_TILES] = {
+#define X(id, name, flags, light, texture, tick) [id] = name,
+	BLOCK_LIST(X)
+#undef X
+};
+
+const uint8_t block_flags[NUM_TILES] = {
+#define X(id, name, flags, light, texture, tick) [id] = flags,
+	BLOCK_LIST(X)
+#undef X
+};
+
+const uint8_t block_light[NUM_TILES] = {
+#define X(id, name, flags, light, texture, tick) [id] = light,
+	BLOCK_LIST(X)
+#undef X
+};
+
+const uint16_t block_textures[NUM_TILES] = {
+#define X(id, name, flags, light, texture, tick) [id] = texture,
+	BLOCK_LIST(X)
+#undef X
+};
+
+const uint8_t block_ticks[NUM_TILES] = {
+#define X(id, name, flags, light, texture, tick) [id] = tick,
+	BLOCK_LIST(X)
+#undef X
+};
+
+const char *const texture_files[NUM_TEXTURES] = {
+#define X(id, file) [id] = file,
+	TEXTURE_LIST(X)
+#undef X
+};
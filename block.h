@@ -0,0 +1,107 @@
+/* The block registry. Every block is a single line of BLOCK_LIST, from which
+ * the BlockID enum and one flat property array per column are generated, so
+ * adding a block never means keeping parallel arrays in the same order by
+ * hand. Blocks that look alike share a texture from TEXTURE_LIST.
+ */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// X(id, file)
+#define TEXTURE_LIST(X) \
+	X(TEXTURE_DIRT, "assets/dirt.bmp") \
+	X(TEXTURE_GRASS, "assets/grass.bmp") \
+	X(TEXTURE_LOG, "assets/log.bmp") \
+	X(TEXTURE_UNBREAKABLE_ROCK, "assets/unbreakable_rock.bmp")
+
+// X(id, name, flags, light, texture, tick)
+// flags is a combination of BlockFlags and light is the brightness the block
+// emits, from 0 to 15.
+#define BLOCK_LIST(X) \
+	X(TILE_DIRT, "dirt", BLOCK_SOLID | BLOCK_OPAQUE, 0, TEXTURE_DIRT, \
+		TICK_NONE) \
+	X(TILE_GRASS, "grass", BLOCK_SOLID | BLOCK_OPAQUE, 0, TEXTURE_GRASS, \
+		TICK_NONE) \
+	X(TILE_AIR, "air", 0, 0, TEXTURE_NONE, TICK_NONE) \
+	X(TILE_LOG, "log", BLOCK_SOLID | BLOCK_OPAQUE, 0, TEXTURE_LOG, \
+		TICK_NONE) \
+	X(TILE_UNBREAKABLE_ROCK, "unbreakable rock", \
+		BLOCK_SOLID | BLOCK_OPAQUE, 0, TEXTURE_UNBREAKABLE_ROCK, \
+		TICK_NONE)
+
+enum TextureID {
+#define X(id, file) id,
+	TEXTURE_LIST(X)
+#undef X
+	NUM_TEXTURES,
+	// For blocks that aren't drawn
+	TEXTURE_NONE = NUM_TEXTURES,
+};
+
+enum BlockID {
+#define X(id, name, flags, light, texture, tick) id,
+	BLOCK_LIST(X)
+#undef X
+	NUM_TILES
+};
+
+// Chunk palettes store BlockIDs in 16 bits
+_Static_assert(NUM_TILES <= UINT16_MAX + 1, "too many blocks");
+
+enum BlockFlags {
+	// Entities collide with it
+	BLOCK_SOLID = 1 << 0,
+	// Nothing behind it shows through
+	BLOCK_OPAQUE = 1 << 1,
+};
+
+// What happens to a block when it's ticked
+enum BlockTick {
+	TICK_NONE,
+};
+
+extern const char *const block_names[NUM_TILES];
+extern const uint8_t block_flags[NUM_TILES];
+extern const uint8_t block_light[NUM_TILES];
+extern const uint16_t block_textures[NUM_TILES];
+extern const uint8_t block_ticks[NUM_TILES];
+extern const char *const texture_files[NUM_TEXTURES];
+
+/**
+ * Checks whether entities collide with a block
+ * @param block The block
+ * @return Whether the block is solid, which blocks that aren't in BLOCK_LIST
+ * 	never are
+ */
+static inline bool block_is_solid(enum BlockID block)
+{
+	return (unsigned) block < NUM_TILES && block_flags[block] & BLOCK_SOLID;
+}
+
+/**
+ * Checks whether a block hides everything behind it
+ * @param block The block
+ * @return Whether the block is opaque, which blocks that aren't in BLOCK_LIST
+ * 	never are
+ */
+static inline bool block_is_opaque(enum BlockID block)
+{
+	return (unsigned) block < NUM_TILES && block_flags[block] & BLOCK_OPAQUE;
+}
+
+/**
+ * Gets the texture a block is drawn with
+ * @param block The block
+ * @return The texture, or TEXTURE_NONE if the block isn't drawn or isn't in
+ * 	BLOCK_LIST
+ */
+static inline enum TextureID block_texture(enum BlockID block)
+{
+	return (unsigned) block < NUM_TILES ? block_textures[block]
+		: TEXTURE_NONE;
+}
+
+#endif // BLOCK_H
@@ -1,9 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <math.h>
 
 #include "entity.h"
+#include "globals.h"
 
 #define PLAYER_HITBOX_WIDTH 0.5
 #define PLAYER_HITBOX_HEIGHT 2.0
@@ -13,95 +15,728 @@
 #define COW_HITBOX_HEIGHT 1.0
 #define COW_HEALTH 7.5
 
-uint32_t SuperFastHash(const char *, int len);
+// A generation is whatever's left of a handle after the slot
+#define ENTITY_GENERATION_MASK (UINT32_MAX >> ENTITY_INDEX_BITS)
+
+// Every per-entity array of struct EntityPool
+#define ENTITY_ARRAYS(X) \
+	X(x) X(y) X(prev_x) X(prev_y) X(velocity_x) X(velocity_y) \
+	X(desired_velocity_x) X(acceleration_x) X(on_ground) \
+	X(hitbox_width) X(hitbox_height) X(health) X(type) X(looking_dir) \
+	X(handle) X(uuid) X(cell) X(bucket_slot)
+
+TYPED_MAP_DEFINE(, EntityMap, entitymap, struct EntityKey, EntityHandle,
+	entity_key_hash)
+TYPED_MAP_DEFINE(, EntityGrid, entitygrid, struct EntityCell,
+	struct EntityBucket, entity_cell_hash)
+
+static int entity_pool_grow(struct EntityPool *pool);
+static uint32_t entity_slot_new(struct EntityPool *pool);
+static struct EntityCell entity_cell_at(double x, double y);
+static int entity_cell_reserve(struct EntityPool *pool,
+	struct EntityCell cell);
+static void entity_cell_add(struct EntityPool *pool, size_t i,
+	struct EntityCell cell);
+static int entity_cell_insert(struct EntityPool *pool, size_t i);
+static void entity_cell_remove(struct EntityPool *pool, size_t i);
+static void entity_grid_free(struct EntityPool *pool);
+static bool entity_overlaps(const struct EntityPool *pool, size_t i,
+	double x1, double y1, double x2, double y2);
+static int entity_query_push(struct EntityQuery *result, size_t i);
+
+/**
+ * Hashes an entity's uuid
+ * Random uuids are already uniformly distributed, so their first 8 bytes are
+ * used as they are.
+ * @param key The uuid
+ * @return The hashed value
+ */
+uint64_t entity_key_hash(struct EntityKey key)
+{
+	uint64_t hash;
+	memcpy(&hash, key.uuid, sizeof(hash));
+	return hash;
+}
+
+/**
+ * Hashes the coordinates of a cell of the entity grid
+ * @param key The cell
+ * @return The hashed value
+ */
+uint64_t entity_cell_hash(struct EntityCell key)
+{
+	return (uint64_t) key.cx * 0xD6E8FEB86659FD93ull ^ (uint64_t) key.cy;
+}
+
+/**
+ * Initializes an empty entity pool
+ * @param pool The pool
+ */
+void entity_pool_init(struct EntityPool *pool)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->free_slot = UINT32_MAX;
+}
+
+/**
+ * Frees every entity in a pool and the pool's arrays
+ * @param pool The pool
+ */
+void entity_pool_free(struct EntityPool *pool)
+{
+#define X(name) free(pool->name);
+	ENTITY_ARRAYS(X)
+#undef X
+	free(pool->players);
+	free(pool->slots);
+	entitymap_free(pool->by_uuid);
+	entity_grid_free(pool);
+	entity_pool_init(pool);
+}
+
+/**
+ * Frees every bucket of a pool's grid and the grid itself
+ * @param pool The pool
+ */
+static void entity_grid_free(struct EntityPool *pool)
+{
+	struct EntityGridIterator it;
+	struct EntityGridEntry *entry;
+	entitygrid_iterator_init(&it, pool->grid);
+	while ((entry = entitygrid_iterate(&it)))
+		free(entry->value.indices);
+	entitygrid_free(pool->grid);
+	pool->grid = NULL;
+}
+
+/**
+ * Despawns every entity in a pool, keeping its arrays for reuse
+ * Handles of the despawned entities go stale, like those of despawned
+ * entities do, and are never reused.
+ * @param pool The pool
+ */
+void entity_pool_clear(struct EntityPool *pool)
+{
+	entitymap_free(pool->by_uuid);
+	pool->by_uuid = NULL;
+
+	// Buckets are emptied but kept, since a pool that's cleared is usually
+	// filled again with much the same entities. Ones still empty from the
+	// last clear were left behind, so they're all let go of then.
+	struct EntityGridIterator it;
+	struct EntityGridEntry *entry;
+	bool stale = false;
+	entitygrid_iterator_init(&it, pool->grid);
+	while ((entry = entitygrid_iterate(&it))) {
+		stale |= !entry->value.len;
+		entry->value.len = 0;
+	}
+	if (stale)
+		entity_grid_free(pool);
+	pool->max_hitbox_width = 0.0;
+	pool->max_hitbox_height = 0.0;
+
+	pool->len = 0;
+	pool->num_players = 0;
+
+	// Every slot is freed the way entity_despawn frees one, linked so
+	// that the lowest slots are taken first
+	pool->free_slot = UINT32_MAX;
+	for (size_t slot = pool->num_slots; slot--; ) {
+		uint32_t generation = (pool->slots[slot].generation + 1) &
+			ENTITY_GENERATION_MASK;
+		pool->slots[slot].generation = generation ? generation : 1;
+		pool->slots[slot].index = pool->free_slot;
+		pool->free_slot = slot;
+	}
+}
 
 /**
- * Allocates and initializes an Entity structure
+ * Adds an entity to a pool
+ * @param pool The pool
  * @param type The type of the entity
  * @param x The x coordinate of this entity
  * @param y The y coordinate of this entity
  * @param hitbox_width The width of the entity's hitbox
  * @param hitbox_height The height of the entity's hitbox
- * @return A pointer to the entity or NULL if an error occurred
+ * @param health How much health the entity starts with
+ * @return The entity's handle, or ENTITY_NONE if an error occurred
  */
-Entity entity_new(
+EntityHandle entity_spawn(
+	struct EntityPool *pool,
 	enum EntityType type,
 	double x, double y,
 	double hitbox_width, double hitbox_height,
 	double health)
 {
-	// calloc is used as a safety measure
-	Entity entity = calloc(1, sizeof(*entity));
-	if (!entity)
+	if (pool->len == pool->capacity && entity_pool_grow(pool) < 0)
+		return ENTITY_NONE;
+	uint32_t slot = entity_slot_new(pool);
+	if (slot == UINT32_MAX)
+		return ENTITY_NONE;
+
+	size_t i = pool->len++;
+	pool->slots[slot].index = i;
+	EntityHandle handle = pool->slots[slot].generation <<
+		ENTITY_INDEX_BITS | slot;
+
+	pool->x[i] = x;
+	pool->y[i] = y;
+	pool->prev_x[i] = x;
+	pool->prev_y[i] = y;
+	pool->velocity_x[i] = 0.0;
+	pool->velocity_y[i] = 0.0;
+	pool->desired_velocity_x[i] = 0.0;
+	pool->acceleration_x[i] = 0.0;
+	pool->on_ground[i] = false;
+	pool->hitbox_width[i] = hitbox_width;
+	pool->hitbox_height[i] = hitbox_height;
+	pool->health[i] = health;
+	pool->type[i] = type;
+	pool->looking_dir[i] = LOOKING_RIGHT;
+	pool->handle[i] = handle;
+	uuid_clear(pool->uuid[i]);
+
+	if (entity_cell_insert(pool, i) < 0) {
+		// The handle was never given out, so the slot can go back as
+		// it is
+		--pool->len;
+		pool->slots[slot].index = pool->free_slot;
+		pool->free_slot = slot;
+		return ENTITY_NONE;
+	}
+	if (hitbox_width > pool->max_hitbox_width)
+		pool->max_hitbox_width = hitbox_width;
+	if (hitbox_height > pool->max_hitbox_height)
+		pool->max_hitbox_height = hitbox_height;
+	return handle;
+}
+
+/**
+ * Makes room for more entities in every array of a pool
+ * @param pool The pool
+ * @return 0 on success and a negative value on error
+ */
+static int entity_pool_grow(struct EntityPool *pool)
+{
+	size_t capacity = pool->capacity ? pool->capacity * 2 : 64;
+
+	// Arrays that grew before one failed are just bigger than they need
+	// to be
+#define X(name) { \
+		void *array = realloc(pool->name, \
+			capacity * sizeof(*pool->name)); \
+		if (!array) { \
+			g_error_message = "malloc failed"; \
+			return -1; \
+		} \
+		pool->name = array; \
+	}
+	ENTITY_ARRAYS(X)
+#undef X
+
+	pool->capacity = capacity;
+	return 0;
+}
+
+/**
+ * Takes a free slot, or adds one if there are none
+ * @param pool The pool
+ * @return The slot, or UINT32_MAX if an error occurred
+ */
+static uint32_t entity_slot_new(struct EntityPool *pool)
+{
+	if (pool->free_slot != UINT32_MAX) {
+		uint32_t slot = pool->free_slot;
+		pool->free_slot = pool->slots[slot].index;
+		return slot;
+	}
+
+	if (pool->num_slots == ENTITY_MAX) {
+		g_error_message = "too many entities";
+		return UINT32_MAX;
+	}
+	if (pool->num_slots == pool->slots_capacity) {
+		size_t capacity = pool->slots_capacity
+			? pool->slots_capacity * 2 : 64;
+		struct EntitySlot *slots = realloc(pool->slots,
+			capacity * sizeof(*slots));
+		if (!slots) {
+			g_error_message = "malloc failed";
+			return UINT32_MAX;
+		}
+		pool->slots = slots;
+		pool->slots_capacity = capacity;
+	}
+	pool->slots[pool->num_slots].generation = 1;
+	return pool->num_slots++;
+}
+
+/**
+ * Removes an entity from a pool, moving the last entity into its place
+ * Despawning an entity that was already despawned does nothing.
+ * @param pool The pool
+ * @param handle The entity
+ */
+void entity_despawn(struct EntityPool *pool, EntityHandle handle)
+{
+	size_t i = entity_index(pool, handle);
+	if (i == SIZE_MAX)
+		return;
+
+	if (!uuid_is_null(pool->uuid[i])) {
+		struct EntityKey key;
+		uuid_copy(key.uuid, pool->uuid[i]);
+		entitymap_remove(pool->by_uuid, key);
+	}
+	for (size_t p = 0; p < pool->num_players; ++p) {
+		if (pool->players[p].handle == handle) {
+			pool->players[p] = pool->players[--pool->num_players];
+			break;
+		}
+	}
+
+	entity_cell_remove(pool, i);
+	size_t last = --pool->len;
+	if (i != last) {
+#define X(name) memcpy(&pool->name[i], &pool->name[last], \
+	sizeof(*pool->name));
+		ENTITY_ARRAYS(X)
+#undef X
+		pool->slots[pool->handle[i] & ENTITY_INDEX_MASK].index = i;
+		entitygrid_get(pool->grid, pool->cell[i])->indices[
+			pool->bucket_slot[i]] = i;
+	}
+
+	// Bumping the generation makes every copy of the handle stale
+	uint32_t slot = handle & ENTITY_INDEX_MASK;
+	uint32_t generation = (pool->slots[slot].generation + 1) &
+		ENTITY_GENERATION_MASK;
+	pool->slots[slot].generation = generation ? generation : 1;
+	pool->slots[slot].index = pool->free_slot;
+	pool->free_slot = slot;
+}
+
+/**
+ * Gets an entity's uuid, which identifies it in saves, generating it the first
+ * time it's asked for
+ * @param pool The pool
+ * @param handle The entity
+ * @return The uuid, or NULL if the entity was despawned or an error occurred
+ */
+const unsigned char *entity_uuid(struct EntityPool *pool, EntityHandle handle)
+{
+	size_t i = entity_index(pool, handle);
+	if (i == SIZE_MAX)
 		return NULL;
-	entity->type = type;
-	entity->x = x;
-	entity->y = y;
-	entity->health = health;
-	entity->hitbox_width = hitbox_width;
-	entity->hitbox_height = hitbox_height;
-	entity->acceleration_x = 0.0;
-	entity->desired_velocity_x = 0.0;
-	entity->velocity_x = 0.0;
-	entity->velocity_y = 0.0;
-	entity->looking_dir = LOOKING_RIGHT;
-	entity->on_ground = false;
-	uuid_generate(entity->uuid);
-	return entity;
+	if (!uuid_is_null(pool->uuid[i]))
+		return pool->uuid[i];
+
+	uuid_t uuid;
+	uuid_generate(uuid);
+	if (entity_set_uuid(pool, handle, uuid) < 0)
+		return NULL;
+	return pool->uuid[i];
 }
 
 /**
- * Releases all resources created by entity_new
- * @param entity The entity to be freed
+ * Gives an entity without a uuid the one it was saved with
+ * @param pool The pool
+ * @param handle The entity
+ * @param uuid The uuid, which no other entity in the pool may have
+ * @return 0 on success and a negative value on error
  */
-void entity_free(Entity entity)
+int entity_set_uuid(struct EntityPool *pool, EntityHandle handle,
+	const uuid_t uuid)
 {
-	free(entity);
+	size_t i = entity_index(pool, handle);
+	if (i == SIZE_MAX || !uuid_is_null(pool->uuid[i]))
+		return -1;
+
+	if (!pool->by_uuid && !(pool->by_uuid = entitymap_new(64))) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	struct EntityKey key;
+	uuid_copy(key.uuid, uuid);
+	if (entitymap_put(pool->by_uuid, key, handle) < 0)
+		return -1;
+	uuid_copy(pool->uuid[i], uuid);
+	return 0;
+}
+
+/**
+ * Finds the entity with a uuid
+ * @param pool The pool
+ * @param uuid The uuid
+ * @return The entity, or ENTITY_NONE if no entity has the uuid
+ */
+EntityHandle entity_find_uuid(struct EntityPool *pool, const uuid_t uuid)
+{
+	if (!pool->by_uuid)
+		return ENTITY_NONE;
+	struct EntityKey key;
+	uuid_copy(key.uuid, uuid);
+	EntityHandle *handle = entitymap_get(pool->by_uuid, key);
+	return handle ? *handle : ENTITY_NONE;
+}
+
+/**
+ * Gets the data only players have
+ * @param pool The pool
+ * @param handle The player
+ * @return The player's data, or NULL if the entity isn't a player
+ */
+struct Player *entity_player(struct EntityPool *pool, EntityHandle handle)
+{
+	for (size_t p = 0; p < pool->num_players; ++p)
+		if (pool->players[p].handle == handle)
+			return &pool->players[p].player;
+	return NULL;
 }
 
 /**
  * Creates a player entity
+ * @param pool The pool to add it to
  * @param x The player's x-coordinate
  * @param y The player's y-coordinate
- * @return A pointer to the entity, or NULL if an error occurred
+ * @return The entity's handle, or ENTITY_NONE if an error occurred
  */
-Entity entity_new_player(double x, double y)
+EntityHandle entity_spawn_player(struct EntityPool *pool, double x, double y)
 {
-	Entity entity = entity_new(PLAYER_ENTITY, x, y,
-		PLAYER_HITBOX_WIDTH, PLAYER_HITBOX_HEIGHT, PLAYER_HEALTH);
+	if (pool->num_players == pool->players_capacity) {
+		size_t capacity = pool->players_capacity
+			? pool->players_capacity * 2 : 4;
+		struct PlayerData *players = realloc(pool->players,
+			capacity * sizeof(*players));
+		if (!players) {
+			g_error_message = "malloc failed";
+			return ENTITY_NONE;
+		}
+		pool->players = players;
+		pool->players_capacity = capacity;
+	}
 
-	if (!entity)
-		return NULL;
+	EntityHandle handle = entity_spawn(pool, PLAYER_ENTITY, x, y,
+		PLAYER_HITBOX_WIDTH, PLAYER_HITBOX_HEIGHT, PLAYER_HEALTH);
+	if (handle == ENTITY_NONE)
+		return ENTITY_NONE;
 
+	struct PlayerData *data = &pool->players[pool->num_players++];
+	data->handle = handle;
 	for (int i = 0; i < NUM_INVENTORY_SLOTS; ++i)
-		(entity->player).inventory[i] = (struct Item) {
+		data->player.inventory[i] = (struct Item) {
 			.type = ITEM_NONE,
 			.quantity = 0,
 		};
-	return entity;
+	return handle;
 }
 
 /**
  * Creates a cow entity
+ * @param pool The pool to add it to
  * @param x The cow's x-coordinate
  * @param y The cow's y-coordinate
- * @return A pointer to the entity, or NULL if an error occurred
+ * @return The entity's handle, or ENTITY_NONE if an error occurred
  */
-Entity entity_new_cow(double x, double y)
+EntityHandle entity_spawn_cow(struct EntityPool *pool, double x, double y)
 {
-	Entity entity = entity_new(COW_ENTITY, x, y,
+	return entity_spawn(pool, COW_ENTITY, x, y,
 		COW_HITBOX_WIDTH, COW_HITBOX_HEIGHT, COW_HEALTH);
+}
 
-	if (!entity)
-		return NULL;
+/**
+ * Finds the cell of the entity grid a position is in
+ * @param x The x-coordinate
+ * @param y The y-coordinate
+ * @return The cell
+ */
+static struct EntityCell entity_cell_at(double x, double y)
+{
+	return (struct EntityCell) {
+		(int64_t) floor(x) >> ENTITY_CELL_SHIFT,
+		(int64_t) floor(y) >> ENTITY_CELL_SHIFT,
+	};
+}
+
+/**
+ * Makes room for one more entity in the bucket of a cell, creating the bucket
+ * if there isn't one
+ * @param pool The pool
+ * @param cell The cell
+ * @return 0 on success and a negative value on error, in which case every
+ * 	entity stays in the bucket it was in
+ */
+static int entity_cell_reserve(struct EntityPool *pool,
+	struct EntityCell cell)
+{
+	if (!pool->grid && !(pool->grid = entitygrid_new(64)))
+		return -1;
 
-	/* custom initialization */
+	struct EntityBucket *bucket = entitygrid_get(pool->grid, cell);
+	if (!bucket) {
+		if (entitygrid_put(pool->grid, cell,
+			(struct EntityBucket) {0}) < 0)
+			return -1;
+		bucket = entitygrid_get(pool->grid, cell);
+	}
+	if (bucket->len == bucket->capacity) {
+		uint32_t capacity = bucket->capacity
+			? bucket->capacity * 2 : 8;
+		uint32_t *indices = realloc(bucket->indices,
+			capacity * sizeof(*indices));
+		if (!indices) {
+			g_error_message = "malloc failed";
+			if (!bucket->len)
+				entitygrid_remove(pool->grid, cell);
+			return -1;
+		}
+		bucket->indices = indices;
+		bucket->capacity = capacity;
+	}
+	return 0;
+}
 
-	return entity;
+/**
+ * Adds an entity to the bucket of a cell, which entity_cell_reserve made room
+ * in
+ * @param pool The pool
+ * @param i The entity's index
+ * @param cell The cell
+ */
+static void entity_cell_add(struct EntityPool *pool, size_t i,
+	struct EntityCell cell)
+{
+	struct EntityBucket *bucket = entitygrid_get(pool->grid, cell);
+	pool->cell[i] = cell;
+	pool->bucket_slot[i] = bucket->len;
+	bucket->indices[bucket->len++] = i;
+}
+
+/**
+ * Adds an entity to the bucket of the cell it's in
+ * @param pool The pool
+ * @param i The entity's index
+ * @return 0 on success and a negative value on error
+ */
+static int entity_cell_insert(struct EntityPool *pool, size_t i)
+{
+	struct EntityCell cell = entity_cell_at(pool->x[i], pool->y[i]);
+	if (entity_cell_reserve(pool, cell) < 0)
+		return -1;
+	entity_cell_add(pool, i, cell);
+	return 0;
 }
 
-uint32_t entity_hash(Entity entity)
+/**
+ * Takes an entity out of its cell's bucket, moving the bucket's last entity
+ * into its place, and lets go of the bucket if that leaves it empty
+ * @param pool The pool
+ * @param i The entity's index
+ */
+static void entity_cell_remove(struct EntityPool *pool, size_t i)
 {
-	return SuperFastHash((const char *) entity->uuid, sizeof(entity->uuid));
+	struct EntityBucket *bucket = entitygrid_get(pool->grid,
+		pool->cell[i]);
+	uint32_t last = bucket->indices[--bucket->len];
+	bucket->indices[pool->bucket_slot[i]] = last;
+	pool->bucket_slot[last] = pool->bucket_slot[i];
+
+	if (!bucket->len) {
+		free(bucket->indices);
+		entitygrid_remove(pool->grid, pool->cell[i]);
+	}
 }
 
+/**
+ * Moves an entity to the bucket of the cell it's in now, after its position
+ * changed
+ * Most moves stay within a cell, which this only has to compare.
+ * @param pool The pool
+ * @param i The entity's index
+ * @return 0 on success and a negative value on error
+ */
+int entity_moved(struct EntityPool *pool, size_t i)
+{
+	struct EntityCell cell = entity_cell_at(pool->x[i], pool->y[i]);
+	if (cell.cx == pool->cell[i].cx && cell.cy == pool->cell[i].cy)
+		return 0;
+
+	// Only making room can fail, which leaves the entity in its old cell.
+	// Removing it may move other buckets in the grid, so the new one is
+	// looked up again afterwards.
+	if (entity_cell_reserve(pool, cell) < 0)
+		return -1;
+	entity_cell_remove(pool, i);
+	entity_cell_add(pool, i, cell);
+	return 0;
+}
+
+/**
+ * Checks whether an entity's hitbox touches a rectangle
+ * @param pool The pool
+ * @param i The entity's index
+ * @param x1 The left edge of the rectangle
+ * @param y1 The bottom edge
+ * @param x2 The right edge
+ * @param y2 The top edge
+ * @return Whether it does
+ */
+static bool entity_overlaps(const struct EntityPool *pool, size_t i,
+	double x1, double y1, double x2, double y2)
+{
+	const double half_width = pool->hitbox_width[i] / 2.0;
+	return pool->x[i] - half_width <= x2 && pool->x[i] + half_width >= x1 &&
+		pool->y[i] <= y2 && pool->y[i] + pool->hitbox_height[i] >= y1;
+}
+
+/**
+ * Adds an entity to the results of a query
+ * @param result The results
+ * @param i The entity's index
+ * @return 0 on success and a negative value on error
+ */
+static int entity_query_push(struct EntityQuery *result, size_t i)
+{
+	if (result->len == result->capacity) {
+		size_t capacity = result->capacity ? result->capacity * 2 : 64;
+		size_t *indices = realloc(result->indices,
+			capacity * sizeof(*indices));
+		if (!indices) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		result->indices = indices;
+		result->capacity = capacity;
+	}
+	result->indices[result->len++] = i;
+	return 0;
+}
+
+/**
+ * Finds every entity whose hitbox touches a rectangle, only looking at the
+ * cells the rectangle and the biggest hitbox reach into
+ * @param pool The pool
+ * @param x1 The left edge of the rectangle
+ * @param y1 The bottom edge
+ * @param x2 The right edge
+ * @param y2 The top edge
+ * @param result Where to put the entities, in no particular order
+ * @return 0 on success and a negative value on error
+ */
+int entity_query_rect(const struct EntityPool *pool, double x1, double y1,
+	double x2, double y2, struct EntityQuery *result)
+{
+	result->len = 0;
+	if (!pool->grid)
+		return 0;
+
+	// An entity's position is the middle of the bottom of its hitbox
+	struct EntityCell low = entity_cell_at(
+		x1 - pool->max_hitbox_width / 2.0,
+		y1 - pool->max_hitbox_height);
+	struct EntityCell high = entity_cell_at(
+		x2 + pool->max_hitbox_width / 2.0, y2);
+
+	// A rectangle covering more cells than have entities in them is
+	// cheaper to check bucket by bucket
+	const double cells = ((double) high.cx - low.cx + 1) *
+		((double) high.cy - low.cy + 1);
+	if (cells > entitygrid_size(pool->grid)) {
+		struct EntityGridIterator it;
+		struct EntityGridEntry *entry;
+		entitygrid_iterator_init(&it, pool->grid);
+		while ((entry = entitygrid_iterate(&it))) {
+			const struct EntityBucket *bucket = &entry->value;
+			for (uint32_t j = 0; j < bucket->len; ++j)
+				if (entity_overlaps(pool, bucket->indices[j],
+					x1, y1, x2, y2) &&
+					entity_query_push(result,
+						bucket->indices[j]) < 0)
+					return -1;
+		}
+		return 0;
+	}
+
+	for (int64_t cy = low.cy; cy <= high.cy; ++cy) {
+		for (int64_t cx = low.cx; cx <= high.cx; ++cx) {
+			const struct EntityBucket *bucket = entitygrid_get(
+				pool->grid, (struct EntityCell) {cx, cy});
+			if (!bucket)
+				continue;
+			for (uint32_t j = 0; j < bucket->len; ++j)
+				if (entity_overlaps(pool, bucket->indices[j],
+					x1, y1, x2, y2) &&
+					entity_query_push(result,
+						bucket->indices[j]) < 0)
+					return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Finds every entity whose hitbox comes within a distance of a point
+ * @param pool The pool
+ * @param x The point's x-coordinate
+ * @param y The point's y-coordinate
+ * @param radius The distance
+ * @param result Where to put the entities, in no particular order
+ * @return 0 on success and a negative value on error
+ */
+int entity_query_radius(const struct EntityPool *pool, double x, double y,
+	double radius, struct EntityQuery *result)
+{
+	if (entity_query_rect(pool, x - radius, y - radius, x + radius,
+		y + radius, result) < 0)
+		return -1;
+
+	// Only the corners of the square are too far away
+	size_t kept = 0;
+	for (size_t j = 0; j < result->len; ++j) {
+		size_t i = result->indices[j];
+		const double half_width = pool->hitbox_width[i] / 2.0;
+		const double dx = fmax(fabs(x - pool->x[i]) - half_width, 0.0);
+		const double dy = y < pool->y[i] ? pool->y[i] - y
+			: fmax(y - pool->y[i] - pool->hitbox_height[i], 0.0);
+		if (dx * dx + dy * dy <= radius * radius)
+			result->indices[kept++] = i;
+	}
+	result->len = kept;
+	return 0;
+}
+
+/**
+ * Finds every other entity whose hitbox touches an entity's hitbox
+ * @param pool The pool
+ * @param i The entity's index
+ * @param result Where to put the entities, in no particular order
+ * @return 0 on success and a negative value on error
+ */
+int entity_query_overlaps(const struct EntityPool *pool, size_t i,
+	struct EntityQuery *result)
+{
+	const double half_width = pool->hitbox_width[i] / 2.0;
+	if (entity_query_rect(pool, pool->x[i] - half_width, pool->y[i],
+		pool->x[i] + half_width, pool->y[i] + pool->hitbox_height[i],
+		result) < 0)
+		return -1;
+
+	for (size_t j = 0; j < result->len; ++j) {
+		if (result->indices[j] == i) {
+			result->indices[j] = result->indices[--result->len];
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Frees the results of a query
+ * @param result The results
+ */
+void entity_query_free(struct EntityQuery *result)
+{
+	free(result->indices);
+	memset(result, 0, sizeof(*result));
+}
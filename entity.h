@@ -2,8 +2,10 @@
 #define ENTITY_H
 
 #include <uuid/uuid.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "typedmap.h"
 
 #define NUM_INVENTORY_SLOTS 10
 #define PLAYER
@@ -39,32 +41,156 @@ struct Player {
 	struct Item inventory[NUM_INVENTORY_SLOTS];
 };
 
-struct Entity {
-	double x, y;
-	double hitbox_width, hitbox_height;
-	double health;
+// Entities are referred to by handles, which stay valid until the entity is
+// despawned and never refer to another entity after that. The low
+// ENTITY_INDEX_BITS bits are a slot, and the rest are the slot's generation,
+// which changes every time the slot is reused.
+typedef uint32_t EntityHandle;
 
-	double velocity_x, velocity_y;
-	double desired_velocity_x;
-	double acceleration_x; // Don't modify, used for physics.c
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_MAX (1u << ENTITY_INDEX_BITS)
+// No entity ever has this handle, since generations start at 1
+#define ENTITY_NONE 0
 
-	bool on_ground;
-
-	enum EntityType type;
-	enum LookingDirection looking_dir;
+struct EntityKey {
 	uuid_t uuid;
-	// The following depends on what the entity type is
-	union {
-		struct Player player;
-	};
 };
 
-typedef struct Entity *Entity;
+TYPED_MAP_DECLARE(, EntityMap, entitymap, struct EntityKey, EntityHandle)
+
+// Entities are bucketed by which cell of a grid their position is in, so that
+// finding the entities in an area only looks at the cells around it. Cells are
+// the size of a chunk.
+#define ENTITY_CELL_SHIFT 4
+
+struct EntityCell {
+	int64_t cx, cy;
+};
+
+// The entities in one cell, by index
+struct EntityBucket {
+	uint32_t *indices;
+	uint32_t len, capacity;
+};
+
+TYPED_MAP_DECLARE(, EntityGrid, entitygrid, struct EntityCell,
+	struct EntityBucket)
+
+// The indices of the entities a query found, which stay valid until an entity
+// is despawned. A query can be reused for another once it's done with, and
+// only grows.
+struct EntityQuery {
+	size_t *indices;
+	size_t len, capacity;
+};
+
+// A player's own data, kept apart from the pool's arrays since there are so
+// few players
+struct PlayerData {
+	EntityHandle handle;
+	struct Player player;
+};
+
+// What a slot of a handle points at
+struct EntitySlot {
+	// The entity's index in the pool, or the next free slot if this one is
+	// free
+	uint32_t index;
+	uint32_t generation;
+};
+
+// Every entity in a world, as a structure of arrays so that going over one
+// field of every entity reads contiguous memory. Index i of every array belongs
+// to the same entity. Entities are packed into [0, len) in no particular order,
+// since despawning one moves the last entity into its place.
+struct EntityPool {
+	size_t len, capacity;
+
+	// Updated by physics every tick. Anything else that moves an entity
+	// must call entity_moved afterwards.
+	double *x, *y;
+	// Where the entity was before the last tick, which it's drawn between
+	double *prev_x, *prev_y;
+	double *velocity_x, *velocity_y;
+	double *desired_velocity_x;
+	double *acceleration_x; // Don't modify, used for physics.c
+	bool *on_ground;
+
+	double *hitbox_width, *hitbox_height;
+	double *health;
+	enum EntityType *type;
+	enum LookingDirection *looking_dir;
+	EntityHandle *handle;
+	// Only used for saving, so it's all zero until entity_uuid is called
+	uuid_t *uuid;
+	// The cell the entity is bucketed in, and where in the bucket it is
+	struct EntityCell *cell;
+	uint32_t *bucket_slot;
+
+	struct PlayerData *players;
+	size_t num_players, players_capacity;
+
+	// Indexed by the slot of a handle
+	struct EntitySlot *slots;
+	size_t num_slots, slots_capacity;
+	// The first of the free slots, which are linked through their index,
+	// or UINT32_MAX if there are none
+	uint32_t free_slot;
+
+	// Every entity that has a uuid, or NULL until one does
+	EntityMap by_uuid;
+
+	// Every cell with entities in it, or NULL until one does
+	EntityGrid grid;
+	// The biggest hitbox any entity has had, which is how far past a
+	// cell an entity in it can reach
+	double max_hitbox_width, max_hitbox_height;
+};
+
+uint64_t entity_key_hash(struct EntityKey);
+uint64_t entity_cell_hash(struct EntityCell);
+
+void entity_pool_init(struct EntityPool *);
+void entity_pool_free(struct EntityPool *);
+void entity_pool_clear(struct EntityPool *);
+
+EntityHandle entity_spawn(struct EntityPool *, enum EntityType, double x,
+	double y, double hw, double hh, double health);
+EntityHandle entity_spawn_player(struct EntityPool *, double x, double y);
+EntityHandle entity_spawn_cow(struct EntityPool *, double x, double y);
+void entity_despawn(struct EntityPool *, EntityHandle);
+int entity_moved(struct EntityPool *, size_t i);
+
+const unsigned char *entity_uuid(struct EntityPool *, EntityHandle);
+int entity_set_uuid(struct EntityPool *, EntityHandle, const uuid_t);
+EntityHandle entity_find_uuid(struct EntityPool *, const uuid_t);
+struct Player *entity_player(struct EntityPool *, EntityHandle);
+
+int entity_query_rect(const struct EntityPool *, double x1, double y1,
+	double x2, double y2, struct EntityQuery *result);
+int entity_query_radius(const struct EntityPool *, double x, double y,
+	double radius, struct EntityQuery *result);
+int entity_query_overlaps(const struct EntityPool *, size_t i,
+	struct EntityQuery *result);
+void entity_query_free(struct EntityQuery *);
 
-Entity entity_new(enum EntityType, double x, double y, double hw, double hh,
-	double health);
-Entity entity_new_player(double x, double y);
-void entity_free(Entity);
-uint32_t entity_hash(Entity);
+/**
+ * Finds where an entity is in its pool's arrays
+ * The index changes whenever another entity is despawned, so it should only be
+ * kept for as long as no entity is.
+ * @param pool The pool
+ * @param handle The entity
+ * @return The index, or SIZE_MAX if the entity was despawned
+ */
+static inline size_t entity_index(const struct EntityPool *pool,
+	EntityHandle handle)
+{
+	uint32_t slot = handle & ENTITY_INDEX_MASK;
+	if (slot >= pool->num_slots ||
+		pool->slots[slot].generation != handle >> ENTITY_INDEX_BITS)
+		return SIZE_MAX;
+	return pool->slots[slot].index;
+}
 
 #endif // ENTITY_H
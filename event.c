@@ -4,17 +4,21 @@
 #include <stdbool.h>
 #include "exit.h"
 #include "event.h"
-#include "entity.h"
-
-extern Entity g_player;
+#include "trace.h"
+#include "render.h"
 
 void left_click_handler(void)
 {
 
 }
 
-void event_handler(void)
+/**
+ * Handles every pending event and reads the keys that move the player
+ * @param input Set to what the player should do
+ */
+void event_handler(struct PlayerInput *input)
 {
+	TRACE_ZONE("event_handler");
 	SDL_Event e;
 
 	while (SDL_PollEvent(&e)) {
@@ -25,27 +29,23 @@ void event_handler(void)
 				break;
 			case SDL_MOUSEBUTTONDOWN:
 				break;
+			case SDL_KEYDOWN:
+				if (e.key.keysym.scancode == SDL_SCANCODE_F3 &&
+					!e.key.repeat)
+					hud_toggle();
+				break;
 		}
 	}
 
-	if (!g_player)
-		return;
-
 	int num_keys;
 	const uint8_t *keystates = SDL_GetKeyboardState(&num_keys);
 
-	if (keystates[SDL_SCANCODE_A]) {
-		g_player->looking_dir = LOOKING_LEFT;
-		g_player->desired_velocity_x = -5.0;
-	} else if (keystates[SDL_SCANCODE_D]) {
-		g_player->looking_dir = LOOKING_RIGHT;
-		g_player->desired_velocity_x = 5.0;
-	} else {
-		g_player->desired_velocity_x = 0.0;
-	}
+	if (keystates[SDL_SCANCODE_A])
+		input->walk = -1;
+	else if (keystates[SDL_SCANCODE_D])
+		input->walk = 1;
+	else
+		input->walk = 0;
 
-	//if (g_player->on_ground && keystates[SDL_SCANCODE_SPACE]) {
-	if (keystates[SDL_SCANCODE_SPACE]) {
-		g_player->velocity_y = 5.0;
-	}
+	input->jump = keystates[SDL_SCANCODE_SPACE];
 }
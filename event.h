@@ -3,6 +3,13 @@
 
 #include <stdbool.h>
 
-void event_handler(void);
+// What the keyboard tells the player to do
+struct PlayerInput {
+	// -1 to walk left, 1 to walk right or 0 to stand still
+	int walk;
+	bool jump;
+};
+
+void event_handler(struct PlayerInput *input);
 
 #endif // EVENT_H
@@ -1,7 +1,12 @@
 #include "exit.h"
 #include "render.h"
 #include "world.h"
+#include "sim.h"
+#include "job.h"
+#include "region.h"
+#include "saver.h"
 #include "globals.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <SDL2/SDL.h>
@@ -40,12 +45,33 @@ void destroy(void)
 	SDL_DestroyWindow(g_window);
 	g_window = NULL;
 
+	// The simulation thread has to stop before SDL shuts down, and before
+	// what's left of its world is saved
+	if (g_sim && g_sim->saver) {
+		sim_stop(g_sim);
+		if (saver_wait(g_sim->saver) < 0 ||
+			saver_begin(g_sim->saver, g_sim->world) < 0 ||
+			saver_wait(g_sim->saver) < 0)
+			fprintf(stderr, "Error: %s\n", g_error_message);
+	}
+	sim_free(g_sim);
+	g_sim = NULL;
+	// The stream is done loading chunks once the simulation is freed
+	region_store_close(g_regions);
+	g_regions = NULL;
+	job_system_free(g_jobs);
+	g_jobs = NULL;
+
 	world_free(g_world);
 	g_world = NULL;
 
 	render_free();
 	SDL_Quit();
 
+	if (g_trace_path && trace_export(g_trace_path) < 0)
+		fprintf(stderr, "Error: %s\n", g_error_message);
+	g_trace_path = NULL;
+
 #ifdef DEBUG
 	t = clock() - t;
 	printf("destroy() took %lf ms\n", 1000.0 * t / CLOCKS_PER_SEC);
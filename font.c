@@ -0,0 +1,70 @@
+#include "font.h"
+
+// Glyphs for ' ' through '_', where bit 14 is the top-left pixel and each row
+// of three pixels follows the one above it
+const uint16_t font_glyphs[FONT_NUM_GLYPHS] = {
+	0x0000, // space
+	0x2482, // !
+	0x5A00, // "
+	0x5F7D, // #
+	0x3C9E, // $
+	0x52A5, // %
+	0x2AAB, // &
+	0x2400, // '
+	0x2922, // (
+	0x224A, // )
+	0x0AA8, // *
+	0x05D0, // +
+	0x0014, // ,
+	0x01C0, // -
+	0x0002, // .
+	0x12A4, // /
+	0x7B6F, // 0
+	0x2C97, // 1
+	0x73E7, // 2
+	0x73CF, // 3
+	0x5BC9, // 4
+	0x79CF, // 5
+	0x79EF, // 6
+	0x7249, // 7
+	0x7BEF, // 8
+	0x7BCF, // 9
+	0x0410, // :
+	0x0414, // ;
+	0x1511, // <
+	0x0E38, // =
+	0x4454, // >
+	0x72C2, // ?
+	0x2BE3, // @
+	0x2BED, // A
+	0x6BAE, // B
+	0x3923, // C
+	0x6B6E, // D
+	0x79A7, // E
+	0x79A4, // F
+	0x396B, // G
+	0x5BED, // H
+	0x7497, // I
+	0x126A, // J
+	0x5BAD, // K
+	0x4927, // L
+	0x5FED, // M
+	0x6B6D, // N
+	0x2B6A, // O
+	0x6BA4, // P
+	0x2B73, // Q
+	0x6BAD, // R
+	0x388E, // S
+	0x7492, // T
+	0x5B6F, // U
+	0x5B6A, // V
+	0x5BFD, // W
+	0x5AAD, // X
+	0x5A92, // Y
+	0x72A7, // Z
+	0x6926, // [
+	0x4889, // backslash
+	0x324B, // ]
+	0x2A00, // ^
+	0x0007, // _
+};
@@ -0,0 +1,45 @@
+/* A tiny built-in bitmap font, so that text can be drawn without loading any
+ * assets. It only has the printable ASCII characters up to '_', and lowercase
+ * letters are drawn as uppercase.
+ */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FONT_WIDTH 3
+#define FONT_HEIGHT 5
+#define FONT_FIRST ' '
+#define FONT_NUM_GLYPHS 64
+
+extern const uint16_t font_glyphs[FONT_NUM_GLYPHS];
+
+/**
+ * Finds the glyph of a character
+ * @param c The character
+ * @return The glyph's index in font_glyphs, or -1 if the font doesn't have it
+ */
+static inline int font_index(char c)
+{
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+	if (c < FONT_FIRST || c >= FONT_FIRST + FONT_NUM_GLYPHS)
+		return -1;
+	return c - FONT_FIRST;
+}
+
+/**
+ * Checks whether a pixel of a glyph is set
+ * @param glyph The glyph
+ * @param x The column, from the left
+ * @param y The row, from the top
+ * @return Whether the pixel is set
+ */
+static inline bool font_pixel(uint16_t glyph, int x, int y)
+{
+	return glyph >> (FONT_WIDTH * FONT_HEIGHT - 1 - (y * FONT_WIDTH + x)) & 1;
+}
+
+#endif // FONT_H
@@ -1,12 +1,18 @@
 #include <SDL2/SDL.h>
 #include "world.h"
 #include "entity.h"
+#include "sim.h"
+#include "job.h"
+#include "region.h"
 // This exists to define symbols for usage in tests as well as the source files
 // to avoid build errors.
 
 SDL_Window *g_window;
 SDL_Surface *g_surface;
 World g_world;
-Entity g_player; // don't double-free, world_free will free this
+Sim g_sim;
+JobSystem g_jobs;
+RegionStore g_regions;
 
-char *g_error_message;
+_Thread_local char *g_error_message;
+const char *g_trace_path;
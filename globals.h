@@ -4,15 +4,29 @@
 #include <SDL2/SDL.h>
 #include "entity.h"
 #include "world.h"
+#include "sim.h"
+#include "job.h"
+#include "region.h"
 
 extern SDL_Window *g_window;
 extern SDL_Surface *g_surface;
+// The world the main thread draws, which is kept in step with g_sim's world
+// when the game runs in a window
 extern World g_world;
-extern Entity g_player;
+extern Sim g_sim;
+// The job system that any part of the game can hand work to
+extern JobSystem g_jobs;
+// Where the world is saved, or NULL if it isn't
+extern RegionStore g_regions;
 
 // error_message is only ever set if the source of the error wasn't SDL, or the
 // programmer (by passing invalid parameters)
 // An example: malloc failing
-extern char *g_error_message;
+// Every thread has its own, so an error on another thread has to be handed
+// over along with whatever reports that it failed
+extern _Thread_local char *g_error_message;
+
+// Where destroy writes the trace, or NULL to not write one
+extern const char *g_trace_path;
 
 #endif // GLOBALS_H
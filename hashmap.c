@@ -2,39 +2,41 @@
 #include <string.h>
 
 #include "hashmap.h"
+#include "typedmap.h"
 #include "globals.h"
 
-struct HashMap {
-	struct HashMapNode **buckets;
-	size_t num_buckets;
+// What hashmap_get and hashmap_remove look a key up by
+struct HashMapKey {
+	const void *data;
+	size_t size;
 };
 
-static struct HashMapNode *hashmap_get_node(HashMap hashmap,
-	const void *key, size_t key_size, size_t hash);
+static inline uint64_t node_hash(const struct HashMapNode *node)
+{
+	return node->hash;
+}
+
+static inline bool node_matches(const struct HashMapNode *node,
+	const struct HashMapKey *key, uint64_t hash)
+{
+	return node->hash == hash && node->key_size == key->size &&
+		memcmp(node->key, key->data, key->size) == 0;
+}
+
+// The tables are the same Robin Hood ones the typed maps use, with the nodes
+// keeping the hash they were put with so that migrating them never calls the
+// hash function again
+TYPED_MAP_TABLE_DEFINE(HashMap, hashmap, struct HashMapNode,
+	struct HashMapKey, node_hash, node_matches)
 
 /**
- * Creates a new hashmap with a fixed number of buckets
- * @param num_buckets The number of buckets used internally for the hashmap,
- * 	with more meaning less key depth and better fetch times
+ * Creates a new hashmap that grows as entries are added
+ * @param capacity The number of entries to reserve space for up front
  * @return The hash map, or NULL if an error occurred
  */
-HashMap hashmap_new(size_t num_buckets)
+HashMap hashmap_new(size_t capacity)
 {
-	HashMap hashmap = malloc(sizeof(*hashmap));
-	if (!hashmap) {
-		g_error_message = "malloc failed";
-		return NULL;
-	}
-
-	hashmap->buckets = calloc(num_buckets, sizeof(*hashmap->buckets));
-	if (!hashmap->buckets) {
-		g_error_message = "malloc failed";
-		free(hashmap);
-		return NULL;
-	}
-	hashmap->num_buckets = num_buckets;
-
-	return hashmap;
+	return hashmap_create(capacity);
 }
 
 /**
@@ -43,11 +45,7 @@ HashMap hashmap_new(size_t num_buckets)
  */
 void hashmap_free(HashMap hashmap)
 {
-	if (!hashmap)
-		return;
-
-	free(hashmap->buckets);
-	free(hashmap);
+	hashmap_destroy(hashmap);
 }
 
 /**
@@ -73,49 +71,13 @@ int hashmap_put(HashMap hashmap, const void *key, size_t key_size,
 		return 0;
 	}
 
-	struct HashMapNode **head_ptr =
-		&hashmap->buckets[hash % hashmap->num_buckets];
-	struct HashMapNode *node = malloc(sizeof(*node));
-	if (!node) {
-		g_error_message = "malloc failed";
-		return -1;
-	}
-	node->key = (void *) key;
-	node->key_size = key_size;
-	node->value = (void *) value;
-	node->next = *head_ptr;
-	node->last = NULL;
-	if (*head_ptr)
-		(*head_ptr)->last = node;
-	*head_ptr = node;
-
-	return 0;
-}
-
-/**
- * Gets the internal node used in the hash map for a certain key
- * @param hashmap The hash map to get from
- * @param key A pointer to data
- * @param key_size The size of key
- * @param hash The hashed value of the key
- * @return The HashMapNode with a matching key or NULL if none matched
- */
-static struct HashMapNode *hashmap_get_node(HashMap hashmap, const void *key,
-	size_t key_size, size_t hash)
-{
-	if (!hashmap)
-		return NULL;
-
-	struct HashMapNode *head =
-		hashmap->buckets[hash % hashmap->num_buckets];
-	while (head) {
-		if (head->key_size == key_size &&
-			memcmp(head->key, key, key_size) == 0)
-			return head;
-		head = head->next;
-	}
-
-	return NULL;
+	struct HashMapNode node = {
+		.key = (void *) key,
+		.key_size = key_size,
+		.value = (void *) value,
+		.hash = hash,
+	};
+	return hashmap_insert(hashmap, node);
 }
 
 /**
@@ -126,14 +88,17 @@ static struct HashMapNode *hashmap_get_node(HashMap hashmap, const void *key,
  * @param hash A hash of key
  * @return A pointer to the pointer value or NULL if it doesn't exist.
  * Can be dereferenced to be used as a r or l-value and represents the
- * tentative address within this entry that will become invalid once this entry
- * is removed or the hashmap is freed.
+ * tentative address within this entry that will become invalid once anything
+ * is put into or removed from the hashmap, or the hashmap is freed.
  */
 void **
 hashmap_get(HashMap hashmap, const void *key, size_t key_size, size_t hash)
 {
-	struct HashMapNode *node =
-		hashmap_get_node(hashmap, key, key_size, hash);
+	if (!hashmap)
+		return NULL;
+
+	struct HashMapKey lookup = {key, key_size};
+	struct HashMapNode *node = hashmap_lookup(hashmap, &lookup, hash);
 	if (!node)
 		return NULL;
 	return &node->value;
@@ -149,24 +114,16 @@ hashmap_get(HashMap hashmap, const void *key, size_t key_size, size_t hash)
 void
 hashmap_remove(HashMap hashmap, const void *key, size_t key_size, size_t hash)
 {
-	struct HashMapNode *node =
-		hashmap_get_node(hashmap, key, key_size, hash);
-	if (!node)
+	if (!hashmap)
 		return;
 
-	if (node->last)
-	// Node is not the first item in the list
-		node->last->next = node->next;
-	else
-	// Since node is the first, we need to adjust the bucket list
-		hashmap->buckets[hash % hashmap->num_buckets] = node->next;
-
-	if (node->next)
-		node->next->last = node->last;
+	struct HashMapKey lookup = {key, key_size};
+	hashmap_erase(hashmap, &lookup, hash);
 }
 
 /**
  * Initializes a hashmap iterator to begin iterating
+ * Putting into or removing from the hashmap invalidates the iterator.
  * @param it A pointer to the uninitialized hash map iterator structure
  * @param hashmap The hashmap to iterate
  */
@@ -174,9 +131,9 @@ void hashmap_iterator_init(struct HashMapIterator *it, HashMap hashmap)
 {
 	if (!it)
 		return;
-	it->bucket_index = 0;
+	it->table = 0;
+	it->index = 0;
 	it->hashmap = hashmap;
-	it->current_node = (hashmap) ? hashmap->buckets[0] : NULL;
 }
 
 /**
@@ -189,16 +146,5 @@ struct HashMapNode *hashmap_iterate(struct HashMapIterator *it)
 	if (!it || !it->hashmap)
 		return NULL;
 
-	// Find the next bucket to iterate through
-	while (!it->current_node) {
-		if (it->bucket_index >= it->hashmap->num_buckets - 1)
-			return NULL;
-		it->current_node = it->hashmap->buckets[++it->bucket_index];
-	}
-
-	struct HashMapNode *element = it->current_node;
-	if (!element)
-		return NULL;
-	it->current_node = it->current_node->next;
-	return element;
+	return hashmap_next(it->hashmap, &it->table, &it->index);
 }
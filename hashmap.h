@@ -8,19 +8,21 @@ struct HashMapNode {
 	void *key;
 	size_t key_size;
 	void *value;
-	struct HashMapNode *next;
-	struct HashMapNode *last;
+	// The hash that the entry was inserted with, kept so that entries can
+	// be moved between tables without calling the hash function again
+	size_t hash;
 };
 
 typedef struct HashMap *HashMap;
 
 struct HashMapIterator {
-	size_t bucket_index;
-	struct HashMapNode *current_node;
+	// 0 is the live table and 1 is the table being migrated out of
+	int table;
+	size_t index;
 	HashMap hashmap;
 };
 
-HashMap hashmap_new(size_t num_buckets);
+HashMap hashmap_new(size_t capacity);
 void hashmap_free(HashMap);
 int hashmap_put(HashMap, const void *k, size_t key_size, const void *value,
 	size_t hash);
@@ -0,0 +1,152 @@
+/* Headless mode draws a fixed number of frames along a scripted camera path
+ * into an offscreen surface, without opening a window. It prints how long each
+ * frame took, so rendering can be profiled on machines without a display, and
+ * can save every frame for pixel-exact comparisons between builds.
+ */
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "headless.h"
+#include "render.h"
+#include "world.h"
+#include "entity.h"
+#include "globals.h"
+#include "trace.h"
+
+// How far apart the logs placed along the camera path are
+#define LOG_SPACING 8
+
+/**
+ * Moves the view to where the camera path is at a frame
+ * The path only depends on the frame, so every run draws the same frames.
+ * @param view The player view
+ * @param frame The frame
+ */
+static void camera_path(struct PlayerView *view, unsigned frame)
+{
+	// Pan right at 15 tiles per second while bobbing up and down
+	view->center_x = -100.0 + frame * 0.25;
+	view->center_y = 3.0 * sin(frame * 0.02) - 2.0;
+}
+
+/**
+ * Builds the world that headless mode draws
+ * @param world The world
+ * @return 0 on success and a negative value on error
+ */
+static int headless_world(World world)
+{
+	if (world_generate_flat(world) < 0)
+		return -1;
+
+	// Some variety along the path, so that chunks aren't all alike
+	for (int x = -16 * CHUNK_LENGTH; x < 16 * CHUNK_LENGTH;
+		x += LOG_SPACING)
+		if (world_fill_block(world, x, 0, x, x & 7 ? 2 : 5, TILE_LOG) < 0)
+			return -1;
+
+	for (int i = 0; i < 4; ++i) {
+		if (entity_spawn_cow(&world->entities, -90.0 + i * 20.0,
+			0.0) == ENTITY_NONE)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Compares frame times for qsort
+ */
+static int compare_times(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Draws frames along the camera path into an offscreen surface, printing how
+ * long each took
+ * The surface and world are left in g_surface and g_world for destroy.
+ * @param options What to draw
+ * @return 0 on success and a negative value on error
+ */
+int headless_run(const struct HeadlessOptions *options)
+{
+	g_surface = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+		0xFF0000, 0xFF00, 0xFF, 0);
+	if (!g_surface)
+		return -1;
+
+	if (render_init() < 0)
+		return -1;
+
+	g_world = world_new();
+	if (!g_world)
+		return -1;
+	if (headless_world(g_world) < 0)
+		return -1;
+
+	// Nothing is simulated, so entities are drawn where they are
+	struct PlayerView view = {.width = 25, .alpha = 1};
+	if (sprites_update(&view) < 0)
+		return -1;
+
+	double *times = malloc(options->frames * sizeof(*times));
+	if (!times && options->frames) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+
+	if (options->hud)
+		hud_toggle();
+
+	const double frequency = SDL_GetPerformanceFrequency();
+	puts("frame,ms,pixels_drawn");
+	for (unsigned i = 0; i < options->frames; ++i) {
+		TRACE_FRAME();
+		camera_path(&view, i);
+		uint64_t pixels = g_render_stats.pixels_drawn;
+
+		Uint64 start = SDL_GetPerformanceCounter();
+		if (render_frame(g_world, &view, options->mode) < 0)
+			goto error;
+		if (hud_draw(g_world) < 0)
+			goto error;
+		times[i] = (SDL_GetPerformanceCounter() - start) * 1000.0
+			/ frequency;
+		hud_push_frame(&(struct FrameTimes) {
+			.frame_ms = times[i],
+			.render_ms = times[i],
+		});
+
+		printf("%u,%.4f,%llu\n", i, times[i], (unsigned long long)
+			(g_render_stats.pixels_drawn - pixels));
+
+		if (options->dump_dir) {
+			char path[4096];
+			snprintf(path, sizeof(path), "%s/frame%05u.bmp",
+				options->dump_dir, i);
+			if (SDL_SaveBMP(g_surface, path) < 0)
+				goto error;
+		}
+	}
+
+	if (options->frames) {
+		double total = 0;
+		for (unsigned i = 0; i < options->frames; ++i)
+			total += times[i];
+		qsort(times, options->frames, sizeof(*times), compare_times);
+		fprintf(stderr, "%u frames: mean %.4f ms, median %.4f ms, "
+			"p95 %.4f ms, max %.4f ms\n", options->frames,
+			total / options->frames, times[options->frames / 2],
+			times[options->frames * 95 / 100],
+			times[options->frames - 1]);
+	}
+
+	free(times);
+	return 0;
+error:
+	free(times);
+	return -1;
+}
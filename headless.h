@@ -0,0 +1,19 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdbool.h>
+#include "render.h"
+
+struct HeadlessOptions {
+	// How many frames to draw
+	unsigned frames;
+	enum RenderMode mode;
+	// The directory frames are saved to as BMPs, or NULL to not save them
+	const char *dump_dir;
+	// Whether the HUD is drawn over the frames
+	bool hud;
+};
+
+int headless_run(const struct HeadlessOptions *options);
+
+#endif // HEADLESS_H
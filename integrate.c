@@ -0,0 +1,217 @@
+#include "integrate.h"
+#include "physics.h"
+#include "trace.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// What every entity in a batch shares, worked out once per batch
+struct IntegrateConstants {
+	double t;
+	// smooth_damp's omega, e^-(omega * t) and largest change, for
+	// INTEGRATE_SMOOTH_TIME and INTEGRATE_MAX_SPEED
+	double omega, exp, max_change;
+	// How much velocity_y changes by
+	double gravity;
+};
+
+static void integrate_scalar(struct EntityPool *pool, size_t begin,
+	size_t end, const struct IntegrateConstants *c);
+#ifdef SIMD_X86
+static void integrate_sse2(struct EntityPool *pool, size_t begin, size_t end,
+	const struct IntegrateConstants *c);
+SIMD_TARGET_AVX
+static void integrate_avx(struct EntityPool *pool, size_t begin, size_t end,
+	const struct IntegrateConstants *c);
+#endif
+
+/**
+ * Damps the horizontal velocity of a range of entities towards the velocity
+ * they want, applies gravity to their vertical velocity and moves them
+ * horizontally
+ * The kernels differ from the scalar one at most by rounding, since they do the
+ * same operations in the same order.
+ * @param pool The pool
+ * @param begin The index of the first entity
+ * @param end The index after the last entity
+ * @param t The length of the tick
+ * @param kernel The kernel to use, which must be supported. See simd_best.
+ */
+void integrate_entities(struct EntityPool *pool, size_t begin, size_t end,
+	double t, enum SimdLevel kernel)
+{
+	TRACE_ZONE("integrate_entities");
+	if (end > pool->len)
+		end = pool->len;
+	if (begin >= end)
+		return;
+
+	// What smooth_damp works out on every call
+	struct IntegrateConstants c = {
+		.t = t,
+		.omega = 2.0 / INTEGRATE_SMOOTH_TIME,
+		.exp = expappr(2.0 / INTEGRATE_SMOOTH_TIME * t),
+		.max_change = INTEGRATE_MAX_SPEED * INTEGRATE_SMOOTH_TIME,
+		.gravity = t * INTEGRATE_GRAVITY,
+	};
+
+	switch (kernel) {
+#ifdef SIMD_X86
+	case SIMD_SSE2:
+		integrate_sse2(pool, begin, end, &c);
+		break;
+	case SIMD_AVX:
+		integrate_avx(pool, begin, end, &c);
+		break;
+#endif
+	default:
+		integrate_scalar(pool, begin, end, &c);
+		break;
+	}
+}
+
+/**
+ * Integrates entities one at a time, which the other kernels also use for
+ * what's left over after their last full vector
+ * @param pool The pool
+ * @param begin The index of the first entity
+ * @param end The index after the last entity
+ * @param c The constants for the batch
+ */
+static void integrate_scalar(struct EntityPool *pool, size_t begin,
+	size_t end, const struct IntegrateConstants *c)
+{
+	for (size_t i = begin; i < end; ++i) {
+		pool->velocity_x[i] = smooth_damp(
+			pool->velocity_x[i],
+			pool->desired_velocity_x[i],
+			&pool->acceleration_x[i],
+			INTEGRATE_SMOOTH_TIME,
+			INTEGRATE_MAX_SPEED,
+			c->t);
+		pool->x[i] += pool->velocity_x[i] * c->t;
+
+		pool->velocity_y[i] -= c->gravity;
+		if (pool->velocity_y[i] < -INTEGRATE_TERMINAL_VELOCITY)
+			pool->velocity_y[i] = -INTEGRATE_TERMINAL_VELOCITY;
+	}
+}
+
+#ifdef SIMD_X86
+/**
+ * Integrates entities two at a time with SSE2
+ * @param pool The pool
+ * @param begin The index of the first entity
+ * @param end The index after the last entity
+ * @param c The constants for the batch
+ */
+static void integrate_sse2(struct EntityPool *pool, size_t begin, size_t end,
+	const struct IntegrateConstants *c)
+{
+	const __m128d t = _mm_set1_pd(c->t);
+	const __m128d omega = _mm_set1_pd(c->omega);
+	const __m128d exp = _mm_set1_pd(c->exp);
+	const __m128d max_change = _mm_set1_pd(c->max_change);
+	const __m128d min_change = _mm_set1_pd(-c->max_change);
+	const __m128d gravity = _mm_set1_pd(c->gravity);
+	const __m128d terminal = _mm_set1_pd(-INTEGRATE_TERMINAL_VELOCITY);
+
+	size_t i = begin;
+	for (; i + 2 <= end; i += 2) {
+		__m128d current = _mm_loadu_pd(&pool->velocity_x[i]);
+		__m128d desired = _mm_loadu_pd(&pool->desired_velocity_x[i]);
+		__m128d velocity = _mm_loadu_pd(&pool->acceleration_x[i]);
+
+		// smooth_damp, step for step
+		__m128d change = _mm_sub_pd(current, desired);
+		change = _mm_min_pd(_mm_max_pd(change, min_change), max_change);
+		__m128d target = _mm_sub_pd(current, change);
+		__m128d temp = _mm_mul_pd(_mm_add_pd(velocity,
+			_mm_mul_pd(omega, change)), t);
+		velocity = _mm_mul_pd(_mm_sub_pd(velocity,
+			_mm_mul_pd(omega, temp)), exp);
+		__m128d next = _mm_add_pd(target,
+			_mm_mul_pd(_mm_add_pd(change, temp), exp));
+
+		// Lanes that didn't overshoot keep their value, and the rest
+		// snap to the desired velocity
+		__m128d kept = _mm_xor_pd(_mm_cmpgt_pd(desired, current),
+			_mm_cmpgt_pd(next, desired));
+		next = _mm_or_pd(_mm_and_pd(kept, next),
+			_mm_andnot_pd(kept, desired));
+		velocity = _mm_and_pd(kept, velocity);
+
+		_mm_storeu_pd(&pool->velocity_x[i], next);
+		_mm_storeu_pd(&pool->acceleration_x[i], velocity);
+		_mm_storeu_pd(&pool->x[i], _mm_add_pd(
+			_mm_loadu_pd(&pool->x[i]), _mm_mul_pd(next, t)));
+
+		__m128d velocity_y = _mm_sub_pd(
+			_mm_loadu_pd(&pool->velocity_y[i]), gravity);
+		_mm_storeu_pd(&pool->velocity_y[i],
+			_mm_max_pd(velocity_y, terminal));
+	}
+	integrate_scalar(pool, i, end, c);
+}
+
+/**
+ * Integrates entities four at a time with AVX, which is only used once
+ * simd_supported says the CPU has it
+ * @param pool The pool
+ * @param begin The index of the first entity
+ * @param end The index after the last entity
+ * @param c The constants for the batch
+ */
+SIMD_TARGET_AVX
+static void integrate_avx(struct EntityPool *pool, size_t begin, size_t end,
+	const struct IntegrateConstants *c)
+{
+	const __m256d t = _mm256_set1_pd(c->t);
+	const __m256d omega = _mm256_set1_pd(c->omega);
+	const __m256d exp = _mm256_set1_pd(c->exp);
+	const __m256d max_change = _mm256_set1_pd(c->max_change);
+	const __m256d min_change = _mm256_set1_pd(-c->max_change);
+	const __m256d gravity = _mm256_set1_pd(c->gravity);
+	const __m256d terminal = _mm256_set1_pd(-INTEGRATE_TERMINAL_VELOCITY);
+
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m256d current = _mm256_loadu_pd(&pool->velocity_x[i]);
+		__m256d desired = _mm256_loadu_pd(
+			&pool->desired_velocity_x[i]);
+		__m256d velocity = _mm256_loadu_pd(&pool->acceleration_x[i]);
+
+		// smooth_damp, step for step
+		__m256d change = _mm256_sub_pd(current, desired);
+		change = _mm256_min_pd(_mm256_max_pd(change, min_change),
+			max_change);
+		__m256d target = _mm256_sub_pd(current, change);
+		__m256d temp = _mm256_mul_pd(_mm256_add_pd(velocity,
+			_mm256_mul_pd(omega, change)), t);
+		velocity = _mm256_mul_pd(_mm256_sub_pd(velocity,
+			_mm256_mul_pd(omega, temp)), exp);
+		__m256d next = _mm256_add_pd(target,
+			_mm256_mul_pd(_mm256_add_pd(change, temp), exp));
+
+		// Lanes that didn't overshoot keep their value, and the rest
+		// snap to the desired velocity
+		__m256d kept = _mm256_xor_pd(
+			_mm256_cmp_pd(desired, current, _CMP_GT_OQ),
+			_mm256_cmp_pd(next, desired, _CMP_GT_OQ));
+		next = _mm256_blendv_pd(desired, next, kept);
+		velocity = _mm256_and_pd(kept, velocity);
+
+		_mm256_storeu_pd(&pool->velocity_x[i], next);
+		_mm256_storeu_pd(&pool->acceleration_x[i], velocity);
+		_mm256_storeu_pd(&pool->x[i], _mm256_add_pd(
+			_mm256_loadu_pd(&pool->x[i]), _mm256_mul_pd(next, t)));
+
+		__m256d velocity_y = _mm256_sub_pd(
+			_mm256_loadu_pd(&pool->velocity_y[i]), gravity);
+		_mm256_storeu_pd(&pool->velocity_y[i],
+			_mm256_max_pd(velocity_y, terminal));
+	}
+	integrate_scalar(pool, i, end, c);
+}
+#endif
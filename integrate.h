@@ -0,0 +1,27 @@
+/* Moves entities without looking at the world: smooth damping towards their
+ * desired horizontal velocity, gravity with terminal velocity, and horizontal
+ * movement. These are the same for every entity, so they run over whole
+ * ranges of a pool's arrays at once, several entities per instruction where
+ * the CPU allows. Collisions, and vertical movement which depends on where
+ * horizontal collisions put the entity, are left to physics.c.
+ */
+
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "entity.h"
+#include "simd.h"
+
+// The horizontal velocity of entities is smoothed over this many seconds, and
+// changes by at most MAX_SPEED per second
+#define INTEGRATE_SMOOTH_TIME 0.1
+#define INTEGRATE_MAX_SPEED 1000.0
+#define INTEGRATE_GRAVITY 9.81
+#define INTEGRATE_TERMINAL_VELOCITY 9.81
+
+void integrate_entities(struct EntityPool *, size_t begin, size_t end,
+	double t, enum SimdLevel);
+
+#endif // INTEGRATE_H
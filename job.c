@@ -0,0 +1,668 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+
+#include "job.h"
+#include "globals.h"
+#include "trace.h"
+
+// How many jobs a worker's deque holds, which must be a power of two. Jobs
+// pushed onto a full deque go to the shared queue instead.
+#define JOB_DEQUE_SIZE 4096
+// How many pieces job_parallel_for splits a loop into per thread when it isn't
+// given a grain, so that threads that finish early can steal some
+#define JOB_PIECES_PER_THREAD 4
+
+// A job with the counter it reports to
+struct QueuedJob {
+	JobFunction function;
+	void *data;
+	struct JobCounter *counter;
+};
+
+// A job in a deque. A thief may read a slot while the owner reuses it, in
+// which case it fails to take the job and throws away what it read, so the
+// fields are atomic to make the read harmless.
+struct JobSlot {
+	_Atomic(JobFunction) function;
+	_Atomic(void *) data;
+	_Atomic(struct JobCounter *) counter;
+};
+
+// Jobs held back by job_submit_after
+struct JobBatch {
+	struct JobBatch *next;
+	struct JobCounter *done;
+	size_t n;
+	struct Job jobs[];
+};
+
+// A Chase-Lev deque. The owner pushes and pops at the bottom, and thieves take
+// from the top.
+struct JobDeque {
+	_Atomic int64_t top, bottom;
+	struct JobSlot slots[JOB_DEQUE_SIZE];
+};
+
+struct JobWorker {
+	JobSystem system;
+	SDL_Thread *thread;
+	struct JobDeque deque;
+};
+
+struct JobSystem {
+	struct JobWorker *workers;
+	unsigned num_workers;
+	atomic_bool running;
+
+	// A ring buffer of the jobs submitted from threads that aren't workers
+	SDL_mutex *shared_lock;
+	struct QueuedJob *shared;
+	size_t shared_head, shared_capacity;
+	// Only changed with shared_lock held, but read without it to skip
+	// taking the lock when the queue is empty
+	atomic_size_t shared_len;
+
+	// How many jobs are queued anywhere, which idle workers sleep until
+	// isn't zero
+	atomic_size_t queued;
+	atomic_uint sleeping;
+	SDL_mutex *sleep_lock;
+	SDL_cond *wake;
+};
+
+// The worker running on this thread, or NULL if it isn't a worker
+static _Thread_local struct JobWorker *job_self;
+// State for picking which worker to steal from
+static _Thread_local uint64_t job_rng = 0x9E3779B97F4A7C15ull;
+
+static int job_worker_run(void *data);
+static struct JobWorker *job_worker_self(JobSystem system);
+static int job_enqueue(JobSystem system, const struct Job *jobs, size_t n,
+	struct JobCounter *counter);
+static bool job_find(JobSystem system, struct QueuedJob *job);
+static void job_execute(JobSystem system, const struct QueuedJob *job);
+static void job_counter_finish(JobSystem system, struct JobCounter *counter);
+static void job_counter_lock(struct JobCounter *counter);
+static void job_counter_unlock(struct JobCounter *counter);
+static bool job_deque_push(struct JobDeque *deque, const struct Job *job,
+	struct JobCounter *counter);
+static bool job_deque_pop(struct JobDeque *deque, struct QueuedJob *job);
+static bool job_deque_steal(struct JobDeque *deque, struct QueuedJob *job);
+static void job_slot_read(struct JobSlot *slot, struct QueuedJob *job);
+
+/**
+ * Starts a job system
+ * The thread that waits on a counter runs jobs while it waits, so it counts as
+ * one of the threads and one less worker thread is started. With one thread,
+ * jobs only ever run in job_wait.
+ * @param threads How many threads run jobs, or 0 for one per core
+ * @return The job system, or NULL if an error occurred
+ */
+JobSystem job_system_new(unsigned threads)
+{
+	if (!threads) {
+		int cores = SDL_GetCPUCount();
+		threads = cores > 0 ? cores : 1;
+	}
+
+	JobSystem system = calloc(1, sizeof(*system));
+	if (!system) {
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+	atomic_init(&system->running, true);
+	atomic_init(&system->shared_len, 0);
+	atomic_init(&system->queued, 0);
+	atomic_init(&system->sleeping, 0);
+
+	system->shared_lock = SDL_CreateMutex();
+	system->sleep_lock = SDL_CreateMutex();
+	system->wake = SDL_CreateCond();
+	system->workers = calloc(threads - 1, sizeof(*system->workers));
+	if (!system->shared_lock || !system->sleep_lock || !system->wake ||
+		(threads > 1 && !system->workers)) {
+		job_system_free(system);
+		return NULL;
+	}
+
+	// Every deque has to be ready before any worker tries stealing from it
+	system->num_workers = threads - 1;
+	for (unsigned i = 0; i < system->num_workers; ++i) {
+		system->workers[i].system = system;
+		atomic_init(&system->workers[i].deque.top, 0);
+		atomic_init(&system->workers[i].deque.bottom, 0);
+	}
+	for (unsigned i = 0; i < system->num_workers; ++i) {
+		struct JobWorker *worker = &system->workers[i];
+		worker->thread = SDL_CreateThread(job_worker_run, "job worker",
+			worker);
+		if (!worker->thread) {
+			job_system_free(system);
+			return NULL;
+		}
+	}
+	return system;
+}
+
+/**
+ * Stops a job system's workers and frees it
+ * Jobs that haven't run by then never will, so anything submitted should be
+ * waited on first.
+ * @param system The job system
+ */
+void job_system_free(JobSystem system)
+{
+	if (!system)
+		return;
+
+	atomic_store(&system->running, false);
+	if (system->sleep_lock) {
+		SDL_LockMutex(system->sleep_lock);
+		SDL_CondBroadcast(system->wake);
+		SDL_UnlockMutex(system->sleep_lock);
+	}
+	// Workers that failed to start have no thread, which is skipped
+	for (unsigned i = 0; i < system->num_workers; ++i)
+		SDL_WaitThread(system->workers[i].thread, NULL);
+
+	free(system->workers);
+	free(system->shared);
+	SDL_DestroyCond(system->wake);
+	SDL_DestroyMutex(system->sleep_lock);
+	SDL_DestroyMutex(system->shared_lock);
+	free(system);
+}
+
+/**
+ * Gets how many threads run a job system's jobs
+ * @param system The job system
+ * @return The number of workers plus one for the thread that waits
+ */
+unsigned job_system_threads(JobSystem system)
+{
+	return system->num_workers + 1;
+}
+
+/**
+ * Initializes a counter at zero
+ * @param counter The counter
+ */
+void job_counter_init(struct JobCounter *counter)
+{
+	atomic_init(&counter->pending, 0);
+	atomic_flag_clear(&counter->lock);
+	counter->waiting = NULL;
+}
+
+/**
+ * Queues jobs to run on any thread
+ * From a worker, jobs go onto its own deque, where they run in the reverse
+ * order they were submitted unless other workers steal them.
+ * @param system The job system
+ * @param jobs The jobs, which are copied
+ * @param n How many jobs there are
+ * @param done The counter that each job decrements when it finishes, or NULL
+ * @return 0 on success and a negative value on error
+ */
+int job_submit(JobSystem system, const struct Job *jobs, size_t n,
+	struct JobCounter *done)
+{
+	if (!system || !n)
+		return n ? -1 : 0;
+	if (done)
+		atomic_fetch_add(&done->pending, n);
+	return job_enqueue(system, jobs, n, done);
+}
+
+/**
+ * Queues jobs to run once every job counted by another counter has finished
+ * @param system The job system
+ * @param after The counter to wait for
+ * @param jobs The jobs, which are copied
+ * @param n How many jobs there are
+ * @param done The counter that each job decrements when it finishes, or NULL,
+ * 	which counts the jobs from now on
+ * @return 0 on success and a negative value on error
+ */
+int job_submit_after(JobSystem system, struct JobCounter *after,
+	const struct Job *jobs, size_t n, struct JobCounter *done)
+{
+	if (!system || !after || !n)
+		return n ? -1 : 0;
+
+	struct JobBatch *batch = malloc(sizeof(*batch) + n * sizeof(*jobs));
+	if (!batch) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	batch->done = done;
+	batch->n = n;
+	memcpy(batch->jobs, jobs, n * sizeof(*jobs));
+	if (done)
+		atomic_fetch_add(&done->pending, n);
+
+	// The last job of after decrements it with the lock held, so either
+	// it sees this batch or this sees it at zero
+	job_counter_lock(after);
+	if (atomic_load(&after->pending) > 0) {
+		batch->next = after->waiting;
+		after->waiting = batch;
+		job_counter_unlock(after);
+		return 0;
+	}
+	job_counter_unlock(after);
+
+	int ret = job_enqueue(system, batch->jobs, n, done);
+	free(batch);
+	return ret;
+}
+
+/**
+ * Runs jobs until a counter reaches zero
+ * @param system The job system
+ * @param counter The counter
+ */
+void job_wait(JobSystem system, struct JobCounter *counter)
+{
+	TRACE_ZONE("job_wait");
+	while (atomic_load_explicit(&counter->pending,
+		memory_order_acquire) > 0) {
+		struct QueuedJob job;
+		if (job_find(system, &job))
+			job_execute(system, &job);
+		else
+			// The jobs left are running on other threads
+			SDL_Delay(0);
+	}
+	// The last job to finish may still be holding the lock
+	job_counter_lock(counter);
+	job_counter_unlock(counter);
+}
+
+// One piece of a job_parallel_for loop
+struct ParallelRange {
+	void (*function)(void *data, size_t begin, size_t end);
+	void *data;
+	size_t begin, end;
+};
+
+/**
+ * Runs one piece of a job_parallel_for loop
+ * @param data The struct ParallelRange
+ */
+static void parallel_range_run(void *data)
+{
+	struct ParallelRange *range = data;
+	range->function(range->data, range->begin, range->end);
+}
+
+/**
+ * Splits a loop over [0, n) into pieces, runs them in parallel and waits for
+ * them to finish
+ * @param system The job system
+ * @param n How many iterations there are
+ * @param grain How many iterations each piece has at most, or 0 to split the
+ * 	loop evenly between threads
+ * @param function Called with data and the range [begin, end) of each piece
+ * @param data Passed to function
+ * @return 0 on success and a negative value on error
+ */
+int job_parallel_for(JobSystem system, size_t n, size_t grain,
+	void (*function)(void *data, size_t begin, size_t end), void *data)
+{
+	if (!system || !function)
+		return -1;
+	if (!n)
+		return 0;
+	if (!grain) {
+		grain = n / (job_system_threads(system) *
+			JOB_PIECES_PER_THREAD);
+		if (!grain)
+			grain = 1;
+	}
+
+	const size_t pieces = (n + grain - 1) / grain;
+	struct Job *jobs = malloc(pieces *
+		(sizeof(struct Job) + sizeof(struct ParallelRange)));
+	if (!jobs) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	struct ParallelRange *ranges = (struct ParallelRange *) (jobs + pieces);
+	for (size_t i = 0; i < pieces; ++i) {
+		ranges[i] = (struct ParallelRange) {
+			.function = function,
+			.data = data,
+			.begin = i * grain,
+			.end = i + 1 < pieces ? (i + 1) * grain : n,
+		};
+		jobs[i] = (struct Job) {parallel_range_run, &ranges[i]};
+	}
+
+	struct JobCounter done;
+	job_counter_init(&done);
+	int ret = job_submit(system, jobs, pieces, &done);
+	if (ret >= 0)
+		job_wait(system, &done);
+	free(jobs);
+	return ret;
+}
+
+/**
+ * Runs jobs on a worker thread, sleeping whenever none are queued
+ * @param data The struct JobWorker
+ * @return 0 once the job system is freed
+ */
+static int job_worker_run(void *data)
+{
+	struct JobWorker *self = data;
+	JobSystem system = self->system;
+	job_self = self;
+	job_rng ^= (uintptr_t) self;
+	TRACE_THREAD_NAME("job worker");
+
+	while (atomic_load(&system->running)) {
+		struct QueuedJob job;
+		if (job_find(system, &job)) {
+			job_execute(system, &job);
+			continue;
+		}
+
+		// Submitters bump queued before checking for sleepers, and
+		// this checks queued with the lock held that they signal with
+		SDL_LockMutex(system->sleep_lock);
+		atomic_fetch_add(&system->sleeping, 1);
+		while (!atomic_load(&system->queued) &&
+			atomic_load(&system->running))
+			SDL_CondWait(system->wake, system->sleep_lock);
+		atomic_fetch_sub(&system->sleeping, 1);
+		SDL_UnlockMutex(system->sleep_lock);
+	}
+	return 0;
+}
+
+/**
+ * Gets the calling thread's worker
+ * @param system The job system
+ * @return The worker, or NULL if the thread isn't one of the system's workers
+ */
+static struct JobWorker *job_worker_self(JobSystem system)
+{
+	return job_self && job_self->system == system ? job_self : NULL;
+}
+
+/**
+ * Queues jobs on the calling worker's deque, or the shared queue if it isn't
+ * a worker or its deque is full, and wakes workers to run them
+ * @param system The job system
+ * @param jobs The jobs
+ * @param n How many jobs there are
+ * @param counter The counter the jobs report to, already counting them
+ * @return 0 on success and a negative value on error
+ */
+static int job_enqueue(JobSystem system, const struct Job *jobs, size_t n,
+	struct JobCounter *counter)
+{
+	// Counted first, so that queued never drops below zero when a job is
+	// taken as soon as it's pushed
+	atomic_fetch_add(&system->queued, n);
+
+	struct JobWorker *self = job_worker_self(system);
+	size_t i = 0;
+	if (self)
+		while (i < n && job_deque_push(&self->deque, &jobs[i], counter))
+			++i;
+
+	if (i < n) {
+		SDL_LockMutex(system->shared_lock);
+		size_t len = atomic_load(&system->shared_len);
+		if (len + n - i > system->shared_capacity) {
+			size_t capacity = system->shared_capacity
+				? system->shared_capacity : 64;
+			while (capacity < len + n - i)
+				capacity *= 2;
+			struct QueuedJob *shared = malloc(capacity *
+				sizeof(*shared));
+			if (!shared) {
+				SDL_UnlockMutex(system->shared_lock);
+				atomic_fetch_sub(&system->queued, n - i);
+				if (counter)
+					atomic_fetch_sub(&counter->pending,
+						n - i);
+				g_error_message = "malloc failed";
+				return -1;
+			}
+			for (size_t j = 0; j < len; ++j)
+				shared[j] = system->shared[(system->shared_head +
+					j) % system->shared_capacity];
+			free(system->shared);
+			system->shared = shared;
+			system->shared_head = 0;
+			system->shared_capacity = capacity;
+		}
+		for (; i < n; ++i, ++len)
+			system->shared[(system->shared_head + len) %
+				system->shared_capacity] = (struct QueuedJob) {
+				jobs[i].function, jobs[i].data, counter};
+		atomic_store(&system->shared_len, len);
+		SDL_UnlockMutex(system->shared_lock);
+	}
+
+	if (atomic_load(&system->sleeping)) {
+		SDL_LockMutex(system->sleep_lock);
+		if (n > 1)
+			SDL_CondBroadcast(system->wake);
+		else
+			SDL_CondSignal(system->wake);
+		SDL_UnlockMutex(system->sleep_lock);
+	}
+	return 0;
+}
+
+/**
+ * Takes a job from the calling worker's deque, then the shared queue, and
+ * then any other worker's deque
+ * @param system The job system
+ * @param job Set to the job
+ * @return Whether a job was found
+ */
+static bool job_find(JobSystem system, struct QueuedJob *job)
+{
+	struct JobWorker *self = job_worker_self(system);
+	bool found = self && job_deque_pop(&self->deque, job);
+
+	if (!found && atomic_load_explicit(&system->shared_len,
+		memory_order_relaxed)) {
+		SDL_LockMutex(system->shared_lock);
+		size_t len = atomic_load(&system->shared_len);
+		if (len) {
+			*job = system->shared[system->shared_head];
+			system->shared_head = (system->shared_head + 1) %
+				system->shared_capacity;
+			atomic_store(&system->shared_len, len - 1);
+			found = true;
+		}
+		SDL_UnlockMutex(system->shared_lock);
+	}
+
+	if (!found && system->num_workers) {
+		// xorshift64, starting from a different victim every time
+		job_rng ^= job_rng << 13;
+		job_rng ^= job_rng >> 7;
+		job_rng ^= job_rng << 17;
+		unsigned start = job_rng % system->num_workers;
+		for (unsigned i = 0; i < system->num_workers && !found; ++i) {
+			struct JobWorker *victim = &system->workers[
+				(start + i) % system->num_workers];
+			if (victim != self)
+				found = job_deque_steal(&victim->deque, job);
+		}
+	}
+
+	if (found)
+		atomic_fetch_sub(&system->queued, 1);
+	return found;
+}
+
+/**
+ * Runs a job and reports to its counter
+ * @param system The job system
+ * @param job The job
+ */
+static void job_execute(JobSystem system, const struct QueuedJob *job)
+{
+	job->function(job->data);
+	if (job->counter)
+		job_counter_finish(system, job->counter);
+}
+
+/**
+ * Decrements a counter, and queues the jobs waiting on it if it reached zero
+ * @param system The job system
+ * @param counter The counter
+ */
+static void job_counter_finish(JobSystem system, struct JobCounter *counter)
+{
+	// Whoever waits on the counter may free it as soon as it reaches zero,
+	// so the last decrement happens with the lock held, which job_wait
+	// takes before returning
+	int pending = atomic_load(&counter->pending);
+	while (pending > 1)
+		if (atomic_compare_exchange_weak(&counter->pending, &pending,
+			pending - 1))
+			return;
+
+	job_counter_lock(counter);
+	struct JobBatch *batch = NULL;
+	if (atomic_fetch_sub(&counter->pending, 1) == 1) {
+		batch = counter->waiting;
+		counter->waiting = NULL;
+	}
+	job_counter_unlock(counter);
+
+	while (batch) {
+		struct JobBatch *next = batch->next;
+		// There's nobody to report an error to, so the jobs are run
+		// right away instead
+		if (job_enqueue(system, batch->jobs, batch->n, batch->done) < 0)
+			for (size_t i = 0; i < batch->n; ++i)
+				job_execute(system, &(struct QueuedJob) {
+					batch->jobs[i].function,
+					batch->jobs[i].data, batch->done});
+		free(batch);
+		batch = next;
+	}
+}
+
+/**
+ * Takes a counter's lock, which is only ever held for a few instructions
+ * @param counter The counter
+ */
+static void job_counter_lock(struct JobCounter *counter)
+{
+	while (atomic_flag_test_and_set_explicit(&counter->lock,
+		memory_order_acquire))
+		;
+}
+
+/**
+ * Releases a counter's lock
+ * @param counter The counter
+ */
+static void job_counter_unlock(struct JobCounter *counter)
+{
+	atomic_flag_clear_explicit(&counter->lock, memory_order_release);
+}
+
+/**
+ * Pushes a job onto the bottom of a deque, which only its owner may do
+ * @param deque The deque
+ * @param job The job
+ * @param counter The counter the job reports to
+ * @return Whether there was room for the job
+ */
+static bool job_deque_push(struct JobDeque *deque, const struct Job *job,
+	struct JobCounter *counter)
+{
+	int64_t bottom = atomic_load_explicit(&deque->bottom,
+		memory_order_relaxed);
+	int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	if (bottom - top >= JOB_DEQUE_SIZE)
+		return false;
+
+	struct JobSlot *slot = &deque->slots[bottom & (JOB_DEQUE_SIZE - 1)];
+	atomic_store_explicit(&slot->function, job->function,
+		memory_order_relaxed);
+	atomic_store_explicit(&slot->data, job->data, memory_order_relaxed);
+	atomic_store_explicit(&slot->counter, counter, memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom + 1,
+		memory_order_release);
+	return true;
+}
+
+/**
+ * Pops the job at the bottom of a deque, which only its owner may do
+ * @param deque The deque
+ * @param job Set to the job
+ * @return Whether there was a job
+ */
+static bool job_deque_pop(struct JobDeque *deque, struct QueuedJob *job)
+{
+	int64_t bottom = atomic_load_explicit(&deque->bottom,
+		memory_order_relaxed) - 1;
+	// Thieves have to see bottom lowered before this reads top, or both
+	// could take the last job
+	atomic_store(&deque->bottom, bottom);
+	int64_t top = atomic_load(&deque->top);
+
+	if (top > bottom) {
+		atomic_store_explicit(&deque->bottom, bottom + 1,
+			memory_order_relaxed);
+		return false;
+	}
+
+	job_slot_read(&deque->slots[bottom & (JOB_DEQUE_SIZE - 1)], job);
+	if (top < bottom)
+		return true;
+
+	// The last job goes to whoever moves top past it first
+	bool won = atomic_compare_exchange_strong(&deque->top, &top, top + 1);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	return won;
+}
+
+/**
+ * Steals the job at the top of a deque
+ * @param deque The deque
+ * @param job Set to the job
+ * @return Whether a job was stolen, which can fail when another thread takes
+ * 	it first even though the deque isn't empty
+ */
+static bool job_deque_steal(struct JobDeque *deque, struct QueuedJob *job)
+{
+	int64_t top = atomic_load(&deque->top);
+	int64_t bottom = atomic_load(&deque->bottom);
+	if (top >= bottom)
+		return false;
+
+	job_slot_read(&deque->slots[top & (JOB_DEQUE_SIZE - 1)], job);
+	return atomic_compare_exchange_strong(&deque->top, &top, top + 1);
+}
+
+/**
+ * Reads a job out of a deque slot
+ * @param slot The slot
+ * @param job Set to the job
+ */
+static void job_slot_read(struct JobSlot *slot, struct QueuedJob *job)
+{
+	job->function = atomic_load_explicit(&slot->function,
+		memory_order_relaxed);
+	job->data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+	job->counter = atomic_load_explicit(&slot->counter,
+		memory_order_relaxed);
+}
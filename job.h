@@ -0,0 +1,48 @@
+/* A work-stealing job system. Every worker thread has its own deque of jobs,
+ * which it pushes to and pops from at one end while idle workers steal from
+ * the other. Threads that aren't workers submit through a shared queue.
+ *
+ * Jobs report to a JobCounter, which job_wait waits on while running other
+ * jobs, so a job can submit more jobs and wait for them without tying up its
+ * thread. job_submit_after holds jobs back until another counter reaches zero.
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef void (*JobFunction)(void *data);
+
+struct Job {
+	JobFunction function;
+	void *data;
+};
+
+// How many jobs are still to finish. Counters are initialized with
+// job_counter_init and can be reused once they reach zero.
+struct JobCounter {
+	atomic_int pending;
+	// Guards waiting
+	atomic_flag lock;
+	// Jobs submitted with job_submit_after to run once this reaches zero
+	struct JobBatch *waiting;
+};
+
+typedef struct JobSystem *JobSystem;
+
+JobSystem job_system_new(unsigned threads);
+void job_system_free(JobSystem);
+unsigned job_system_threads(JobSystem);
+
+void job_counter_init(struct JobCounter *);
+int job_submit(JobSystem, const struct Job *jobs, size_t n,
+	struct JobCounter *done);
+int job_submit_after(JobSystem, struct JobCounter *after,
+	const struct Job *jobs, size_t n, struct JobCounter *done);
+void job_wait(JobSystem, struct JobCounter *);
+int job_parallel_for(JobSystem, size_t n, size_t grain,
+	void (*function)(void *data, size_t begin, size_t end), void *data);
+
+#endif // JOB_H
@@ -1,21 +1,212 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
 #include <SDL2/SDL.h>
 
 #include "exit.h"
 #include "world.h"
+#include "terrain.h"
 #include "render.h"
 #include "entity.h"
 #include "event.h"
-#include "physics.h"
+#include "sim.h"
+#include "stream.h"
+#include "region.h"
+#include "saver.h"
+#include "snapshot.h"
+#include "job.h"
+#include "headless.h"
+#include "trace.h"
 #include "globals.h"
 
-int main(void)
+// How many chunks of the drawn world world_compact_step looks at every frame
+#define COMPACT_CHUNKS_PER_FRAME 64
+// Waits shorter than this many milliseconds spin on the performance counter
+// instead of sleeping, since SDL_Delay can oversleep by about as much
+#define PACING_SPIN_MS 2.0
+// How many chunks around the player's are kept generated along each axis,
+// which covers the view with room to spare
+#define STREAM_RADIUS 3
+// How often a saved world is saved again while the game runs
+#define AUTOSAVE_SECONDS 30
+
+/**
+ * Prints how to run the game
+ * @param name The name the program was run with
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [--headless] [--frames N] [--dump DIR] [--full]\n"
+		"       [--trace FILE] [--hud] [--tick-rate N] [--max-ticks N]\n"
+		"       [--fps N] [--seed N] [--chunk-memory N] [--world DIR]\n"
+		"  --headless    draw frames along a scripted path offscreen and\n"
+		"                print how long each took\n"
+		"  --frames N    how many frames to draw headless (default 600)\n"
+		"  --dump DIR    save every headless frame to DIR as a BMP\n"
+		"  --full        redraw every frame from scratch\n"
+		"  --trace FILE  write a Chrome trace to FILE on exit, in builds\n"
+		"                made with TRACING=1\n"
+		"  --hud         start with the HUD shown (toggled with F3)\n"
+		"  --tick-rate N simulate N ticks per second (default 60)\n"
+		"  --max-ticks N simulate at most N ticks per frame, falling\n"
+		"                behind when frames are slower (default 8)\n"
+		"  --fps N       draw at most N frames per second, or as many as\n"
+		"                possible if N is 0 (default 60)\n"
+		"  --seed N      generate the world from seed N (default the\n"
+		"                current time)\n"
+		"  --chunk-memory N\n"
+		"                unload chunks away from the player once they\n"
+		"                take up more than N MiB (default 16)\n"
+		"  --world DIR   save the world in DIR every 30 seconds and on\n"
+		"                exit, and carry on from it when run again\n",
+		name);
+}
+
+/**
+ * Parses a whole number from an argument
+ * @param arg The argument
+ * @param value Set to the number
+ * @return Whether the whole argument was a number
+ */
+static bool parse_unsigned(const char *arg, unsigned *value)
+{
+	char *end;
+	*value = strtoul(arg, &end, 10);
+	return *arg && !*end;
+}
+
+/**
+ * Saves a chunk the stream is about to unload
+ * @param data The Saver
+ * @param chunk The chunk
+ * @return 1 if it was saved, 0 if a save in progress keeps it from being
+ * 	saved yet, and a negative value on error
+ */
+static int save_chunk(void *data, Chunk chunk)
+{
+	return saver_save_chunk(data, chunk);
+}
+
+/**
+ * Loads a chunk for the stream, on any thread
+ * @param data The RegionStore
+ * @param cx The chunk column
+ * @param cy The chunk row
+ * @param chunk Set to the chunk, or to NULL if it was never saved
+ * @return 0 on success and a negative value on error
+ */
+static int load_chunk(void *data, int64_t cx, int64_t cy, Chunk *chunk)
+{
+	return region_load_chunk(data, cx, cy, chunk);
+}
+
+/**
+ * Waits until the performance counter reaches a value, sleeping for most of
+ * the wait and spinning for the rest
+ * @param deadline The performance counter value
+ */
+static void wait_until(Uint64 deadline)
+{
+	const double counter_ms = SDL_GetPerformanceFrequency() / 1000.0;
+	Uint64 now;
+	while ((now = SDL_GetPerformanceCounter()) < deadline) {
+		double ms = (deadline - now) / counter_ms;
+		if (ms > PACING_SPIN_MS)
+			SDL_Delay(ms - PACING_SPIN_MS);
+	}
+}
+
+int main(int argc, char **argv)
 {
+	bool headless = false;
+	unsigned tick_rate = 60;
+	unsigned max_ticks = 8;
+	unsigned fps = 60;
+	unsigned seed = time(NULL);
+	unsigned chunk_memory_mib = 16;
+	const char *world_dir = NULL;
+	struct HeadlessOptions options = {
+		.frames = 600,
+		.mode = RENDER_SCROLL,
+		.dump_dir = NULL,
+	};
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--headless")) {
+			headless = true;
+		} else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &options.frames)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--tick-rate") && i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &tick_rate) ||
+				!tick_rate) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--max-ticks") && i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &max_ticks) ||
+				!max_ticks) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &fps)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &seed)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--chunk-memory") &&
+			i + 1 < argc) {
+			if (!parse_unsigned(argv[++i], &chunk_memory_mib)) {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--world") && i + 1 < argc) {
+			world_dir = argv[++i];
+		} else if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+			options.dump_dir = argv[++i];
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			g_trace_path = argv[++i];
+		} else if (!strcmp(argv[i], "--hud")) {
+			options.hud = true;
+		} else if (!strcmp(argv[i], "--full")) {
+			options.mode = RENDER_FULL;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	TRACE_THREAD_NAME("main");
+
+	if (headless) {
+		// Surfaces and timers work without initializing any subsystem
+		if (SDL_Init(0) < 0)
+			raise_error();
+		g_jobs = job_system_new(0);
+		if (!g_jobs)
+			raise_error();
+		if (headless_run(&options) < 0)
+			raise_error();
+		destroy();
+		return 0;
+	}
+
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0)
 		raise_error();
+	g_jobs = job_system_new(0);
+	if (!g_jobs)
+		raise_error();
 
 	g_window = SDL_CreateWindow(
 		"NotMinecraft", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -31,42 +222,142 @@ int main(void)
 	if (render_init() < 0)
 		raise_error();
 
+	// A saved world keeps the seed it was generated from
+	uint64_t world_seed = seed;
+	if (world_dir) {
+		g_regions = region_store_open(world_dir);
+		if (!g_regions || region_store_seed(g_regions, &world_seed) < 0)
+			raise_error();
+	}
+
+	// The simulation runs on its own thread, and the main thread draws a
+	// copy of its world kept up to date from its snapshots
 	g_world = world_new();
 	if (!g_world)
 		raise_error();
 
-	if (world_generate_flat(g_world) < 0)
+	g_sim = sim_new(tick_rate, max_ticks);
+	if (!g_sim)
+		raise_error();
+	// The world is generated around the player as it moves, starting once
+	// the simulation does
+	g_sim->stream = stream_new(g_jobs, world_seed, STREAM_RADIUS);
+	if (!g_sim->stream)
 		raise_error();
+	g_sim->stream->budget = (size_t) chunk_memory_mib << 20;
+	if (g_regions) {
+		g_sim->saver = saver_new(g_regions);
+		if (!g_sim->saver)
+			raise_error();
+		g_sim->save_interval = AUTOSAVE_SECONDS * tick_rate;
+		g_sim->next_save = g_sim->save_interval;
+		g_sim->stream->save = save_chunk;
+		g_sim->stream->save_data = g_sim->saver;
+		g_sim->stream->load = load_chunk;
+		g_sim->stream->load_data = g_regions;
+	}
 
+	// A saved world's player carries on where it was
+	struct EntityPool *pool = &g_sim->world->entities;
+	if (g_regions && saver_load_entities(g_regions, pool) < 0)
+		raise_error();
+	g_sim->player = ENTITY_NONE;
+	for (size_t i = 0; i < pool->len && g_sim->player == ENTITY_NONE; ++i)
+		if (pool->type[i] == PLAYER_ENTITY)
+			g_sim->player = pool->handle[i];
+	if (g_sim->player == ENTITY_NONE) {
+		// The player stands on the higher of the two columns it
+		// straddles
+		int64_t spawn_y = terrain_surface_height(world_seed, -1);
+		if (terrain_surface_height(world_seed, 0) > spawn_y)
+			spawn_y = terrain_surface_height(world_seed, 0);
+		g_sim->player = entity_spawn_player(pool, 0, spawn_y + 1);
+		if (g_sim->player == ENTITY_NONE)
+			raise_error();
+	}
+
+	const size_t player = entity_index(pool, g_sim->player);
 	struct PlayerView player_view = {
-		.center_x = 0.0,
-		.center_y = 0.0,
+		.center_x = pool->x[player],
+		.center_y = pool->y[player],
 		.width = 25,
 	};
 
 	if (sprites_update(&player_view) < 0)
 		raise_error();
+	if (options.hud)
+		hud_toggle();
 
-	g_player = entity_new_player(0, 0);
-	if (!g_player)
+	if (sim_start(g_sim) < 0)
 		raise_error();
-	world_put_entity(g_world, g_player);
+
+	const double frequency = SDL_GetPerformanceFrequency();
+	const double counter_ms = frequency / 1000.0;
+	const double tick_counts = frequency / tick_rate;
+	const Uint64 frame_period = fps ? frequency / fps : 0;
+	Uint64 last_frame_start = SDL_GetPerformanceCounter();
+	Uint64 next_frame = last_frame_start;
+	struct PlayerInput input = {0};
 
 	for (;;) {
-		event_handler();
-		entity_update_physics(g_player, g_world, 1.0 / 60);
-		player_view.center_x = g_player->x;
-		player_view.center_y = g_player->y;
-
-		// stage the canvas and draw to it
-		if (SDL_FillRect(g_surface, NULL,
-			SDL_MapRGB(g_surface->format, 0, 0, 0)) < 0)
+		TRACE_FRAME();
+		Uint64 frame_start = SDL_GetPerformanceCounter();
+		event_handler(&input);
+		sim_set_input(g_sim, &input);
+		if (sim_failed(g_sim))
 			raise_error();
-		if (world_draw(g_world, &player_view) < 0)
+
+		struct Snapshot *snapshot = sim_snapshot(g_sim);
+		if (snapshot_apply(snapshot, g_world) < 0)
+			raise_error();
+		if (world_compact_step(g_world, COMPACT_CHUNKS_PER_FRAME) < 0)
 			raise_error();
+		hud_set_stream_stats(&snapshot->stream_stats);
+
+		// Entities are drawn partway between their last two ticks, as
+		// far as the time since the snapshot's tick ended is into the
+		// next one, and the camera follows the player where it's drawn
+		player_view.alpha = frame_start > snapshot->time
+			? (frame_start - snapshot->time) / tick_counts : 0.0;
+		if (player_view.alpha > 1.0)
+			player_view.alpha = 1.0;
+		if (snapshot->player != SIZE_MAX) {
+			const struct EntityTransform *player =
+				&snapshot->entities[snapshot->player];
+			player_view.center_x = player->prev_x +
+				(player->x - player->prev_x) *
+				player_view.alpha;
+			player_view.center_y = player->prev_y +
+				(player->y - player->prev_y) *
+				player_view.alpha;
+		}
+
+		Uint64 sim_end = SDL_GetPerformanceCounter();
+		if (render_frame(g_world, &player_view, options.mode) < 0)
+			raise_error();
+		if (hud_draw(g_world) < 0)
+			raise_error();
+		Uint64 render_end = SDL_GetPerformanceCounter();
 		if (SDL_UpdateWindowSurface(g_window) < 0)
 			raise_error();
-		SDL_Delay(1000 / 60);
+
+		hud_push_frame(&(struct FrameTimes) {
+			.frame_ms = (frame_start - last_frame_start) / counter_ms,
+			.sim_ms = sim_batch_ms(g_sim),
+			.render_ms = (render_end - sim_end) / counter_ms,
+		});
+		last_frame_start = frame_start;
+
+		if (frame_period) {
+			// A frame that ran late doesn't make the next ones
+			// hurry to catch up
+			next_frame += frame_period;
+			Uint64 now = SDL_GetPerformanceCounter();
+			if (next_frame < now)
+				next_frame = now;
+			else
+				wait_until(next_frame);
+		}
 	}
 
 	destroy();
@@ -1,15 +1,19 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h> // TENTATIVE
+#include <string.h>
 #include "physics.h"
+#include "integrate.h"
 #include "entity.h"
 #include "world.h"
+#include "trace.h"
 
 static double clamp(double lower, double higher, double val);
-static double expappr(double x);
-static void entity_hitbox_blockrange(Entity entity,
+static void entity_hitbox_blockrange(const struct EntityPool *pool, size_t i,
 	double *x1, double *x2,
 	double *y1, double *y2);
+static void entity_collide(struct EntityPool *pool, size_t i, World world,
+	double t);
 
 /**
  * Uses a critical smooth dampening function to step a value in the direction of
@@ -84,7 +88,7 @@ static double clamp(double low, double high, double val)
  * @param x The variable
  * @return The approximation
  */
-static double expappr(double x)
+double expappr(double x)
 {
 	// The values of this function were obtained by using Wolfram Alpha
 	// This is a partial Taylor Series
@@ -102,118 +106,172 @@ static double expappr(double x)
 
 /**
  * Checks if an entity is colliding with a block's hitbox
- * @param The entity to check for collision
- * @param The world
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param world The world
  * @return Whether or not an entity is intersecting with a block hitbox
  */
-bool entity_is_colliding(Entity entity, World world)
+bool entity_is_colliding(const struct EntityPool *pool, size_t i, World world)
 {
-	if (!entity || !world)
+	if (!world || i >= pool->len)
 		return false;
 
-	int64_t x1 = floor(entity->x - entity->hitbox_width);
-	int64_t x2 = floor(entity->x + entity->hitbox_width);
-	int64_t y1 = floor(entity->y - entity->hitbox_height);
-	int64_t y2 = floor(entity->y + entity->hitbox_height);
-
-	for (int64_t y = y1; y <= y2; ++y)
-		for (int64_t x = x1; x <= x2; ++x) {
-			enum BlockID block = world_get_block(world, x, y);
-			if (block != TILE_AIR)
-				return true;
-		}
-	return false;
+	int64_t x1 = floor(pool->x[i] - pool->hitbox_width[i]);
+	int64_t x2 = floor(pool->x[i] + pool->hitbox_width[i]);
+	int64_t y1 = floor(pool->y[i] - pool->hitbox_height[i]);
+	int64_t y2 = floor(pool->y[i] + pool->hitbox_height[i]);
+
+	return world_query_solid_aabb(world, x1, y1, x2, y2);
 }
 
-static void entity_hitbox_blockrange(Entity entity,
+static void entity_hitbox_blockrange(const struct EntityPool *pool, size_t i,
 	double *x1, double *x2,
 	double *y1, double *y2)
 {
-	*x1 = entity->x - entity->hitbox_width / 2.0;
-	*x2 = entity->x + entity->hitbox_width / 2.0;
-	*y1 = entity->y;
-	*y2 = entity->y + entity->hitbox_height;
+	*x1 = pool->x[i] - pool->hitbox_width[i] / 2.0;
+	*x2 = pool->x[i] + pool->hitbox_width[i] / 2.0;
+	*y1 = pool->y[i];
+	*y2 = pool->y[i] + pool->hitbox_height[i];
 }
 
-double entity_collcheck_ver(Entity entity, World world)
+/**
+ * Finds how far an entity has to move vertically to stop overlapping blocks
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param world The world
+ * @return The shortest distance to move, or 0 if it's not colliding
+ */
+double entity_collcheck_ver(const struct EntityPool *pool, size_t i,
+	World world)
 {
 	double x1, x2, y1, y2;
-	if (!entity || !world)
+	if (!world)
 		return 0.0;
 
-	// Determine the smallest shift required to
-	// uncollide the player vertically.
-	entity_hitbox_blockrange(entity, &x1, &x2, &y1, &y2);
-
-	int64_t ix1 = floor(x1);
-	int64_t ix2 = floor(x2);
-	int64_t iy1 = floor(y1);
-	int64_t iy2 = floor(y2);
+	entity_hitbox_blockrange(pool, i, &x1, &x2, &y1, &y2);
+	return world_query_free_shift_y(world, x1, y1, x2, y2);
+}
 
-	double best_shift = INFINITY;
+/**
+ * Finds how far an entity has to move horizontally to stop overlapping blocks
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param world The world
+ * @return The shortest distance to move, or 0 if it's not colliding
+ */
+double entity_collcheck_hor(const struct EntityPool *pool, size_t i,
+	World world)
+{
+	double x1, x2, y1, y2;
+	if (!world)
+		return 0.0;
 
-	for (int64_t y = iy1; y <= iy2; ++y) {
-		for (int64_t x = ix1; x <= ix2; ++x) {
-			if (world_get_block(world, x, y) == TILE_AIR)
-				continue;
-			double shift_down = y1 - y + entity->hitbox_height;
-			double shift_up = y - y1 + 1;
+	entity_hitbox_blockrange(pool, i, &x1, &x2, &y1, &y2);
+	return world_query_free_shift_x(world, x1, y1, x2, y2);
+}
 
-			if (fabs(shift_down) < fabs(best_shift))
-				best_shift = shift_down;
+/**
+ * Changes the entity's velocity and position based on its current acceleration
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param world The world it moves through
+ * @param t The amount of time to be elapsed
+ * @return 0 on success and a negative value on error
+ */
+int entity_update_physics(struct EntityPool *pool, size_t i, World world,
+	double t)
+{
+	TRACE_ZONE("entity_update_physics");
+	if (i >= pool->len)
+		return 0;
+	integrate_entities(pool, i, i + 1, t, SIMD_SCALAR);
+	entity_collide(pool, i, world, t);
+	return entity_moved(pool, i);
+}
 
-			if (fabs(shift_up) < fabs(best_shift))
-				best_shift = shift_up;
-			break;
-		}
+/**
+ * Pushes an entity that integrate_entities moved horizontally out of any block
+ * it ran into, then does the same vertically
+ * The vertical move is made here, since where it ends up depends on where the
+ * horizontal push left the entity.
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param world The world it moves through
+ * @param t The length of the tick
+ */
+static void entity_collide(struct EntityPool *pool, size_t i, World world,
+	double t)
+{
+	double shift_x = entity_collcheck_hor(pool, i, world);
+	if (shift_x != 0.0) {
+		pool->x[i] += shift_x;
+		pool->velocity_x[i] = 0.0;
 	}
 
-	// No collision found
-	if (best_shift == INFINITY)
-		return 0.0;
-
-	// A collision was found, this is the best course of action
-	return best_shift;
+	pool->y[i] += pool->velocity_y[i] * t;
+	double shift_y = entity_collcheck_ver(pool, i, world);
+	pool->on_ground[i] = shift_y > 0.0;
+	if (shift_y != 0.0) {
+		pool->y[i] += shift_y;
+		pool->velocity_y[i] = 0.0;
+	}
 }
 
-double entity_collcheck_hor(Entity entity, World world)
+/**
+ * Advances every entity in the world by one tick, remembering where each was
+ * so that it can be drawn between the two
+ * @param world The world
+ * @param t The length of the tick
+ * @return 0 on success and a negative value on error
+ */
+int world_update_physics(World world, double t)
 {
-	return 0.0;
+	if (!world || !world->entities.len)
+		return 0;
+
+	struct EntityPool *pool = &world->entities;
+	memcpy(pool->prev_x, pool->x, pool->len * sizeof(*pool->x));
+	memcpy(pool->prev_y, pool->y, pool->len * sizeof(*pool->y));
+	// Every entity moves before any collides, which is the same as moving
+	// them one at a time since they don't collide with each other
+	integrate_entities(pool, 0, pool->len, t, simd_best());
+	for (size_t i = 0; i < pool->len; ++i) {
+		entity_collide(pool, i, world, t);
+		if (entity_moved(pool, i) < 0)
+			return -1;
+	}
+	return 0;
 }
 
 /**
- * Changes the entity's velocity and position based on its current acceleration
- * @param entity The entity to move
- * @param t The amount of time to be elapsed
+ * Adds the length of a frame to the time waiting to be simulated
+ * @param step The fixed step
+ * @param elapsed How many seconds the frame took
+ * @return How many ticks to run this frame
  */
-void entity_update_physics(Entity entity, World world, double t)
+unsigned fixed_step_advance(struct FixedStep *step, double elapsed)
 {
-	if (!entity)
-		return;
-	entity->velocity_x = smooth_damp(
-		entity->velocity_x,
-		entity->desired_velocity_x,
-		&entity->acceleration_x,
-		0.1,
-		1000.0,
-		t);
-/*
-	if (entity->on_ground && entity->velocity_y < 0) {
-		entity->velocity_y = 0.0;
+	step->accumulator += elapsed;
+	unsigned ticks = step->accumulator / step->dt;
+	if (ticks > step->max_ticks) {
+		// The time that can't be caught up on is dropped, keeping the
+		// fraction of a tick so that drawing stays smooth
+		ticks = step->max_ticks;
+		step->accumulator = fmod(step->accumulator, step->dt);
 	} else {
-		entity->velocity_y -= 1.0;
-		if (entity->velocity_y < -5.0)
-			entity->velocity_y = -5.0;
+		step->accumulator -= ticks * step->dt;
 	}
-*/
-
-	entity->x += entity->velocity_x * t;
-
-	// Simple gravity and terminal velocity
-	entity->velocity_y -= t * 9.81;
-	if (entity->velocity_y < -9.81)
-		entity->velocity_y = -9.81;
+	return ticks;
+}
 
-	entity->y += entity->velocity_y * t;
-	entity->y += entity_collcheck_ver(entity, world);
+/**
+ * Finds how far the time not simulated yet is into the next tick, which is how
+ * far between their last two positions entities are drawn
+ * @param step The fixed step
+ * @return A number from 0 up to 1
+ */
+double fixed_step_alpha(const struct FixedStep *step)
+{
+	double alpha = step->accumulator / step->dt;
+	return alpha < 1.0 ? alpha : 1.0;
 }
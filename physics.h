@@ -12,8 +12,23 @@ double smooth_damp(
 	double smooth_time,
 	double max_speed,
 	double dt);
+double expappr(double x);
 
-void entity_update_physics(Entity, World, double t);
-bool entity_is_colliding(Entity entity, World world);
+// Runs the simulation in ticks of a fixed length, however long frames take
+struct FixedStep {
+	// The length of a tick in seconds
+	double dt;
+	// Time that has passed but hasn't been simulated yet
+	double accumulator;
+	// The most ticks run in one frame, past which the simulation falls
+	// behind instead of making slow frames slower
+	unsigned max_ticks;
+};
+
+int entity_update_physics(struct EntityPool *, size_t i, World, double t);
+int world_update_physics(World world, double t);
+bool entity_is_colliding(const struct EntityPool *, size_t i, World world);
+unsigned fixed_step_advance(struct FixedStep *step, double elapsed);
+double fixed_step_alpha(const struct FixedStep *step);
 
 #endif // PHYSICS_H
@@ -0,0 +1,669 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <SDL2/SDL.h>
+
+#include "region.h"
+#include "globals.h"
+#include "trace.h"
+
+// A region file starts with these, then the table
+#define REGION_MAGIC 0x4E524753 // "SGRN"
+#define REGION_VERSION 1
+#define REGION_HEADER_BYTES 8
+#define REGION_ENTRY_BYTES 8
+#define REGION_TABLE_BYTES (REGION_CHUNKS * REGION_ENTRY_BYTES)
+// Chunks are given space in multiples of this, so that they can grow a little
+// and still be rewritten in place
+#define REGION_SLACK 64
+
+// Where a chunk is in its region file, stored as a little-endian uint32_t and
+// two uint16_ts. A chunk that was never saved has an offset of 0.
+struct RegionEntry {
+	uint32_t offset;
+	uint16_t length;
+	// How many bytes at offset belong to the chunk
+	uint16_t capacity;
+};
+
+struct Region {
+	int fd;
+	// Where chunks that outgrow their space are moved to
+	uint32_t end;
+	// Whether the file was written since the last region_flush
+	bool written;
+	struct RegionEntry table[REGION_CHUNKS];
+};
+
+// Regions are keyed by their coordinates, which look just like a chunk's
+TYPED_MAP_DECLARE(static inline, RegionMap, regionmap, struct ChunkKey,
+	struct Region *)
+TYPED_MAP_DEFINE(static inline, RegionMap, regionmap, struct ChunkKey,
+	struct Region *, chunk_key_hash)
+
+struct RegionStore {
+	char *dir;
+	// Guards everything below, since chunks are loaded on job threads
+	// while the simulation thread saves others
+	SDL_mutex *lock;
+	// Every region file opened so far, which stay open until the store is
+	// closed
+	RegionMap regions;
+	struct RegionStats stats;
+};
+
+static int region_get(RegionStore store, int64_t rx, int64_t ry, bool create,
+	struct Region **result);
+static int region_open(RegionStore store, int64_t rx, int64_t ry,
+	bool create, struct Region *region);
+
+/**
+ * Writes a little-endian uint16_t
+ * @param data Where to write it
+ * @param value The value
+ */
+static inline void region_put16(uint8_t *data, uint16_t value)
+{
+	data[0] = value;
+	data[1] = value >> 8;
+}
+
+/**
+ * Writes a little-endian uint32_t
+ * @param data Where to write it
+ * @param value The value
+ */
+static inline void region_put32(uint8_t *data, uint32_t value)
+{
+	region_put16(data, value);
+	region_put16(data + 2, value >> 16);
+}
+
+/**
+ * Reads a little-endian uint16_t
+ * @param data Where to read it from
+ * @return The value
+ */
+static inline uint16_t region_get16(const uint8_t *data)
+{
+	return data[0] | data[1] << 8;
+}
+
+/**
+ * Reads a little-endian uint32_t
+ * @param data Where to read it from
+ * @return The value
+ */
+static inline uint32_t region_get32(const uint8_t *data)
+{
+	return region_get16(data) | (uint32_t) region_get16(data + 2) << 16;
+}
+
+/**
+ * Opens the store of a saved world, creating its directory if it doesn't
+ * exist yet
+ * @param dir The directory
+ * @return The store, or NULL if an error occurred
+ */
+RegionStore region_store_open(const char *dir)
+{
+	if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+		g_error_message = "couldn't create the world directory";
+		return NULL;
+	}
+
+	RegionStore store = calloc(1, sizeof(*store));
+	if (!store) {
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+	store->dir = malloc(strlen(dir) + 1);
+	store->regions = regionmap_new(16);
+	store->lock = SDL_CreateMutex();
+	if (!store->dir || !store->regions || !store->lock) {
+		// Only SDL sets its own error
+		if (store->lock)
+			g_error_message = "malloc failed";
+		region_store_close(store);
+		return NULL;
+	}
+	strcpy(store->dir, dir);
+	return store;
+}
+
+/**
+ * Closes a store's region files without flushing them, and frees it
+ * @param store The store
+ */
+void region_store_close(RegionStore store)
+{
+	if (!store)
+		return;
+
+	if (store->regions) {
+		struct RegionMapIterator it;
+		regionmap_iterator_init(&it, store->regions);
+		struct RegionMapEntry *entry;
+		while ((entry = regionmap_iterate(&it))) {
+			close(entry->value->fd);
+			free(entry->value);
+		}
+		regionmap_free(store->regions);
+	}
+	SDL_DestroyMutex(store->lock);
+	free(store->dir);
+	free(store);
+}
+
+/**
+ * Gets the seed the saved world was generated from, or saves one for it if it
+ * doesn't have one yet
+ * @param store The store
+ * @param seed The seed to save, which is set to the saved one if there is one
+ * @return 0 on success and a negative value on error
+ */
+int region_store_seed(RegionStore store, uint64_t *seed)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/seed", store->dir);
+
+	FILE *file = fopen(path, "r");
+	if (file) {
+		unsigned long long saved;
+		int matched = fscanf(file, "%llu", &saved);
+		fclose(file);
+		if (matched != 1) {
+			g_error_message = "the world's seed file is corrupt";
+			return -1;
+		}
+		*seed = saved;
+		return 0;
+	}
+
+	file = fopen(path, "w");
+	if (!file || fprintf(file, "%llu\n", (unsigned long long) *seed) < 0) {
+		if (file)
+			fclose(file);
+		g_error_message = "couldn't save the world's seed";
+		return -1;
+	}
+	if (fclose(file) != 0) {
+		g_error_message = "couldn't save the world's seed";
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Gets a store's counters
+ * @param store The store
+ * @param stats Set to the counters
+ */
+void region_store_stats(RegionStore store, struct RegionStats *stats)
+{
+	SDL_LockMutex(store->lock);
+	*stats = store->stats;
+	SDL_UnlockMutex(store->lock);
+}
+
+/**
+ * Encodes a chunk's tiles as its palette followed by runs of palette indices
+ * @param chunk The chunk
+ * @param data Where to write it, with room for REGION_MAX_CHUNK_BYTES
+ * @return How many bytes were written
+ */
+size_t region_encode_chunk(Chunk chunk, uint8_t *data)
+{
+	size_t len = 0;
+	region_put16(data, chunk->palette_len);
+	len += 2;
+	for (unsigned i = 0; i < chunk->palette_len; ++i, len += 2)
+		region_put16(data + len, chunk->palette[i]);
+
+	// Indices are read straight out of the packed tiles
+	const unsigned mask = (1u << chunk->bits) - 1;
+	unsigned run_index = 0, run_length = 0;
+	for (int i = 0; i < CHUNK_AREA; ++i) {
+		unsigned bit = i * chunk->bits;
+		unsigned index = (chunk->indices[bit >> 3] >> (bit & 7)) & mask;
+		if (run_length && index == run_index) {
+			++run_length;
+			continue;
+		}
+		if (run_length) {
+			data[len++] = run_index;
+			data[len++] = run_length - 1;
+		}
+		run_index = index;
+		run_length = 1;
+	}
+	data[len++] = run_index;
+	data[len++] = run_length - 1;
+	return len;
+}
+
+/**
+ * Replaces a chunk's tiles with ones encoded by region_encode_chunk
+ * @param chunk The chunk
+ * @param data The encoded tiles
+ * @param len How many bytes they take up
+ * @return 0 on success and a negative value on error, including if the data
+ * 	isn't a valid chunk
+ */
+int region_decode_chunk(Chunk chunk, const uint8_t *data, size_t len)
+{
+	if (len < 2)
+		goto corrupt;
+	const unsigned palette_len = region_get16(data);
+	if (!palette_len || palette_len > 256 || len < 2 + 2 * palette_len)
+		goto corrupt;
+	uint16_t palette[256];
+	for (unsigned i = 0; i < palette_len; ++i) {
+		palette[i] = region_get16(data + 2 + 2 * i);
+		if (palette[i] >= NUM_TILES)
+			goto corrupt;
+	}
+
+	uint16_t tiles[CHUNK_AREA];
+	int i = 0;
+	for (size_t at = 2 + 2 * palette_len; at < len; at += 2) {
+		if (at + 2 > len || data[at] >= palette_len ||
+			i + data[at + 1] + 1 > CHUNK_AREA)
+			goto corrupt;
+		for (int end = i + data[at + 1] + 1; i < end; ++i)
+			tiles[i] = palette[data[at]];
+	}
+	if (i != CHUNK_AREA)
+		goto corrupt;
+	return chunk_set_tiles(chunk, tiles);
+
+corrupt:
+	g_error_message = "a saved chunk is corrupt";
+	return -1;
+}
+
+/**
+ * Saves a chunk in its region file, rewriting it if it was saved before
+ * The chunk's CHUNK_MODIFIED flag is left for the caller to clear.
+ * @param store The store
+ * @param chunk The chunk
+ * @return 0 on success and a negative value on error
+ */
+int region_save_chunk(RegionStore store, Chunk chunk)
+{
+	TRACE_ZONE("region_save_chunk");
+	uint8_t data[REGION_MAX_CHUNK_BYTES];
+	const size_t len = region_encode_chunk(chunk, data);
+
+	SDL_LockMutex(store->lock);
+	struct Region *region;
+	if (region_get(store, chunk->cx >> REGION_SHIFT,
+		chunk->cy >> REGION_SHIFT, true, &region) < 0) {
+		SDL_UnlockMutex(store->lock);
+		return -1;
+	}
+	const int index = (chunk->cy & REGION_MASK) * REGION_LENGTH +
+		(chunk->cx & REGION_MASK);
+	struct RegionEntry entry = region->table[index];
+	if (!entry.offset || len > entry.capacity) {
+		entry.offset = region->end;
+		entry.capacity = (len + REGION_SLACK - 1) / REGION_SLACK *
+			REGION_SLACK;
+	}
+	entry.length = len;
+
+	// The data goes in before the table points at it
+	uint8_t bytes[REGION_ENTRY_BYTES];
+	region_put32(bytes, entry.offset);
+	region_put16(bytes + 4, entry.length);
+	region_put16(bytes + 6, entry.capacity);
+	if (pwrite(region->fd, data, len, entry.offset) != (ssize_t) len ||
+		pwrite(region->fd, bytes, sizeof(bytes), REGION_HEADER_BYTES +
+			index * REGION_ENTRY_BYTES) != sizeof(bytes)) {
+		SDL_UnlockMutex(store->lock);
+		g_error_message = "couldn't write a region file";
+		return -1;
+	}
+	if (entry.offset == region->end)
+		region->end += entry.capacity;
+	region->table[index] = entry;
+	region->written = true;
+	++store->stats.chunks_saved;
+	store->stats.bytes_written += len;
+	SDL_UnlockMutex(store->lock);
+	return 0;
+}
+
+/**
+ * Loads a chunk from its region file
+ * @param store The store
+ * @param cx The chunk column
+ * @param cy The chunk row
+ * @param chunk Set to the chunk, or to NULL if it was never saved
+ * @return 0 on success and a negative value on error
+ */
+int region_load_chunk(RegionStore store, int64_t cx, int64_t cy, Chunk *chunk)
+{
+	TRACE_ZONE("region_load_chunk");
+	*chunk = NULL;
+	uint8_t data[REGION_MAX_CHUNK_BYTES];
+
+	SDL_LockMutex(store->lock);
+	struct Region *region;
+	if (region_get(store, cx >> REGION_SHIFT, cy >> REGION_SHIFT, false,
+		&region) < 0) {
+		SDL_UnlockMutex(store->lock);
+		return -1;
+	}
+	const int index = (cy & REGION_MASK) * REGION_LENGTH +
+		(cx & REGION_MASK);
+	if (!region || !region->table[index].offset) {
+		SDL_UnlockMutex(store->lock);
+		return 0;
+	}
+	const struct RegionEntry entry = region->table[index];
+	if (entry.length > sizeof(data) ||
+		pread(region->fd, data, entry.length, entry.offset) !=
+		entry.length) {
+		SDL_UnlockMutex(store->lock);
+		g_error_message = "couldn't read a region file";
+		return -1;
+	}
+	++store->stats.chunks_loaded;
+	store->stats.bytes_read += entry.length;
+	SDL_UnlockMutex(store->lock);
+
+	Chunk loaded = chunk_new(cx, cy);
+	if (!loaded)
+		return -1;
+	if (region_decode_chunk(loaded, data, entry.length) < 0) {
+		chunk_free(loaded);
+		return -1;
+	}
+	*chunk = loaded;
+	return 0;
+}
+
+/**
+ * Saves every chunk of a world modified since it was last saved, and marks
+ * them as saved
+ * @param store The store
+ * @param world The world
+ * @return 0 on success and a negative value on error
+ */
+int region_save_world(RegionStore store, World world)
+{
+	TRACE_ZONE("region_save_world");
+	struct ChunkMapIterator it;
+	chunkmap_iterator_init(&it, world->chunkmap);
+	struct ChunkMapEntry *entry;
+	while ((entry = chunkmap_iterate(&it))) {
+		Chunk chunk = entry->value;
+		if (!(chunk->flags & CHUNK_MODIFIED))
+			continue;
+		if (region_save_chunk(store, chunk) < 0)
+			return -1;
+		chunk->flags &= ~CHUNK_MODIFIED;
+	}
+	return 0;
+}
+
+/**
+ * Makes sure everything saved so far is on disk
+ * @param store The store
+ * @return 0 on success and a negative value on error
+ */
+int region_flush(RegionStore store)
+{
+	TRACE_ZONE("region_flush");
+	// The files are synced outside the lock, since that can take long
+	// enough to hold up chunks being loaded. Regions stay open until the
+	// store is closed, so they can be used without it.
+	SDL_LockMutex(store->lock);
+	size_t num_regions = regionmap_size(store->regions);
+	if (!num_regions) {
+		SDL_UnlockMutex(store->lock);
+		return 0;
+	}
+	struct Region **written = malloc(num_regions * sizeof(*written));
+	if (!written) {
+		SDL_UnlockMutex(store->lock);
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	size_t num_written = 0;
+	struct RegionMapIterator it;
+	regionmap_iterator_init(&it, store->regions);
+	struct RegionMapEntry *entry;
+	while ((entry = regionmap_iterate(&it))) {
+		// Anything written from here on is left for the next flush
+		if (entry->value->written) {
+			entry->value->written = false;
+			written[num_written++] = entry->value;
+		}
+	}
+	SDL_UnlockMutex(store->lock);
+
+	int ret = 0;
+	for (size_t i = 0; i < num_written; ++i) {
+		if (fsync(written[i]->fd) < 0) {
+			SDL_LockMutex(store->lock);
+			written[i]->written = true;
+			SDL_UnlockMutex(store->lock);
+			g_error_message = "couldn't flush a region file";
+			ret = -1;
+		}
+	}
+	free(written);
+	return ret;
+}
+
+/**
+ * Replaces a file of the saved world other than its regions, such that it's
+ * either wholly the old file or wholly the new one if the game stops partway
+ * @param store The store
+ * @param name The file's name within the world's directory
+ * @param data The new contents
+ * @param len How many bytes they take up
+ * @return 0 on success and a negative value on error
+ */
+int region_write_file(RegionStore store, const char *name, const void *data,
+	size_t len)
+{
+	TRACE_ZONE("region_write_file");
+	char path[4096], temp[4096];
+	snprintf(path, sizeof(path), "%s/%s", store->dir, name);
+	snprintf(temp, sizeof(temp), "%s/%s.tmp", store->dir, name);
+
+	int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		g_error_message = "couldn't write a world file";
+		return -1;
+	}
+	const uint8_t *bytes = data;
+	for (size_t done = 0; done < len; ) {
+		ssize_t written = write(fd, bytes + done, len - done);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0)
+			goto error;
+		done += written;
+	}
+	if (fsync(fd) < 0)
+		goto error;
+	close(fd);
+	if (rename(temp, path) < 0) {
+		unlink(temp);
+		g_error_message = "couldn't write a world file";
+		return -1;
+	}
+	return 0;
+
+error:
+	close(fd);
+	unlink(temp);
+	g_error_message = "couldn't write a world file";
+	return -1;
+}
+
+/**
+ * Reads a whole file of the saved world other than its regions
+ * @param store The store
+ * @param name The file's name within the world's directory
+ * @param data Set to the contents, to be freed by the caller, or to NULL if
+ * 	the file doesn't exist
+ * @param len Set to how many bytes they take up
+ * @return 0 on success and a negative value on error
+ */
+int region_read_file(RegionStore store, const char *name, uint8_t **data,
+	size_t *len)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", store->dir, name);
+	*data = NULL;
+	*len = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		g_error_message = "couldn't read a world file";
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		g_error_message = "couldn't read a world file";
+		return -1;
+	}
+	// One more byte, so that an empty file isn't mistaken for a missing one
+	uint8_t *contents = malloc(st.st_size + 1);
+	if (!contents) {
+		close(fd);
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	if (pread(fd, contents, st.st_size, 0) != st.st_size) {
+		free(contents);
+		close(fd);
+		g_error_message = "couldn't read a world file";
+		return -1;
+	}
+	close(fd);
+	*data = contents;
+	*len = st.st_size;
+	return 0;
+}
+
+/**
+ * Gets an open region, opening its file if it isn't yet
+ * The store's lock must be held.
+ * @param store The store
+ * @param rx The region column
+ * @param ry The region row
+ * @param create Whether to create the file if it doesn't exist
+ * @param result Set to the region, or to NULL if its file doesn't exist and
+ * 	create is false
+ * @return 0 on success and a negative value on error
+ */
+static int region_get(RegionStore store, int64_t rx, int64_t ry, bool create,
+	struct Region **result)
+{
+	struct ChunkKey key = {rx, ry};
+	struct Region **found = regionmap_get(store->regions, key);
+	if (found) {
+		*result = *found;
+		return 0;
+	}
+
+	*result = NULL;
+	struct Region *region = malloc(sizeof(*region));
+	if (!region) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	int ret = region_open(store, rx, ry, create, region);
+	if (ret <= 0) {
+		free(region);
+		return ret;
+	}
+	if (regionmap_put(store->regions, key, region) < 0) {
+		close(region->fd);
+		free(region);
+		return -1;
+	}
+	*result = region;
+	return 0;
+}
+
+/**
+ * Opens a region file and reads its table, or creates it with an empty one
+ * @param store The store
+ * @param rx The region column
+ * @param ry The region row
+ * @param create Whether to create the file if it doesn't exist
+ * @param region The region to open it into
+ * @return 1 if it was opened, 0 if it doesn't exist and create is false and a
+ * 	negative value on error
+ */
+static int region_open(RegionStore store, int64_t rx, int64_t ry,
+	bool create, struct Region *region)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/r.%lld.%lld.region", store->dir,
+		(long long) rx, (long long) ry);
+	region->fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0666);
+	if (region->fd < 0) {
+		if (errno == ENOENT && !create)
+			return 0;
+		g_error_message = "couldn't open a region file";
+		return -1;
+	}
+	region->written = false;
+
+	uint8_t header[REGION_HEADER_BYTES + REGION_TABLE_BYTES];
+	struct stat st;
+	if (fstat(region->fd, &st) < 0)
+		goto error;
+	if (st.st_size == 0) {
+		// A new file, which nothing has been saved in
+		memset(header, 0, sizeof(header));
+		region_put32(header, REGION_MAGIC);
+		region_put32(header + 4, REGION_VERSION);
+		if (pwrite(region->fd, header, sizeof(header), 0) !=
+			sizeof(header))
+			goto error;
+		memset(region->table, 0, sizeof(region->table));
+		region->end = sizeof(header);
+		return 1;
+	}
+
+	if (st.st_size < (off_t) sizeof(header) || st.st_size > UINT32_MAX ||
+		pread(region->fd, header, sizeof(header), 0) !=
+		sizeof(header) || region_get32(header) != REGION_MAGIC ||
+		region_get32(header + 4) != REGION_VERSION) {
+		close(region->fd);
+		g_error_message = "a region file is corrupt";
+		return -1;
+	}
+	for (int i = 0; i < REGION_CHUNKS; ++i) {
+		const uint8_t *bytes = header + REGION_HEADER_BYTES +
+			i * REGION_ENTRY_BYTES;
+		region->table[i] = (struct RegionEntry) {
+			region_get32(bytes),
+			region_get16(bytes + 4),
+			region_get16(bytes + 6),
+		};
+	}
+	region->end = st.st_size;
+	return 1;
+
+error:
+	close(region->fd);
+	g_error_message = "couldn't read a region file";
+	return -1;
+}
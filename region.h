@@ -0,0 +1,56 @@
+/* Saves chunks in region files of REGION_LENGTH by REGION_LENGTH chunks. A
+ * region file starts with a table giving where in the file each of its chunks
+ * is, which is read once when the file is opened, so loading a chunk after
+ * that takes one read of exactly its bytes.
+ *
+ * A chunk is stored as its palette followed by runs of palette indices. Chunks
+ * are rewritten in place while they fit in the space they were given and
+ * moved to the end of the file when they outgrow it, leaving the old space
+ * unused.
+ *
+ * Every function may be called from any thread.
+ */
+
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "world.h"
+
+#define REGION_SHIFT 5
+#define REGION_LENGTH (1 << REGION_SHIFT)
+#define REGION_MASK (REGION_LENGTH - 1)
+#define REGION_CHUNKS (REGION_LENGTH * REGION_LENGTH)
+// The most bytes a chunk can take up encoded: its palette's length, the
+// palette and a run for every tile
+#define REGION_MAX_CHUNK_BYTES (2 + 2 * 256 + 2 * CHUNK_AREA)
+
+// Counters that are only ever incremented, for profiling
+struct RegionStats {
+	uint64_t chunks_saved;
+	uint64_t chunks_loaded;
+	// Chunk data written and read, not counting the tables
+	uint64_t bytes_written;
+	uint64_t bytes_read;
+};
+
+typedef struct RegionStore *RegionStore;
+
+RegionStore region_store_open(const char *dir);
+void region_store_close(RegionStore);
+int region_store_seed(RegionStore, uint64_t *seed);
+void region_store_stats(RegionStore, struct RegionStats *);
+int region_save_chunk(RegionStore, Chunk);
+int region_load_chunk(RegionStore, int64_t cx, int64_t cy, Chunk *);
+int region_save_world(RegionStore, World);
+int region_flush(RegionStore);
+int region_write_file(RegionStore, const char *name, const void *data,
+	size_t len);
+int region_read_file(RegionStore, const char *name, uint8_t **data,
+	size_t *len);
+
+size_t region_encode_chunk(Chunk, uint8_t *data);
+int region_decode_chunk(Chunk, const uint8_t *data, size_t len);
+
+#endif // REGION_H
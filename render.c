@@ -1,139 +1,666 @@
 #include <SDL2/SDL.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "render.h"
 #include "world.h"
-#include "macros.h"
-#include "hashmap.h"
+#include "typedmap.h"
 #include "globals.h"
+#include "trace.h"
+#include "font.h"
 
-// These must be ordered respective to the BlockID enum in world.h
-static const char *tile_filenames[NUM_TILES] = {
-	"assets/dirt.bmp",
-	"assets/grass.bmp",
-	NULL,
-	"assets/log.bmp",
-	"assets/unbreakable_rock.bmp",
+// The dimensions of a scaled sprite
+struct SpriteKey {
+	int w, h;
 };
 
-static SDL_Surface *block_textures[ARRAY_LEN(tile_filenames)];
-static HashMap scaled_block_textures[ARRAY_LEN(tile_filenames)];
+static uint64_t sprite_key_hash(struct SpriteKey key);
+
+TYPED_MAP_DECLARE(static inline, SpriteMap, spritemap, struct SpriteKey,
+	SDL_Surface *)
+TYPED_MAP_DEFINE(static inline, SpriteMap, spritemap, struct SpriteKey,
+	SDL_Surface *, sprite_key_hash)
+
+// Indexed by TextureID
+static SDL_Surface *textures[NUM_TEXTURES];
+static SpriteMap scaled_textures[NUM_TEXTURES];
+
+// How many bytes of chunk surfaces are kept before the least recently drawn
+// ones are freed
+#define CHUNK_CACHE_BUDGET (64 << 20)
+
+// A chunk drawn once onto its own surface, which is blitted as a whole until
+// the chunk changes
+struct CachedChunk {
+	struct ChunkKey key;
+	// The chunk that was drawn, since another may replace it in the world
+	Chunk chunk;
+	SDL_Surface *surface;
+	// The last frame the chunk was drawn in
+	uint64_t frame;
+	// Neighbours in the LRU list, where prev was drawn more recently
+	struct CachedChunk *prev, *next;
+};
+
+TYPED_MAP_DECLARE(static inline, ChunkCache, chunkcache, struct ChunkKey,
+	struct CachedChunk *)
+TYPED_MAP_DEFINE(static inline, ChunkCache, chunkcache, struct ChunkKey,
+	struct CachedChunk *, chunk_key_hash)
+
+static struct {
+	ChunkCache map;
+	// The most and least recently drawn chunks
+	struct CachedChunk *head, *tail;
+	// The scale that every cached surface was drawn at
+	double tile_width;
+	// Incremented by every call to world_draw
+	uint64_t frame;
+} chunk_cache;
+
+// A screen full of pixels is drawn from scratch at least this often, in case
+// anything changed that RENDER_SCROLL doesn't know about
+#define FULL_REPAINT_INTERVAL 300
+
+struct RectList {
+	SDL_Rect *rects;
+	size_t len, capacity;
+};
+
+// Where a frame is drawn on the pixel grid
+struct Frame {
+	// The pixel column and row of the screen's top-left corner
+	int64_t x, y;
+	double tile_width;
+	// See PlayerView.alpha
+	double alpha;
+	// Where every visible entity is on the screen
+	const struct RectList *entities;
+};
+
+// What the last frame left on g_surface, which RENDER_SCROLL draws over
+static struct {
+	// A different surface or scale means none of it can be kept
+	SDL_Surface *surface;
+	double tile_width;
+	int64_t x, y;
+	// Frames drawn since the last full repaint
+	unsigned age;
+	struct RectList entities;
+	// Where the HUD was drawn over the frame, if it was
+	SDL_Rect overlay;
+	bool valid;
+} last_frame;
+
+// The regions of the screen that RENDER_SCROLL draws in the current frame
+static struct RectList dirty_regions;
+// Where the current frame draws entities, which is swapped with
+// last_frame.entities once it's done
+static struct RectList frame_entities;
+
+// The entities near the screen, some of which may be on it
+static struct EntityQuery nearby_entities;
+// How far from where they are entities can be drawn, since they're drawn
+// between where they were before the last tick and where they are. Entities
+// move much less than this in a tick.
+#define ENTITY_DRAW_MARGIN 1.0
+
+struct RenderStats g_render_stats;
+
+// Each pixel of a HUD glyph is drawn as a square this many pixels wide
+#define HUD_SCALE 2
+// How many frames the HUD graphs
+#define HUD_HISTORY 160
+// How many frames pass between updates of the HUD's text, so that it can be
+// read and so that the map stats aren't scanned every frame
+#define HUD_REFRESH_FRAMES 15
+#define HUD_LINES 6
+#define HUD_LINE_LENGTH 42
+// One graphed pixel for every this many milliseconds
+#define HUD_GRAPH_MS_PER_PIXEL 0.5
+#define HUD_GRAPH_HEIGHT 70
+#define HUD_MARGIN 8
+
+static struct {
+	bool visible;
+	// Every glyph of the font side by side, drawn at HUD_SCALE
+	SDL_Surface *glyphs;
+	// A ring of the last HUD_HISTORY frames, where next is the oldest
+	struct FrameTimes history[HUD_HISTORY];
+	unsigned next;
+	// Frames pushed since the text was last updated
+	unsigned since_refresh;
+	// The simulation's chunk stream, as of the latest snapshot
+	struct StreamStats stream;
+	char lines[HUD_LINES][HUD_LINE_LENGTH + 1];
+} hud;
 
 /**
- * Draws an entity on the screen
- * @param entity The entity to be drawn
- * @param view The player's view
- * @return 0 on success and a negative value on error
+ * Hashes the dimensions of a sprite
+ * @param key The sprite's dimensions
+ * @return The hashed value
  */
-int entity_draw(Entity entity, struct PlayerView *view)
+static uint64_t sprite_key_hash(struct SpriteKey key)
 {
-	if (!entity || !view)
-		return -1;
+	return (uint64_t) (uint32_t) key.w << 32 | (uint32_t) key.h;
+}
 
-	double tile_width = SCREEN_WIDTH / view->width;
+/**
+ * Finds the pixel column of a world x-coordinate
+ * Every tile and chunk edge is rounded onto this one grid, so that surfaces
+ * rendered once line up wherever they're blitted.
+ * @param x The x-coordinate
+ * @param tile_width The width of a tile in pixels
+ * @return The pixel column, relative to x = 0
+ */
+static int64_t pixel_x(double x, double tile_width)
+{
+	return floor(x * tile_width);
+}
 
-	int entity_width = tile_width * entity->hitbox_width;
-	int entity_height = tile_width * entity->hitbox_height;
+/**
+ * Finds the pixel row of a world y-coordinate, which grows downwards
+ * @param y The y-coordinate
+ * @param tile_width The width of a tile in pixels
+ * @return The pixel row, relative to y = 0
+ */
+static int64_t pixel_y(double y, double tile_width)
+{
+	return floor(-y * tile_width);
+}
 
-	SDL_Rect rect;
-	rect.x = SCREEN_WIDTH / 2.0
-		+ (entity->x - entity->hitbox_width / 2.0 - view->center_x)
-		* tile_width;
-	rect.y = SCREEN_HEIGHT / 2.0
-		- (entity->y + entity->hitbox_height - view->center_y)
-		* tile_width;
+/**
+ * Finds where an entity's hitbox is on the screen
+ * @param pool The pool the entity is in
+ * @param i The entity's index in the pool
+ * @param frame The frame it's drawn in
+ * @return The rectangle covered by the entity
+ */
+static SDL_Rect entity_rect(const struct EntityPool *pool, size_t i,
+	const struct Frame *frame)
+{
+	const double tile_width = frame->tile_width;
+	const double x = pool->prev_x[i] +
+		(pool->x[i] - pool->prev_x[i]) * frame->alpha;
+	const double y = pool->prev_y[i] +
+		(pool->y[i] - pool->prev_y[i]) * frame->alpha;
+	const double half_width = pool->hitbox_width[i] / 2.0;
+	const int64_t left = pixel_x(x - half_width, tile_width);
+	const int64_t top = pixel_y(y + pool->hitbox_height[i], tile_width);
 
-	rect.w = entity_width;
-	rect.h = entity_height;
+	return (SDL_Rect) {
+		.x = left - frame->x,
+		.y = top - frame->y,
+		.w = pixel_x(x + half_width, tile_width) - left,
+		.h = pixel_y(y, tile_width) - top,
+	};
+}
 
-	SDL_Surface *surface = SDL_CreateRGBSurface(0, rect.w, rect.h, 32,
-		0, 0, 0, 0);
-	if (!surface)
-		return -1;
+/**
+ * Finds where a chunk is on the screen
+ * @param cx The chunk's x-coordinate
+ * @param cy The chunk's y-coordinate
+ * @param frame The frame it's drawn in
+ * @return The rectangle covered by the chunk
+ */
+static SDL_Rect chunk_rect(int64_t cx, int64_t cy, const struct Frame *frame)
+{
+	const double tile_width = frame->tile_width;
+	const int64_t left = pixel_x(cx * CHUNK_LENGTH, tile_width);
+	const int64_t top = pixel_y((cy + 1) * CHUNK_LENGTH, tile_width);
 
-	if (SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 0, 255, 0)
-		) < 0)
-		return -1;
+	return (SDL_Rect) {
+		.x = left - frame->x,
+		.y = top - frame->y,
+		.w = pixel_x((cx + 1) * CHUNK_LENGTH, tile_width) - left,
+		.h = pixel_y(cy * CHUNK_LENGTH, tile_width) - top,
+	};
+}
 
-	if (SDL_BlitSurface(surface, NULL, g_surface, &rect) < 0)
-		return -1;
+/**
+ * Draws an entity on the screen
+ * @param rect Where the entity is on the screen
+ * @return 0 on success and a negative value on error
+ */
+static int entity_draw(const SDL_Rect *rect)
+{
+	SDL_Rect copy = *rect;
+	return SDL_FillRect(g_surface, &copy,
+		SDL_MapRGB(g_surface->format, 0, 255, 0));
+}
 
+/**
+ * Adds a rectangle to the end of a list
+ * @param list The list
+ * @param rect The rectangle
+ * @return 0 on success and a negative value on error
+ */
+static int rect_list_push(struct RectList *list, SDL_Rect rect)
+{
+	if (list->len == list->capacity) {
+		size_t capacity = list->capacity ? list->capacity * 2 : 16;
+		SDL_Rect *rects = realloc(list->rects,
+			capacity * sizeof(*rects));
+		if (!rects) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		list->rects = rects;
+		list->capacity = capacity;
+	}
+	list->rects[list->len++] = rect;
 	return 0;
 }
 
 /**
- * Draws an individual chunk on the screen
+ * Draws every tile of a chunk onto a surface the size of the chunk
  * @param chunk The chunk to be drawn
- * @param view The player view used to determine the screen coordinates
+ * @param surface The surface, which is replaced if it's NULL or the wrong size
+ * @param tile_width The width of a tile in pixels
  * @return 0 on success and a negative value on SDL error
  */
-static int chunk_draw(
-	Chunk chunk,
-	struct PlayerView *view)
+static int chunk_render(Chunk chunk, SDL_Surface **surface, double tile_width)
 {
-	// If the chunk doesn't exist, don't draw anything
-	if (!chunk || !view)
-		return 0;
+	TRACE_ZONE("chunk_render");
+	const int64_t x = chunk->cx * CHUNK_LENGTH;
+	const int64_t y = chunk->cy * CHUNK_LENGTH;
+	const int64_t left = pixel_x(x, tile_width);
+	const int64_t top = pixel_y(y + CHUNK_LENGTH, tile_width);
+	const int w = pixel_x(x + CHUNK_LENGTH, tile_width) - left;
+	const int h = pixel_y(y, tile_width) - top;
 
-	double tile_width = SCREEN_WIDTH / view->width;
+	if (*surface && ((*surface)->w != w || (*surface)->h != h)) {
+		SDL_FreeSurface(*surface);
+		*surface = NULL;
+	}
+	if (!*surface) {
+		*surface = SDL_CreateRGBSurface(0, w, h,
+			g_surface->format->BitsPerPixel,
+			g_surface->format->Rmask, g_surface->format->Gmask,
+			g_surface->format->Bmask, g_surface->format->Amask);
+		if (!*surface)
+			return -1;
+	}
 
-	for (int i = 0; i < CHUNK_LENGTH; ++i) {
-		for (int j = 0; j < CHUNK_LENGTH; ++j) {
-			enum BlockID tile = chunk->tiles[i][j];
+	// Chunks that are opaque all over are blitted without a color key,
+	// which is the faster blit
+	bool opaque = true;
+	for (unsigned i = 0; i < chunk->palette_len; ++i)
+		opaque &= block_is_opaque(chunk->palette[i]);
 
-			if (tile == TILE_AIR)
-				continue;
-
-			// The x and y offset from the center
-			double rx = chunk->cx * CHUNK_LENGTH + j - view->center_x;
-			double ry = chunk->cy * CHUNK_LENGTH + i - view->center_y;
+	Uint32 key = SDL_MapRGB((*surface)->format, 255, 0, 255);
+	if (SDL_SetColorKey(*surface, !opaque, key) < 0)
+		return -1;
+	if (!opaque && SDL_FillRect(*surface, NULL, key) < 0)
+		return -1;
 
-			int64_t px = SCREEN_WIDTH / 2.0 + rx * tile_width;
-			int64_t py = SCREEN_HEIGHT / 2.0 - ry * tile_width;
+	for (int i = 0; i < CHUNK_LENGTH; ++i) {
+		const int64_t row_top = pixel_y(y + i + 1, tile_width);
+		const int tile_height = pixel_y(y + i, tile_width) - row_top;
 
-			int var_tile_width =
-				SCREEN_WIDTH / 2.0 + (rx + 1) * tile_width - px;
-			int var_tile_height =
-				py - (int) (SCREEN_HEIGHT / 2.0 - (ry + 1.0) * tile_width);
+		for (int j = 0; j < CHUNK_LENGTH; ++j) {
+			enum BlockID tile = chunk_get_tile(chunk, j, i);
+			enum TextureID texture = block_texture(tile);
 
-			// Needs to be done since SDL draws from the top-left.
-			py -= var_tile_height;
+			if (texture == TEXTURE_NONE)
+				continue;
 
+			const int64_t column_left = pixel_x(x + j, tile_width);
 			SDL_Rect rect = {
-				.x = px,
-				.y = py,
-				.w = var_tile_width,
-				.h = var_tile_height,
+				.x = column_left - left,
+				.y = row_top - top,
+				.w = pixel_x(x + j + 1, tile_width) - column_left,
+				.h = tile_height,
 			};
 
-			int key[] = {var_tile_width, var_tile_height};
-			size_t hash = hash_coordinate(var_tile_width,
-				var_tile_height);
-			SDL_Surface **surface = (SDL_Surface **) hashmap_get(scaled_block_textures[tile],
-				key, sizeof key, hash);
+			struct SpriteKey sprite_key = {rect.w, rect.h};
+			SDL_Surface **sprite =
+				spritemap_get(scaled_textures[texture], sprite_key);
 
-			if (!surface) {
+			if (!sprite) {
 				g_error_message = "scaled block texture not"
 					" found in cache";
 				return -1;
 			}
 
-			if (SDL_BlitSurface(*surface, NULL, g_surface,
-				&rect) < 0)
+			if (SDL_BlitSurface(*sprite, NULL, *surface, &rect) < 0)
+				return -1;
+		}
+	}
+
+	chunk->flags &= ~CHUNK_RENDER_DIRTY;
+	return 0;
+}
+
+/**
+ * Moves a cached chunk to the front of the LRU list
+ * @param cached The cached chunk, which may not be in the list yet
+ */
+static void chunk_cache_touch(struct CachedChunk *cached)
+{
+	if (chunk_cache.head == cached)
+		return;
+	if (cached->prev)
+		cached->prev->next = cached->next;
+	if (cached->next)
+		cached->next->prev = cached->prev;
+	if (chunk_cache.tail == cached)
+		chunk_cache.tail = cached->prev;
+
+	cached->prev = NULL;
+	cached->next = chunk_cache.head;
+	if (chunk_cache.head)
+		chunk_cache.head->prev = cached;
+	chunk_cache.head = cached;
+	if (!chunk_cache.tail)
+		chunk_cache.tail = cached;
+}
+
+/**
+ * Removes a chunk from the cache and frees its surface
+ * @param cached The cached chunk, whose surface has already been taken out of
+ * 	cache_bytes
+ */
+static void chunk_cache_remove(struct CachedChunk *cached)
+{
+	if (cached->prev)
+		cached->prev->next = cached->next;
+	else
+		chunk_cache.head = cached->next;
+	if (cached->next)
+		cached->next->prev = cached->prev;
+	else
+		chunk_cache.tail = cached->prev;
+
+	--g_render_stats.cached_chunks;
+	chunkcache_remove(chunk_cache.map, cached->key);
+	SDL_FreeSurface(cached->surface);
+	free(cached);
+}
+
+/**
+ * Frees the least recently drawn chunk surface
+ */
+static void chunk_cache_evict(void)
+{
+	struct CachedChunk *cached = chunk_cache.tail;
+
+	g_render_stats.cache_bytes -= cached->surface->pitch *
+		cached->surface->h;
+	++g_render_stats.evictions;
+	chunk_cache_remove(cached);
+}
+
+/**
+ * Frees every cached chunk surface, which must be done once they no longer
+ * match the scale tiles are drawn at
+ */
+static void chunk_cache_flush(void)
+{
+	while (chunk_cache.tail)
+		chunk_cache_evict();
+}
+
+/**
+ * Draws an individual chunk on the screen from its cached surface, rendering
+ * it first if it isn't cached or has changed since
+ * @param chunk The chunk to be drawn
+ * @param frame The frame it's drawn in
+ * @return 0 on success and a negative value on error
+ */
+static int chunk_draw(Chunk chunk, const struct Frame *frame)
+{
+	TRACE_ZONE("chunk_draw");
+	const double tile_width = frame->tile_width;
+
+	// If the chunk doesn't exist, don't draw anything
+	if (!chunk)
+		return 0;
+	// Nor if it's all air, which leaves nothing to redraw either
+	if (chunk_is_uniform(chunk) &&
+		block_texture(chunk->uniform) == TEXTURE_NONE) {
+		chunk->flags &= ~CHUNK_RENDER_DIRTY;
+		return 0;
+	}
+
+	struct ChunkKey key = {chunk->cx, chunk->cy};
+	struct CachedChunk **entry = chunkcache_get(chunk_cache.map, key);
+	struct CachedChunk *cached;
+
+	if (entry) {
+		cached = *entry;
+		// A different chunk at the same coordinates is also stale
+		if (cached->chunk != chunk ||
+			chunk->flags & CHUNK_RENDER_DIRTY) {
+			g_render_stats.cache_bytes -= cached->surface->pitch *
+				cached->surface->h;
+			cached->chunk = chunk;
+			// The surface may have been freed or left half drawn,
+			// so the entry can't stay
+			if (chunk_render(chunk, &cached->surface,
+				tile_width) < 0) {
+				chunk_cache_remove(cached);
+				return -1;
+			}
+			g_render_stats.cache_bytes += cached->surface->pitch *
+				cached->surface->h;
+			++g_render_stats.rerenders;
+		} else {
+			++g_render_stats.cache_hits;
+		}
+	} else {
+		cached = calloc(1, sizeof(*cached));
+		if (!cached) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		cached->key = key;
+		cached->chunk = chunk;
+		if (chunk_render(chunk, &cached->surface, tile_width) < 0) {
+			SDL_FreeSurface(cached->surface);
+			free(cached);
+			return -1;
+		}
+		if (chunkcache_put(chunk_cache.map, key, cached) < 0) {
+			SDL_FreeSurface(cached->surface);
+			free(cached);
+			return -1;
+		}
+		g_render_stats.cache_bytes += cached->surface->pitch *
+			cached->surface->h;
+		++g_render_stats.cached_chunks;
+		++g_render_stats.cache_misses;
+	}
+	cached->frame = chunk_cache.frame;
+	chunk_cache_touch(cached);
+
+	SDL_Rect rect = chunk_rect(chunk->cx, chunk->cy, frame);
+	return SDL_BlitSurface(cached->surface, NULL, g_surface, &rect);
+}
+
+/**
+ * Finds the chunks that may cover part of a region of the screen
+ * @param frame The frame
+ * @param region The region of the screen
+ * @param cx1 Set to the leftmost chunk column
+ * @param cy1 Set to the bottom chunk row
+ * @param cx2 Set to the rightmost chunk column
+ * @param cy2 Set to the top chunk row
+ */
+static void region_chunks(const struct Frame *frame, const SDL_Rect *region,
+	int64_t *cx1, int64_t *cy1, int64_t *cx2, int64_t *cy2)
+{
+	// Pixel edges are rounded, so a tile is spared on every side
+	const double tile_width = frame->tile_width;
+	const int64_t x1 = floor((region->x + frame->x) / tile_width) - 1;
+	const int64_t x2 = floor((region->x + region->w + frame->x)
+		/ tile_width) + 1;
+	const int64_t y1 = floor(-(region->y + region->h + frame->y)
+		/ tile_width) - 1;
+	const int64_t y2 = floor(-(region->y + frame->y) / tile_width) + 1;
+
+	*cx1 = x1 >> CHUNK_SHIFT;
+	*cx2 = x2 >> CHUNK_SHIFT;
+	*cy1 = y1 >> CHUNK_SHIFT;
+	*cy2 = y2 >> CHUNK_SHIFT;
+}
+
+/**
+ * Draws everything within a region of the screen from scratch
+ * @param world The world
+ * @param frame The frame being drawn
+ * @param region The region of the screen
+ * @return 0 on success and a negative value on error
+ */
+static int region_draw(World world, const struct Frame *frame,
+	SDL_Rect region)
+{
+	if (!SDL_SetClipRect(g_surface, &region))
+		return 0;
+	region = g_surface->clip_rect;
+	g_render_stats.pixels_drawn += (uint64_t) region.w * region.h;
+
+	int ret = -1;
+	if (SDL_FillRect(g_surface, NULL,
+		SDL_MapRGB(g_surface->format, 0, 0, 0)) < 0)
+		goto out;
+
+	int64_t cx1, cy1, cx2, cy2;
+	region_chunks(frame, &region, &cx1, &cy1, &cx2, &cy2);
+	for (int64_t cy = cy1; cy <= cy2; ++cy) {
+		for (int64_t cx = cx1; cx <= cx2; ++cx) {
+			Chunk chunk = world_get_chunk(world, cx, cy);
+			if (chunk_draw(chunk, frame) < 0)
+				goto out;
+		}
+	}
+
+	for (size_t i = 0; i < frame->entities->len; ++i) {
+		const SDL_Rect *rect = &frame->entities->rects[i];
+		if (SDL_HasIntersection(rect, &region) &&
+			entity_draw(rect) < 0)
+			goto out;
+	}
+	ret = 0;
+out:
+	SDL_SetClipRect(g_surface, NULL);
+	return ret;
+}
+
+/**
+ * Moves the contents of a surface, leaving the pixels it uncovers as they were
+ * @param surface The surface
+ * @param dx How many pixels left to move it
+ * @param dy How many pixels up to move it
+ * @return 0 on success and a negative value on SDL error
+ */
+static int surface_scroll(SDL_Surface *surface, int dx, int dy)
+{
+	const int w = surface->w - abs(dx);
+	const int h = surface->h - abs(dy);
+	if (w <= 0 || h <= 0)
+		return 0;
+
+	if (SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) < 0)
+		return -1;
+
+	const int bpp = surface->format->BytesPerPixel;
+	uint8_t *pixels = surface->pixels;
+	// Rows are visited in the order that reads each one before it's
+	// overwritten
+	for (int i = 0; i < h; ++i) {
+		int row = dy >= 0 ? i : surface->h - 1 - i;
+		memmove(pixels + row * surface->pitch
+				+ (dx < 0 ? -dx : 0) * bpp,
+			pixels + (row + dy) * surface->pitch
+				+ (dx > 0 ? dx : 0) * bpp,
+			w * bpp);
+	}
+
+	if (SDL_MUSTLOCK(surface))
+		SDL_UnlockSurface(surface);
+	return 0;
+}
+
+/**
+ * Finds the regions of the screen that differ from the last frame once it's
+ * been scrolled into place
+ * @param world The world
+ * @param frame The frame being drawn
+ * @param dx How many pixels the screen moved right since the last frame
+ * @param dy How many pixels the screen moved down since the last frame
+ * @return 0 on success and a negative value on error
+ */
+static int find_dirty_regions(World world, const struct Frame *frame,
+	int dx, int dy)
+{
+	dirty_regions.len = 0;
+
+	// The strips scrolled into view
+	if (dx && rect_list_push(&dirty_regions, (SDL_Rect) {
+		.x = dx > 0 ? SCREEN_WIDTH - dx : 0,
+		.y = 0,
+		.w = abs(dx),
+		.h = SCREEN_HEIGHT,
+	}) < 0)
+		return -1;
+	if (dy && rect_list_push(&dirty_regions, (SDL_Rect) {
+		.x = 0,
+		.y = dy > 0 ? SCREEN_HEIGHT - dy : 0,
+		.w = SCREEN_WIDTH,
+		.h = abs(dy),
+	}) < 0)
+		return -1;
+
+	// Chunks that changed
+	const SDL_Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+	int64_t cx1, cy1, cx2, cy2;
+	region_chunks(frame, &screen, &cx1, &cy1, &cx2, &cy2);
+	for (int64_t cy = cy1; cy <= cy2; ++cy) {
+		for (int64_t cx = cx1; cx <= cx2; ++cx) {
+			Chunk chunk = world_get_chunk(world, cx, cy);
+			if (chunk && chunk->flags & CHUNK_RENDER_DIRTY &&
+				rect_list_push(&dirty_regions,
+				chunk_rect(cx, cy, frame)) < 0)
 				return -1;
 		}
 	}
+
+	// The HUD, which is drawn over each frame after it's finished
+	if (last_frame.overlay.w && rect_list_push(&dirty_regions, (SDL_Rect) {
+		.x = last_frame.overlay.x - dx,
+		.y = last_frame.overlay.y - dy,
+		.w = last_frame.overlay.w,
+		.h = last_frame.overlay.h,
+	}) < 0)
+		return -1;
+
+	// Entities, both where they were and where they are now
+	for (size_t i = 0; i < last_frame.entities.len; ++i) {
+		SDL_Rect rect = last_frame.entities.rects[i];
+		rect.x -= dx;
+		rect.y -= dy;
+		if (rect_list_push(&dirty_regions, rect) < 0)
+			return -1;
+	}
+	for (size_t i = 0; i < frame->entities->len; ++i)
+		if (rect_list_push(&dirty_regions,
+			frame->entities->rects[i]) < 0)
+			return -1;
+
 	return 0;
 }
 
 /**
- * Renders every chunk in-view from the player's perspective
+ * Draws a frame of the world from the player's perspective
  * @param world The collection of chunks
  * @param view The player view
- * @return 0 on success and a negative value on SDL error
+ * @param mode How much of the last frame may be kept
+ * @return 0 on success and a negative value on error
  */
-int world_draw(World world, struct PlayerView *view)
+int render_frame(World world, struct PlayerView *view, enum RenderMode mode)
 {
+	TRACE_ZONE("render_frame");
 	// (x1, y2) ---------------+ x2 > x1
 	// |                       | y2 > y1
 	// |   What the user can   |
@@ -151,38 +678,311 @@ int world_draw(World world, struct PlayerView *view)
 	const double y1 = view->center_y - height / 2.0;
 	const double y2 = y1 + height;
 
-	// Chunk coordinates to determine what chunks are within view
-	const int64_t cx1 = floor(x1 / CHUNK_LENGTH);
-	const int64_t cx2 = floor(x2 / CHUNK_LENGTH);
-	const int64_t cy1 = floor(y1 / CHUNK_LENGTH);
-	const int64_t cy2 = floor(y2 / CHUNK_LENGTH);
+	const double tile_width = SCREEN_WIDTH / view->width;
+	if (tile_width != chunk_cache.tile_width) {
+		chunk_cache_flush();
+		chunk_cache.tile_width = tile_width;
+	}
+	++chunk_cache.frame;
 
-	for (int64_t cy = cy1; cy <= cy2; ++cy) {
-		for (int64_t cx = cx1; cx <= cx2; ++cx) {
-			Chunk chunk = world_get_chunk(world, cx, cy);
-			if (!chunk)
-				continue;
-			if (chunk_draw(chunk, view) < 0)
+	struct Frame frame = {
+		.x = pixel_x(x1, tile_width),
+		.y = pixel_y(y2, tile_width),
+		.tile_width = tile_width,
+		.alpha = view->alpha,
+		.entities = &frame_entities,
+	};
+
+	// Any part of an entity's hitbox being on the screen is enough to draw
+	// it
+	frame_entities.len = 0;
+	const struct EntityPool *pool = &world->entities;
+	if (entity_query_rect(pool, x1 - ENTITY_DRAW_MARGIN,
+		y1 - ENTITY_DRAW_MARGIN, x2 + ENTITY_DRAW_MARGIN,
+		y2 + ENTITY_DRAW_MARGIN, &nearby_entities) < 0)
+		return -1;
+	const SDL_Rect screen = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+	for (size_t j = 0; j < nearby_entities.len; ++j) {
+		SDL_Rect rect = entity_rect(pool, nearby_entities.indices[j],
+			&frame);
+		if (SDL_HasIntersection(&rect, &screen) &&
+			rect_list_push(&frame_entities, rect) < 0)
+			return -1;
+	}
+
+	const int64_t dx = frame.x - last_frame.x;
+	const int64_t dy = frame.y - last_frame.y;
+	const bool repaint = mode == RENDER_FULL || !last_frame.valid ||
+		last_frame.surface != g_surface ||
+		last_frame.tile_width != tile_width ||
+		++last_frame.age >= FULL_REPAINT_INTERVAL ||
+		llabs(dx) >= SCREEN_WIDTH || llabs(dy) >= SCREEN_HEIGHT;
+
+	// A failure partway through leaves the screen in an unknown state
+	last_frame.valid = false;
+
+	if (repaint) {
+		if (region_draw(world, &frame, screen) < 0)
+			return -1;
+		last_frame.age = 0;
+		++g_render_stats.full_repaints;
+	} else {
+		if (surface_scroll(g_surface, dx, dy) < 0)
+			return -1;
+		if (find_dirty_regions(world, &frame, dx, dy) < 0)
+			return -1;
+		for (size_t i = 0; i < dirty_regions.len; ++i)
+			if (region_draw(world, &frame,
+				dirty_regions.rects[i]) < 0)
 				return -1;
-		}
 	}
 
-	struct HashMapIterator it;
-	struct HashMapNode *entity_entry;
-	hashmap_iterator_init(&it, world->entitymap);
-	while ((entity_entry = hashmap_iterate(&it))) {
-		Entity entity = entity_entry->value;
-		// TODO: This won't render an entity if more than half of their
-		// hitbox is out-of-frame
-		if (x1 <= entity->x && entity->x <= x2 && y1 <= entity->y &&
-			entity->y <= y2) {
-
-			if (entity_draw(entity, view) < 0)
+	// Chunks drawn this frame are kept even when they go over the budget,
+	// since they'd only be rendered again next frame
+	while (g_render_stats.cache_bytes > CHUNK_CACHE_BUDGET &&
+		chunk_cache.tail->frame != chunk_cache.frame)
+		chunk_cache_evict();
+
+	struct RectList swap = last_frame.entities;
+	last_frame.entities = frame_entities;
+	frame_entities = swap;
+
+	last_frame.surface = g_surface;
+	last_frame.tile_width = tile_width;
+	last_frame.x = frame.x;
+	last_frame.y = frame.y;
+	last_frame.overlay = (SDL_Rect) {0};
+	last_frame.valid = true;
+	return 0;
+}
+
+/**
+ * Renders every chunk in-view from the player's perspective, from scratch
+ * @param world The collection of chunks
+ * @param view The player view
+ * @return 0 on success and a negative value on error
+ */
+int world_draw(World world, struct PlayerView *view)
+{
+	return render_frame(world, view, RENDER_FULL);
+}
+
+/**
+ * Shows or hides the HUD
+ */
+void hud_toggle(void)
+{
+	hud.visible = !hud.visible;
+	// Drawn with fresh text when it's next shown
+	hud.since_refresh = HUD_REFRESH_FRAMES;
+}
+
+/**
+ * Records how long a frame took, for the HUD to show
+ * @param times The frame's timings
+ */
+void hud_push_frame(const struct FrameTimes *times)
+{
+	hud.history[hud.next] = *times;
+	hud.next = (hud.next + 1) % HUD_HISTORY;
+	++hud.since_refresh;
+}
+
+/**
+ * Records the counters of the chunk stream the simulation world is filled by,
+ * for the HUD to show
+ * @param stats The counters
+ */
+void hud_set_stream_stats(const struct StreamStats *stats)
+{
+	hud.stream = *stats;
+}
+
+/**
+ * Draws every glyph of the font onto one surface, which text is blitted from
+ * @return 0 on success and a negative value on SDL error
+ */
+static int hud_glyphs_init(void)
+{
+	const int w = FONT_WIDTH * HUD_SCALE;
+	const int h = FONT_HEIGHT * HUD_SCALE;
+	hud.glyphs = SDL_CreateRGBSurface(0, w * FONT_NUM_GLYPHS, h,
+		g_surface->format->BitsPerPixel,
+		g_surface->format->Rmask, g_surface->format->Gmask,
+		g_surface->format->Bmask, g_surface->format->Amask);
+	if (!hud.glyphs)
+		return -1;
+
+	Uint32 key = SDL_MapRGB(hud.glyphs->format, 0, 0, 0);
+	Uint32 white = SDL_MapRGB(hud.glyphs->format, 255, 255, 255);
+	if (SDL_SetColorKey(hud.glyphs, SDL_TRUE, key) < 0 ||
+		SDL_FillRect(hud.glyphs, NULL, key) < 0)
+		return -1;
+
+	for (int i = 0; i < FONT_NUM_GLYPHS; ++i)
+		for (int y = 0; y < FONT_HEIGHT; ++y)
+			for (int x = 0; x < FONT_WIDTH; ++x) {
+				if (!font_pixel(font_glyphs[i], x, y))
+					continue;
+				SDL_Rect pixel = {
+					i * w + x * HUD_SCALE, y * HUD_SCALE,
+					HUD_SCALE, HUD_SCALE,
+				};
+				if (SDL_FillRect(hud.glyphs, &pixel, white) < 0)
+					return -1;
+			}
+	return 0;
+}
+
+/**
+ * Draws a line of text onto the screen
+ * @param text The text
+ * @param x The column of its top-left corner
+ * @param y The row of its top-left corner
+ * @return 0 on success and a negative value on SDL error
+ */
+static int text_draw(const char *text, int x, int y)
+{
+	const int w = FONT_WIDTH * HUD_SCALE;
+	const int h = FONT_HEIGHT * HUD_SCALE;
+
+	for (; *text; ++text, x += w + HUD_SCALE) {
+		// Spaces and characters the font doesn't have are left blank
+		int index = font_index(*text);
+		if (index <= 0)
+			continue;
+
+		SDL_Rect glyph = {index * w, 0, w, h};
+		SDL_Rect rect = {x, y, w, h};
+		if (SDL_BlitSurface(hud.glyphs, &glyph, g_surface, &rect) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Rewrites the HUD's text from the latest counters
+ * @param world The world being drawn
+ */
+static void hud_refresh(World world)
+{
+	// Averaged over the frames since the last refresh
+	unsigned frames = hud.since_refresh < HUD_HISTORY ?
+		hud.since_refresh : HUD_HISTORY;
+	struct FrameTimes mean = {0};
+	for (unsigned i = 1; i <= frames; ++i) {
+		const struct FrameTimes *times =
+			&hud.history[(hud.next + HUD_HISTORY - i) % HUD_HISTORY];
+		mean.frame_ms += times->frame_ms / frames;
+		mean.sim_ms += times->sim_ms / frames;
+		mean.render_ms += times->render_ms / frames;
+	}
+
+	struct TypedMapStats chunks;
+	chunkmap_stats(world->chunkmap, &chunks);
+
+	snprintf(hud.lines[0], sizeof(hud.lines[0]),
+		"FRAME %.2f MS  %.0f FPS", mean.frame_ms,
+		mean.frame_ms > 0 ? 1000 / mean.frame_ms : 0.0);
+	snprintf(hud.lines[1], sizeof(hud.lines[1]),
+		"SIM %.2f MS  RENDER %.2f MS", mean.sim_ms, mean.render_ms);
+	snprintf(hud.lines[2], sizeof(hud.lines[2]),
+		"CHUNKS %zu  LOAD %.0f%%  MAX PROBE %u", chunks.size,
+		chunks.capacity ? 100.0 * chunks.size / chunks.capacity : 0.0,
+		chunks.max_probe);
+	snprintf(hud.lines[3], sizeof(hud.lines[3]),
+		"ENTITIES %zu", world->entities.len);
+	snprintf(hud.lines[4], sizeof(hud.lines[4]),
+		"CACHE %.1f MB (%zu)  SPRITES %.1f MB",
+		g_render_stats.cache_bytes / 1048576.0,
+		g_render_stats.cached_chunks,
+		g_render_stats.sprite_bytes / 1048576.0);
+	snprintf(hud.lines[5], sizeof(hud.lines[5]),
+		"STREAM %.1f MB  EVICT %llu  RELOAD %llu",
+		hud.stream.resident_bytes / 1048576.0,
+		(unsigned long long) hud.stream.evicted,
+		(unsigned long long) hud.stream.reloaded);
+	hud.since_refresh = 0;
+}
+
+/**
+ * Draws the HUD over the frame, if it's shown
+ * It must be drawn after render_frame, which knows to draw over it in the next
+ * frame.
+ * @param world The world being drawn
+ * @return 0 on success and a negative value on error
+ */
+int hud_draw(World world)
+{
+	TRACE_ZONE("hud_draw");
+	if (!hud.visible || !world)
+		return 0;
+	if (!hud.glyphs && hud_glyphs_init() < 0)
+		return -1;
+	if (hud.since_refresh >= HUD_REFRESH_FRAMES)
+		hud_refresh(world);
+
+	const int line_height = (FONT_HEIGHT + 2) * HUD_SCALE;
+	const int text_height = HUD_LINES * line_height;
+	SDL_Rect panel = {
+		.x = HUD_MARGIN,
+		.y = HUD_MARGIN,
+		.w = HUD_LINE_LENGTH * (FONT_WIDTH + 1) * HUD_SCALE
+			+ 2 * HUD_MARGIN,
+		.h = text_height + HUD_GRAPH_HEIGHT + 3 * HUD_MARGIN,
+	};
+	if (SDL_FillRect(g_surface, &panel,
+		SDL_MapRGB(g_surface->format, 16, 16, 16)) < 0)
+		return -1;
+	last_frame.overlay = panel;
+
+	for (int i = 0; i < HUD_LINES; ++i)
+		if (text_draw(hud.lines[i], panel.x + HUD_MARGIN,
+			panel.y + HUD_MARGIN + i * line_height) < 0)
+			return -1;
+
+	// Each frame is a bar of its sim time with its render time stacked on
+	// top, behind a bar of the whole frame time
+	const int bottom = panel.y + 2 * HUD_MARGIN + text_height
+		+ HUD_GRAPH_HEIGHT;
+	const int bar_width = (panel.w - 2 * HUD_MARGIN) / HUD_HISTORY;
+	const Uint32 colors[] = {
+		SDL_MapRGB(g_surface->format, 96, 96, 96),
+		SDL_MapRGB(g_surface->format, 255, 160, 0),
+		SDL_MapRGB(g_surface->format, 0, 160, 255),
+	};
+	for (unsigned i = 0; i < HUD_HISTORY; ++i) {
+		const struct FrameTimes *times =
+			&hud.history[(hud.next + i) % HUD_HISTORY];
+		const double bars[][2] = {
+			{0, times->frame_ms},
+			{0, times->sim_ms},
+			{times->sim_ms, times->sim_ms + times->render_ms},
+		};
+		for (int b = 0; b < 3; ++b) {
+			int y1 = bars[b][0] / HUD_GRAPH_MS_PER_PIXEL;
+			int y2 = bars[b][1] / HUD_GRAPH_MS_PER_PIXEL;
+			if (y2 > HUD_GRAPH_HEIGHT)
+				y2 = HUD_GRAPH_HEIGHT;
+			if (y1 >= y2)
+				continue;
+			SDL_Rect bar = {
+				panel.x + HUD_MARGIN + i * bar_width,
+				bottom - y2, bar_width, y2 - y1,
+			};
+			if (SDL_FillRect(g_surface, &bar, colors[b]) < 0)
 				return -1;
 		}
 	}
 
-	return 0;
+	// A line at 60 frames per second
+	SDL_Rect line = {
+		panel.x + HUD_MARGIN,
+		bottom - (int) (1000.0 / 60 / HUD_GRAPH_MS_PER_PIXEL),
+		HUD_HISTORY * bar_width, 1,
+	};
+	return SDL_FillRect(g_surface, &line,
+		SDL_MapRGB(g_surface->format, 255, 255, 255));
 }
 
 /**
@@ -191,15 +991,18 @@ int world_draw(World world, struct PlayerView *view)
  */
 int render_init(void)
 {
-	for (size_t i = 0; i < ARRAY_LEN(tile_filenames); ++i) {
-		if (!tile_filenames[i])
-			continue;
-		SDL_Surface *surface = SDL_LoadBMP(tile_filenames[i]);
+	for (size_t i = 0; i < NUM_TEXTURES; ++i) {
+		SDL_Surface *surface = SDL_LoadBMP(texture_files[i]);
 		if (!surface)
 			return -1;
-		block_textures[i] = surface;
-		scaled_block_textures[i] = hashmap_new(8);
+		textures[i] = surface;
+		scaled_textures[i] = spritemap_new(8);
+		if (!scaled_textures[i])
+			return -1;
 	}
+	chunk_cache.map = chunkcache_new(64);
+	if (!chunk_cache.map)
+		return -1;
 	return 0;
 }
 
@@ -208,19 +1011,35 @@ int render_init(void)
  */
 void render_free(void)
 {
-	for (size_t i = 0; i < ARRAY_LEN(block_textures); ++i) {
-		SDL_FreeSurface(block_textures[i]);
-
-		struct HashMapNode *node;
-		struct HashMapIterator it;
-		hashmap_iterator_init(&it, scaled_block_textures[i]);
-		while ((node = hashmap_iterate(&it)))
-			SDL_FreeSurface(node->value);
-		hashmap_free(scaled_block_textures[i]);
+	chunk_cache_flush();
+	chunkcache_free(chunk_cache.map);
+	chunk_cache.map = NULL;
+
+	SDL_FreeSurface(hud.glyphs);
+	hud.glyphs = NULL;
+	g_render_stats.sprite_bytes = 0;
+
+	free(last_frame.entities.rects);
+	free(frame_entities.rects);
+	free(dirty_regions.rects);
+	entity_query_free(&nearby_entities);
+	memset(&last_frame, 0, sizeof(last_frame));
+	memset(&frame_entities, 0, sizeof(frame_entities));
+	memset(&dirty_regions, 0, sizeof(dirty_regions));
+
+	for (size_t i = 0; i < NUM_TEXTURES; ++i) {
+		SDL_FreeSurface(textures[i]);
+
+		struct SpriteMapEntry *entry;
+		struct SpriteMapIterator it;
+		spritemap_iterator_init(&it, scaled_textures[i]);
+		while ((entry = spritemap_iterate(&it)))
+			SDL_FreeSurface(entry->value);
+		spritemap_free(scaled_textures[i]);
 	}
 
-	memset(block_textures, 0, sizeof(block_textures));
-	memset(scaled_block_textures, 0, sizeof(scaled_block_textures));
+	memset(textures, 0, sizeof(textures));
+	memset(scaled_textures, 0, sizeof(scaled_textures));
 }
 
 /**
@@ -231,14 +1050,17 @@ void render_free(void)
  */
 int sprites_update(struct PlayerView *view)
 {
+	TRACE_ZONE("sprites_update");
 	if (!view)
 		return -1;
 
+	// The cached chunks were drawn with the old sprites
+	chunk_cache_flush();
+
 	int sprite_width = floor(SCREEN_WIDTH / view->width);
-	for (size_t i = 0; i < ARRAY_LEN(block_textures); ++i) {
-		// This means that either the block doesn't have a texture to
-		// begin with, or render_init was never called
-		if (!block_textures[i])
+	for (size_t i = 0; i < NUM_TEXTURES; ++i) {
+		// This means that render_init was never called
+		if (!textures[i])
 			continue;
 
 		for (int h = sprite_width - 1; h <= sprite_width + 1; ++h)
@@ -247,7 +1069,7 @@ int sprites_update(struct PlayerView *view)
 				// scaled
 				SDL_Surface *formatted_surface =
 					SDL_ConvertSurface(
-						block_textures[i],
+						textures[i],
 						g_surface->format,
 						0);
 				if (!formatted_surface)
@@ -275,14 +1097,20 @@ int sprites_update(struct PlayerView *view)
 
 				SDL_FreeSurface(formatted_surface);
 
-				size_t hash = hash_coordinate(w, h);
-				// Using the address of w is a hack to skip a
-				// dynamic allocation here. Put simply, &w is
-				// right before &h, so the next int*2 bytes will
-				// contain the dimensions of the surface.
-				if (hashmap_put(scaled_block_textures[i],
-					&scaled_surface->w, sizeof(int) * 2,
-					scaled_surface, hash) < 0)
+				// Replace any sprite left from a previous call
+				struct SpriteKey key = {w, h};
+				SDL_Surface **old_surface = spritemap_get(
+					scaled_textures[i], key);
+				if (old_surface) {
+					g_render_stats.sprite_bytes -=
+						(*old_surface)->pitch *
+						(*old_surface)->h;
+					SDL_FreeSurface(*old_surface);
+				}
+				g_render_stats.sprite_bytes +=
+					scaled_surface->pitch * scaled_surface->h;
+				if (spritemap_put(scaled_textures[i],
+					key, scaled_surface) < 0)
 					return -1;
 			}
 	}
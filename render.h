@@ -2,6 +2,7 @@
 #define RENDER_H
 
 #include "world.h"
+#include "stream.h"
 
 #define SCREEN_WIDTH (720*16/9)
 #define SCREEN_HEIGHT 720
@@ -10,11 +11,59 @@ struct PlayerView {
 	double center_x, center_y;
 	// How many blocks are shown horizontally
 	double width;
+	// How far between their positions before and after the last tick
+	// entities are drawn, where 1 is where they are now
+	double alpha;
 };
 
+// How much of the last frame render_frame keeps
+enum RenderMode {
+	// Everything is drawn from scratch
+	RENDER_FULL,
+	// The last frame is scrolled by however many pixels the view moved,
+	// and only what it scrolled in or what changed is drawn
+	RENDER_SCROLL,
+};
+
+// Counters for profiling the renderer. All but the last three are only ever
+// incremented.
+struct RenderStats {
+	// Chunks drawn from their cached surface
+	uint64_t cache_hits;
+	// Chunks rendered because they weren't cached
+	uint64_t cache_misses;
+	// Chunks rendered again because they changed
+	uint64_t rerenders;
+	// Surfaces freed to stay within the memory budget
+	uint64_t evictions;
+	// Pixels cleared and drawn over, counting each region drawn once
+	uint64_t pixels_drawn;
+	// Frames drawn entirely from scratch
+	uint64_t full_repaints;
+	size_t cached_chunks;
+	size_t cache_bytes;
+	// Memory used by scaled block textures
+	size_t sprite_bytes;
+};
+
+// How long the parts of a frame took, which the HUD graphs
+struct FrameTimes {
+	double frame_ms;
+	// Handling input and updating the world
+	double sim_ms;
+	double render_ms;
+};
+
+extern struct RenderStats g_render_stats;
+
 int render_init(void);
 void render_free(void);
 int sprites_update(struct PlayerView *);
 int world_draw(World world, struct PlayerView *view);
+int render_frame(World world, struct PlayerView *view, enum RenderMode mode);
+void hud_toggle(void);
+void hud_push_frame(const struct FrameTimes *times);
+void hud_set_stream_stats(const struct StreamStats *stats);
+int hud_draw(World world);
 
 #endif // RENDER_H
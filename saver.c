@@ -0,0 +1,468 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "saver.h"
+#include "globals.h"
+#include "trace.h"
+
+// The entities file starts with these, then the number of entities
+#define SAVER_ENTITIES_MAGIC 0x4E454753 // "SGEN"
+#define SAVER_ENTITIES_VERSION 1
+#define SAVER_ENTITIES_HEADER_BYTES 12
+// An entity's uuid, type, looking direction, position, velocity and health,
+// followed by the inventory slots of a player
+#define SAVER_ENTITY_BYTES (16 + 2 + 5 * 8)
+#define SAVER_ITEM_BYTES 3
+#define SAVER_PLAYER_BYTES (SAVER_ITEM_BYTES * NUM_INVENTORY_SLOTS)
+
+static int saver_run(void *data);
+static int saver_write(Saver saver);
+static void saver_release(Saver saver, bool failed);
+static int saver_push_chunk(Saver saver, Chunk chunk);
+static int saver_serialize_entities(Saver saver, struct EntityPool *pool);
+
+/**
+ * Writes a little-endian uint32_t
+ * @param data Where to write it
+ * @param value The value
+ */
+static inline void saver_put32(uint8_t *data, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+		data[i] = value >> 8 * i;
+}
+
+/**
+ * Writes a double as a little-endian uint64_t of its bits
+ * @param data Where to write it
+ * @param value The value
+ */
+static inline void saver_put_double(uint8_t *data, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 8; ++i)
+		data[i] = bits >> 8 * i;
+}
+
+/**
+ * Reads a little-endian uint32_t
+ * @param data Where to read it from
+ * @return The value
+ */
+static inline uint32_t saver_get32(const uint8_t *data)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; ++i)
+		value |= (uint32_t) data[i] << 8 * i;
+	return value;
+}
+
+/**
+ * Reads a double written by saver_put_double
+ * @param data Where to read it from
+ * @return The value
+ */
+static inline double saver_get_double(const uint8_t *data)
+{
+	uint64_t bits = 0;
+	for (int i = 0; i < 8; ++i)
+		bits |= (uint64_t) data[i] << 8 * i;
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/**
+ * Creates a saver and starts its thread
+ * @param store The store to save into, which must outlive the saver
+ * @return The saver, or NULL if an error occurred
+ */
+Saver saver_new(RegionStore store)
+{
+	Saver saver = calloc(1, sizeof(*saver));
+	if (!saver) {
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+
+	saver->store = store;
+	saver->running = true;
+	atomic_init(&saver->done, false);
+	saver->lock = SDL_CreateMutex();
+	saver->wake = SDL_CreateCond();
+	saver->finished = SDL_CreateCond();
+	if (!saver->lock || !saver->wake || !saver->finished ||
+		!(saver->thread = SDL_CreateThread(saver_run, "saver",
+		saver))) {
+		SDL_DestroyCond(saver->finished);
+		SDL_DestroyCond(saver->wake);
+		SDL_DestroyMutex(saver->lock);
+		free(saver);
+		return NULL;
+	}
+	return saver;
+}
+
+/**
+ * Finishes the save in progress, if any, then stops the saver's thread and
+ * frees it
+ * This has to be called before the world being saved is freed.
+ * @param saver The saver
+ */
+void saver_free(Saver saver)
+{
+	if (!saver)
+		return;
+
+	SDL_LockMutex(saver->lock);
+	saver->running = false;
+	SDL_CondSignal(saver->wake);
+	SDL_UnlockMutex(saver->lock);
+	// The thread writes out a queued snapshot before it stops
+	SDL_WaitThread(saver->thread, NULL);
+	if (saver->busy)
+		saver_release(saver, saver->result < 0);
+
+	SDL_DestroyCond(saver->finished);
+	SDL_DestroyCond(saver->wake);
+	SDL_DestroyMutex(saver->lock);
+	free(saver->chunks);
+	free(saver->entities);
+	free(saver);
+}
+
+/**
+ * Takes a snapshot of a world's modified chunks and its entities, and hands it
+ * to the saver's thread
+ * Chunks are saved as they are when this is called, and count as unmodified
+ * from then on. If the save fails, saver_poll marks them as modified again.
+ * @param saver The saver
+ * @param world The world, which must not be freed until the save is done
+ * @return 1 if the save began, 0 if another one is still in progress and a
+ * 	negative value on error
+ */
+int saver_begin(Saver saver, World world)
+{
+	TRACE_ZONE("saver_begin");
+	if (saver->busy)
+		return 0;
+	const uint64_t start = SDL_GetPerformanceCounter();
+
+	saver->num_chunks = 0;
+	struct ChunkMapIterator it;
+	chunkmap_iterator_init(&it, world->chunkmap);
+	struct ChunkMapEntry *entry;
+	while ((entry = chunkmap_iterate(&it))) {
+		Chunk chunk = entry->value;
+		if (!(chunk->flags & CHUNK_MODIFIED))
+			continue;
+		if (saver_push_chunk(saver, chunk) < 0) {
+			saver_release(saver, true);
+			return -1;
+		}
+		chunk->flags = (chunk->flags & ~CHUNK_MODIFIED) | CHUNK_SHARED;
+	}
+	if (saver_serialize_entities(saver, &world->entities) < 0) {
+		saver_release(saver, true);
+		return -1;
+	}
+
+	saver->started = start;
+	saver->busy = true;
+	atomic_store_explicit(&saver->done, false, memory_order_relaxed);
+	SDL_LockMutex(saver->lock);
+	saver->queued = true;
+	SDL_CondSignal(saver->wake);
+	SDL_UnlockMutex(saver->lock);
+
+	saver->stats.last_snapshot_us = (SDL_GetPerformanceCounter() - start) /
+		(SDL_GetPerformanceFrequency() / 1e6);
+	return 1;
+}
+
+/**
+ * Collects the save in progress if the saver's thread is done with it, which
+ * lets its chunks change in place again and frees the ones it kept alive
+ * @param saver The saver
+ * @return 0 on success, or if no save was done, and a negative value if the
+ * 	save failed
+ */
+int saver_poll(Saver saver)
+{
+	if (!saver->busy ||
+		!atomic_load_explicit(&saver->done, memory_order_acquire))
+		return 0;
+
+	const bool failed = saver->result < 0;
+	saver_release(saver, failed);
+	saver->busy = false;
+	if (failed) {
+		g_error_message = saver->error;
+		return -1;
+	}
+
+	const uint64_t latency_us = (saver->ended - saver->started) /
+		(SDL_GetPerformanceFrequency() / 1e6);
+	++saver->stats.saves;
+	saver->stats.last_latency_us = latency_us;
+	if (latency_us > saver->stats.max_latency_us)
+		saver->stats.max_latency_us = latency_us;
+	return 0;
+}
+
+/**
+ * Waits for the save in progress, if any, and collects it
+ * @param saver The saver
+ * @return 0 on success and a negative value if the save failed
+ */
+int saver_wait(Saver saver)
+{
+	TRACE_ZONE("saver_wait");
+	SDL_LockMutex(saver->lock);
+	while (saver->busy &&
+		!atomic_load_explicit(&saver->done, memory_order_acquire))
+		SDL_CondWait(saver->finished, saver->lock);
+	SDL_UnlockMutex(saver->lock);
+	return saver_poll(saver);
+}
+
+/**
+ * Saves a modified chunk right away, such as before it's unloaded
+ * The save in progress may hold an older version of the chunk, which it
+ * would overwrite this one with, so nothing is saved until it's collected.
+ * That isn't waited for, since this is called between ticks.
+ * @param saver The saver
+ * @param chunk The chunk, whose CHUNK_MODIFIED flag is left for the caller
+ * @return 1 if the chunk was saved, 0 if a save is still in progress, and a
+ * 	negative value on error
+ */
+int saver_save_chunk(Saver saver, Chunk chunk)
+{
+	if (saver_poll(saver) < 0)
+		return -1;
+	if (saver->busy)
+		return 0;
+	if (region_save_chunk(saver->store, chunk) < 0)
+		return -1;
+	return 1;
+}
+
+/**
+ * Spawns the entities of the last save into a pool
+ * @param store The store the world was saved in
+ * @param pool The pool
+ * @return How many entities were spawned, or a negative value on error
+ */
+int saver_load_entities(RegionStore store, struct EntityPool *pool)
+{
+	uint8_t *data;
+	size_t len;
+	if (region_read_file(store, "entities", &data, &len) < 0)
+		return -1;
+	if (!data)
+		return 0;
+
+	size_t at = SAVER_ENTITIES_HEADER_BYTES;
+	uint32_t count = 0;
+	if (len < at || saver_get32(data) != SAVER_ENTITIES_MAGIC ||
+		saver_get32(data + 4) != SAVER_ENTITIES_VERSION)
+		goto corrupt;
+	count = saver_get32(data + 8);
+	for (uint32_t n = 0; n < count; ++n) {
+		if (len - at < SAVER_ENTITY_BYTES)
+			goto corrupt;
+		const uint8_t *bytes = data + at;
+		const double x = saver_get_double(bytes + 18);
+		const double y = saver_get_double(bytes + 26);
+		EntityHandle handle;
+		if (bytes[16] == PLAYER_ENTITY) {
+			if (len - at < SAVER_ENTITY_BYTES + SAVER_PLAYER_BYTES)
+				goto corrupt;
+			handle = entity_spawn_player(pool, x, y);
+		} else if (bytes[16] == COW_ENTITY) {
+			handle = entity_spawn_cow(pool, x, y);
+		} else {
+			goto corrupt;
+		}
+		if (handle == ENTITY_NONE)
+			goto error;
+
+		const size_t i = entity_index(pool, handle);
+		pool->looking_dir[i] = bytes[17] ? LOOKING_RIGHT : LOOKING_LEFT;
+		pool->velocity_x[i] = saver_get_double(bytes + 34);
+		pool->velocity_y[i] = saver_get_double(bytes + 42);
+		pool->health[i] = saver_get_double(bytes + 50);
+		if (entity_set_uuid(pool, handle, bytes) < 0)
+			goto corrupt;
+		at += SAVER_ENTITY_BYTES;
+
+		struct Player *player = entity_player(pool, handle);
+		for (int s = 0; player && s < NUM_INVENTORY_SLOTS; ++s) {
+			struct Item *item = &player->inventory[s];
+			item->type = data[at];
+			item->stackable = data[at + 1];
+			item->quantity = data[at + 2];
+			at += SAVER_ITEM_BYTES;
+		}
+	}
+	free(data);
+	return count;
+
+corrupt:
+	g_error_message = "the saved entities are corrupt";
+error:
+	free(data);
+	return -1;
+}
+
+/**
+ * Writes out every snapshot handed to it until the saver is freed
+ * @param data The saver
+ * @return 0
+ */
+static int saver_run(void *data)
+{
+	TRACE_THREAD_NAME("saver");
+	Saver saver = data;
+	SDL_LockMutex(saver->lock);
+	for (;;) {
+		while (saver->running && !saver->queued)
+			SDL_CondWait(saver->wake, saver->lock);
+		if (!saver->queued)
+			break;
+		saver->queued = false;
+		SDL_UnlockMutex(saver->lock);
+
+		int result = saver_write(saver);
+
+		SDL_LockMutex(saver->lock);
+		saver->result = result;
+		saver->error = g_error_message;
+		saver->ended = SDL_GetPerformanceCounter();
+		atomic_store_explicit(&saver->done, true, memory_order_release);
+		SDL_CondBroadcast(saver->finished);
+	}
+	SDL_UnlockMutex(saver->lock);
+	return 0;
+}
+
+/**
+ * Encodes a snapshot into the region files and flushes them, on the saver's
+ * thread
+ * @param saver The saver
+ * @return 0 on success and a negative value on error
+ */
+static int saver_write(Saver saver)
+{
+	TRACE_ZONE("saver_write");
+	for (size_t i = 0; i < saver->num_chunks; ++i)
+		if (region_save_chunk(saver->store, saver->chunks[i]) < 0)
+			return -1;
+	if (region_write_file(saver->store, "entities", saver->entities,
+		saver->entities_len) < 0)
+		return -1;
+	return region_flush(saver->store);
+}
+
+/**
+ * Hands a snapshot's chunks back to their world, freeing the ones it no
+ * longer has
+ * @param saver The saver
+ * @param failed Whether the chunks weren't saved, and so are still modified
+ */
+static void saver_release(Saver saver, bool failed)
+{
+	for (size_t i = 0; i < saver->num_chunks; ++i) {
+		Chunk chunk = saver->chunks[i];
+		if (chunk->flags & CHUNK_DETACHED) {
+			// The copy in its place took over its modified flag
+			chunk_free(chunk);
+			continue;
+		}
+		chunk->flags &= ~CHUNK_SHARED;
+		if (failed)
+			chunk->flags |= CHUNK_MODIFIED;
+	}
+	if (!failed)
+		saver->stats.chunks_saved += saver->num_chunks;
+	saver->num_chunks = 0;
+}
+
+/**
+ * Adds a chunk to the snapshot
+ * @param saver The saver
+ * @param chunk The chunk
+ * @return 0 on success and a negative value on error
+ */
+static int saver_push_chunk(Saver saver, Chunk chunk)
+{
+	if (saver->num_chunks == saver->chunks_capacity) {
+		size_t capacity = saver->chunks_capacity
+			? saver->chunks_capacity * 2 : 256;
+		Chunk *chunks = realloc(saver->chunks,
+			capacity * sizeof(*chunks));
+		if (!chunks) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		saver->chunks = chunks;
+		saver->chunks_capacity = capacity;
+	}
+	saver->chunks[saver->num_chunks++] = chunk;
+	return 0;
+}
+
+/**
+ * Writes every entity of a pool into the snapshot
+ * @param saver The saver
+ * @param pool The pool, whose entities are given uuids if they have none yet
+ * @return 0 on success and a negative value on error
+ */
+static int saver_serialize_entities(Saver saver, struct EntityPool *pool)
+{
+	size_t len = SAVER_ENTITIES_HEADER_BYTES +
+		pool->len * SAVER_ENTITY_BYTES +
+		pool->num_players * SAVER_PLAYER_BYTES;
+	if (len > saver->entities_capacity) {
+		uint8_t *entities = realloc(saver->entities, len);
+		if (!entities) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		saver->entities = entities;
+		saver->entities_capacity = len;
+	}
+
+	uint8_t *data = saver->entities;
+	saver_put32(data, SAVER_ENTITIES_MAGIC);
+	saver_put32(data + 4, SAVER_ENTITIES_VERSION);
+	saver_put32(data + 8, pool->len);
+	size_t at = SAVER_ENTITIES_HEADER_BYTES;
+	for (size_t i = 0; i < pool->len; ++i) {
+		const unsigned char *uuid = entity_uuid(pool, pool->handle[i]);
+		if (!uuid)
+			return -1;
+		uint8_t *bytes = data + at;
+		memcpy(bytes, uuid, 16);
+		bytes[16] = pool->type[i];
+		bytes[17] = pool->looking_dir[i] == LOOKING_RIGHT;
+		saver_put_double(bytes + 18, pool->x[i]);
+		saver_put_double(bytes + 26, pool->y[i]);
+		saver_put_double(bytes + 34, pool->velocity_x[i]);
+		saver_put_double(bytes + 42, pool->velocity_y[i]);
+		saver_put_double(bytes + 50, pool->health[i]);
+		at += SAVER_ENTITY_BYTES;
+
+		struct Player *player = entity_player(pool, pool->handle[i]);
+		for (int s = 0; player && s < NUM_INVENTORY_SLOTS; ++s) {
+			const struct Item *item = &player->inventory[s];
+			data[at] = item->type;
+			data[at + 1] = item->stackable;
+			data[at + 2] = item->quantity;
+			at += SAVER_ITEM_BYTES;
+		}
+	}
+	saver->entities_len = at;
+	return 0;
+}
@@ -0,0 +1,79 @@
+/* Saves the world in the background. saver_begin takes a snapshot of the
+ * world between ticks, and a thread of the saver's own encodes it into the
+ * region files and flushes them while the simulation carries on.
+ *
+ * The snapshot doesn't copy the modified chunks. It marks them CHUNK_SHARED
+ * instead, and the world puts a copy in place of any shared chunk before
+ * changing it, so only the chunks changed during the save are ever copied.
+ * Entities are few enough that they're written out whole when the snapshot is
+ * taken.
+ *
+ * Every function but saver_load_entities is meant for the thread that owns
+ * the world.
+ */
+
+#ifndef SAVER_H
+#define SAVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include "world.h"
+#include "entity.h"
+#include "region.h"
+
+// Counters for profiling. The last ones are of the last save to finish, and
+// the rest are only ever incremented.
+struct SaverStats {
+	uint64_t saves;
+	uint64_t chunks_saved;
+	// How long the last snapshot held up the world's thread
+	uint64_t last_snapshot_us;
+	// How long the last save took from its snapshot until it was on disk
+	uint64_t last_latency_us;
+	uint64_t max_latency_us;
+};
+
+struct Saver {
+	RegionStore store;
+	struct SaverStats stats;
+
+	SDL_Thread *thread;
+	// Guards running and queued, and the thread waits on wake for them
+	// to change and signals finished once it's done with a snapshot
+	SDL_mutex *lock;
+	SDL_cond *wake, *finished;
+	bool running;
+	bool queued;
+	// Whether a snapshot was handed to the thread and not yet collected by
+	// saver_poll, which only the world's thread touches
+	bool busy;
+	// Set by the thread once it's done with the snapshot, with result
+	// set to the save's return value, error to the thread's
+	// g_error_message if it failed and ended to the performance counter
+	atomic_bool done;
+	int result;
+	char *error;
+	uint64_t ended;
+
+	// The snapshot, which belongs to the thread while busy
+	Chunk *chunks;
+	size_t num_chunks, chunks_capacity;
+	uint8_t *entities;
+	size_t entities_len, entities_capacity;
+	// The performance counter when the snapshot was taken
+	uint64_t started;
+};
+
+typedef struct Saver *Saver;
+
+Saver saver_new(RegionStore);
+void saver_free(Saver);
+int saver_begin(Saver, World);
+int saver_poll(Saver);
+int saver_wait(Saver);
+int saver_save_chunk(Saver, Chunk);
+int saver_load_entities(RegionStore, struct EntityPool *);
+
+#endif // SAVER_H
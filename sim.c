@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "sim.h"
+#include "globals.h"
+#include "trace.h"
+
+// How many chunks world_compact_step looks at after every batch of ticks
+#define COMPACT_CHUNKS_PER_BATCH 64
+
+static int sim_run(void *data);
+static int sim_batch(Sim sim, unsigned ticks, uint64_t end);
+
+/**
+ * Creates a simulation with an empty world, to be filled before sim_start
+ * @param tick_rate How many ticks to simulate per second
+ * @param max_ticks The most ticks to simulate at once, see FixedStep
+ * @return The simulation, or NULL if an error occurred
+ */
+Sim sim_new(unsigned tick_rate, unsigned max_ticks)
+{
+	Sim sim = calloc(1, sizeof(*sim));
+	if (!sim) {
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+
+	sim->world = world_new();
+	if (!sim->world) {
+		free(sim);
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+	// Everything put into the world from here on goes into the first
+	// snapshot
+	world_track_changes(sim->world);
+
+	sim->step.dt = 1.0 / tick_rate;
+	sim->step.max_ticks = max_ticks;
+	snapshot_buffer_init(&sim->snapshots);
+	atomic_init(&sim->running, false);
+	atomic_init(&sim->failed, false);
+	atomic_init(&sim->walk, 0);
+	atomic_init(&sim->jump, false);
+	atomic_init(&sim->batch_us, 0);
+	return sim;
+}
+
+/**
+ * Publishes the world as it is and starts simulating it on a new thread
+ * @param sim The simulation
+ * @return 0 on success and a negative value on error
+ */
+int sim_start(Sim sim)
+{
+	if (!sim)
+		return -1;
+
+	// The main thread has something to draw before the first tick
+	if (sim_batch(sim, 0, SDL_GetPerformanceCounter()) < 0)
+		return -1;
+
+	atomic_store(&sim->running, true);
+	sim->thread = SDL_CreateThread(sim_run, "sim", sim);
+	if (!sim->thread) {
+		atomic_store(&sim->running, false);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Stops the simulation thread after the batch of ticks it's on, leaving the
+ * world to the calling thread
+ * Does nothing if the thread isn't running.
+ * @param sim The simulation
+ */
+void sim_stop(Sim sim)
+{
+	atomic_store(&sim->running, false);
+	SDL_WaitThread(sim->thread, NULL);
+	sim->thread = NULL;
+}
+
+/**
+ * Stops the simulation thread and frees the simulation with its world
+ * @param sim The simulation
+ */
+void sim_free(Sim sim)
+{
+	if (!sim)
+		return;
+
+	sim_stop(sim);
+	stream_free(sim->stream);
+	saver_free(sim->saver);
+	snapshot_buffer_free(&sim->snapshots);
+	world_free(sim->world);
+	free(sim);
+}
+
+/**
+ * Passes the player's input on to the simulation, which uses it from its next
+ * tick onwards
+ * @param sim The simulation
+ * @param input The input
+ */
+void sim_set_input(Sim sim, const struct PlayerInput *input)
+{
+	atomic_store_explicit(&sim->walk, input->walk, memory_order_relaxed);
+	atomic_store_explicit(&sim->jump, input->jump, memory_order_relaxed);
+}
+
+/**
+ * Gets the latest snapshot the simulation published, for the main thread
+ * @param sim The simulation
+ * @return The snapshot, which stays valid until the next call
+ */
+struct Snapshot *sim_snapshot(Sim sim)
+{
+	return snapshot_acquire(&sim->snapshots);
+}
+
+/**
+ * Checks whether the simulation thread stopped because of an error
+ * @param sim The simulation
+ * @return Whether it did, in which case g_error_message is set to why
+ */
+bool sim_failed(Sim sim)
+{
+	if (!atomic_load_explicit(&sim->failed, memory_order_acquire))
+		return false;
+	g_error_message = sim->error;
+	return true;
+}
+
+/**
+ * Gets how long the simulation's last batch of ticks took
+ * @param sim The simulation
+ * @return The time in milliseconds
+ */
+double sim_batch_ms(Sim sim)
+{
+	return atomic_load_explicit(&sim->batch_us, memory_order_relaxed) /
+		1000.0;
+}
+
+/**
+ * Simulates ticks as they come due until the simulation is stopped
+ * @param data The simulation
+ * @return 0 once stopped and a negative value on error
+ */
+static int sim_run(void *data)
+{
+	TRACE_THREAD_NAME("sim");
+	Sim sim = data;
+	const double frequency = SDL_GetPerformanceFrequency();
+	Uint64 last_start = SDL_GetPerformanceCounter();
+
+	while (atomic_load_explicit(&sim->running, memory_order_relaxed)) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		unsigned ticks = fixed_step_advance(&sim->step,
+			(start - last_start) / frequency);
+		last_start = start;
+
+		if (ticks) {
+			// The last tick ended as long ago as the time left in
+			// the accumulator
+			Uint64 end = start - sim->step.accumulator * frequency;
+			if (sim_batch(sim, ticks, end) < 0) {
+				sim->error = g_error_message;
+				atomic_store_explicit(&sim->failed, true,
+					memory_order_release);
+				return -1;
+			}
+			atomic_store_explicit(&sim->batch_us,
+				(SDL_GetPerformanceCounter() - start) /
+				(frequency / 1e6), memory_order_relaxed);
+		}
+
+		double wait_ms = (sim->step.dt - sim->step.accumulator) * 1000.0 -
+			(SDL_GetPerformanceCounter() - start) / (frequency / 1000.0);
+		if (wait_ms > 0.0)
+			SDL_Delay(ceil(wait_ms));
+	}
+	return 0;
+}
+
+/**
+ * Simulates some ticks and publishes the world as they leave it
+ * @param sim The simulation
+ * @param ticks How many ticks to simulate
+ * @param end The performance counter value the last tick ends at
+ * @return 0 on success and a negative value on error
+ */
+static int sim_batch(Sim sim, unsigned ticks, uint64_t end)
+{
+	TRACE_ZONE("sim_batch");
+
+	struct EntityPool *pool = &sim->world->entities;
+	size_t player = entity_index(pool, sim->player);
+	if (player != SIZE_MAX && ticks) {
+		int walk = atomic_load_explicit(&sim->walk,
+			memory_order_relaxed);
+		if (walk)
+			pool->looking_dir[player] = walk < 0
+				? LOOKING_LEFT : LOOKING_RIGHT;
+		pool->desired_velocity_x[player] = walk * 5.0;
+		if (atomic_load_explicit(&sim->jump, memory_order_relaxed))
+			pool->velocity_y[player] = 5.0;
+	}
+
+	// Nothing moves until the ground around the player has been generated
+	bool frozen = false;
+	if (sim->stream && player != SIZE_MAX) {
+		if (stream_update(sim->stream, sim->world, pool->x[player],
+			pool->y[player], pool->velocity_x[player],
+			pool->velocity_y[player]) < 0)
+			return -1;
+		frozen = !stream_ready(sim->world, pool->x[player],
+			pool->y[player]);
+	}
+
+	for (unsigned i = 0; i < ticks; ++i) {
+		if (!frozen && world_update_physics(sim->world,
+			sim->step.dt) < 0)
+			return -1;
+		++sim->tick;
+	}
+	if (world_compact_step(sim->world, COMPACT_CHUNKS_PER_BATCH) < 0)
+		return -1;
+
+	// Saves are snapshotted between ticks and written out in the
+	// background, and one that can't begin yet is tried again next batch
+	if (sim->saver) {
+		if (saver_poll(sim->saver) < 0)
+			return -1;
+		if (sim->save_interval && sim->tick >= sim->next_save) {
+			int began = saver_begin(sim->saver, sim->world);
+			if (began < 0)
+				return -1;
+			if (began)
+				sim->next_save = sim->tick + sim->save_interval;
+		}
+	}
+
+	struct Snapshot *snapshot = snapshot_begin(&sim->snapshots);
+	if (snapshot_capture(snapshot, sim->world, sim->player) < 0)
+		return -1;
+	snapshot->tick = sim->tick;
+	snapshot->time = end;
+	if (sim->stream)
+		snapshot->stream_stats = sim->stream->stats;
+	snapshot_publish(&sim->snapshots);
+	return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <SDL2/SDL.h>
+#include "world.h"
+#include "entity.h"
+#include "event.h"
+#include "physics.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "saver.h"
+
+// Runs the simulation on its own thread, which owns the world and player
+// The main thread only ever sees the simulation through the snapshots it
+// publishes after every batch of ticks, and only changes it through the
+// player's input.
+struct Sim {
+	// Only touched by the main thread before sim_start and after sim_stop
+	// stops the thread
+	World world;
+	EntityHandle player;
+	// Streams terrain in around the player, or NULL if the world is
+	// filled some other way
+	ChunkStream stream;
+	// Saves the world every save_interval ticks, or NULL if it isn't saved
+	Saver saver;
+	uint64_t save_interval;
+	uint64_t next_save;
+	struct FixedStep step;
+	uint64_t tick;
+
+	struct SnapshotBuffer snapshots;
+	SDL_Thread *thread;
+	atomic_bool running;
+	// Set if the thread stopped because of an error, with error set to
+	// the thread's g_error_message
+	atomic_bool failed;
+	char *error;
+	// The latest struct PlayerInput from the main thread
+	atomic_int walk;
+	atomic_bool jump;
+	// How long the last batch of ticks took, in microseconds
+	atomic_uint batch_us;
+};
+
+typedef struct Sim *Sim;
+
+Sim sim_new(unsigned tick_rate, unsigned max_ticks);
+int sim_start(Sim);
+void sim_stop(Sim);
+void sim_free(Sim);
+void sim_set_input(Sim, const struct PlayerInput *);
+struct Snapshot *sim_snapshot(Sim);
+bool sim_failed(Sim);
+double sim_batch_ms(Sim);
+
+#endif // SIM_H
@@ -0,0 +1,53 @@
+#include "simd.h"
+
+/**
+ * Checks whether kernels of a level can run on this CPU
+ * @param level The level
+ * @return Whether they can
+ */
+bool simd_supported(enum SimdLevel level)
+{
+	switch (level) {
+	case SIMD_SCALAR:
+		return true;
+#ifdef SIMD_X86
+	case SIMD_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case SIMD_AVX:
+		return __builtin_cpu_supports("avx");
+#endif
+	default:
+		return false;
+	}
+}
+
+/**
+ * Finds the widest level that can run on this CPU
+ * @return The level
+ */
+enum SimdLevel simd_best(void)
+{
+	for (int level = NUM_SIMD_LEVELS - 1; level > 0; --level)
+		if (simd_supported(level))
+			return level;
+	return SIMD_SCALAR;
+}
+
+/**
+ * Gets a level's name, for benchmarks and debugging
+ * @param level The level
+ * @return The name
+ */
+const char *simd_name(enum SimdLevel level)
+{
+	switch (level) {
+	case SIMD_SCALAR:
+		return "scalar";
+	case SIMD_SSE2:
+		return "sse2";
+	case SIMD_AVX:
+		return "avx";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,31 @@
+/* Which vector instructions the CPU has. Code with SIMD kernels compiles every
+ * kernel the compiler can target, picks one with simd_best at run time, and
+ * keeps a scalar kernel that the others must match.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdbool.h>
+
+// SSE2 comes with every x86-64 CPU, and AVX is checked for when it's used, so
+// kernels for both are compiled wherever SSE2 is
+#if defined(__SSE2__)
+#define SIMD_X86
+// Marks a function that uses AVX, which must only be called once
+// simd_supported says the CPU has it
+#define SIMD_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+enum SimdLevel {
+	SIMD_SCALAR,
+	SIMD_SSE2,
+	SIMD_AVX,
+	NUM_SIMD_LEVELS,
+};
+
+bool simd_supported(enum SimdLevel);
+enum SimdLevel simd_best(void);
+const char *simd_name(enum SimdLevel);
+
+#endif // SIMD_H
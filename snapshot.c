@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "snapshot.h"
+#include "globals.h"
+#include "trace.h"
+
+static void snapshot_free_changes(struct Snapshot *snapshot);
+static int snapshot_reserve_entities(struct Snapshot *snapshot, size_t n);
+static int snapshot_push_change(struct Snapshot *snapshot, size_t search,
+	struct ChunkKey key, Chunk chunk);
+
+/**
+ * Initializes a snapshot buffer, in which the reader starts with an empty
+ * snapshot
+ * @param buffer The buffer
+ */
+void snapshot_buffer_init(struct SnapshotBuffer *buffer)
+{
+	memset(buffer->slots, 0, sizeof(buffer->slots));
+	for (int i = 0; i < 3; ++i)
+		buffer->slots[i].player = SIZE_MAX;
+	buffer->front = 0;
+	buffer->back = 2;
+	atomic_init(&buffer->middle, 1);
+}
+
+/**
+ * Frees the snapshots in a buffer, once neither thread uses it anymore
+ * @param buffer The buffer
+ */
+void snapshot_buffer_free(struct SnapshotBuffer *buffer)
+{
+	for (int i = 0; i < 3; ++i) {
+		snapshot_free_changes(&buffer->slots[i]);
+		free(buffer->slots[i].entities);
+		free(buffer->slots[i].changes);
+	}
+	memset(buffer->slots, 0, sizeof(buffer->slots));
+}
+
+/**
+ * Frees the chunk copies in a snapshot and empties its change list
+ * @param snapshot The snapshot
+ */
+static void snapshot_free_changes(struct Snapshot *snapshot)
+{
+	for (size_t i = 0; i < snapshot->num_changes; ++i)
+		chunk_free(snapshot->changes[i].chunk);
+	snapshot->num_changes = 0;
+}
+
+/**
+ * Gets a snapshot for the writer to fill, which only becomes visible to the
+ * reader once snapshot_publish is called
+ * If the reader never took the last published snapshot, that one is taken back
+ * with its chunk changes, so that none are lost when this one replaces it.
+ * Until this one is published, the reader keeps the snapshot it already has.
+ * @param buffer The buffer
+ * @return The snapshot, with no entities
+ */
+struct Snapshot *snapshot_begin(struct SnapshotBuffer *buffer)
+{
+	unsigned slot = atomic_exchange_explicit(&buffer->middle,
+		buffer->back, memory_order_acq_rel);
+	struct Snapshot *snapshot = &buffer->slots[slot & ~SNAPSHOT_FRESH];
+
+	if (!(slot & SNAPSHOT_FRESH))
+		snapshot_free_changes(snapshot);
+	snapshot->num_entities = 0;
+	snapshot->player = SIZE_MAX;
+	buffer->back = slot & ~SNAPSHOT_FRESH;
+	return snapshot;
+}
+
+/**
+ * Records every entity in a world and copies every chunk in its change list
+ * into a snapshot, then empties the change list
+ * @param snapshot The snapshot from snapshot_begin
+ * @param world The world, which must be tracking changes
+ * @param player The player, or ENTITY_NONE
+ * @return 0 on success and a negative value on error
+ */
+int snapshot_capture(struct Snapshot *snapshot, World world,
+	EntityHandle player)
+{
+	TRACE_ZONE("snapshot_capture");
+
+	const struct EntityPool *pool = &world->entities;
+	if (snapshot_reserve_entities(snapshot, pool->len) < 0)
+		return -1;
+	for (size_t i = 0; i < pool->len; ++i)
+		snapshot->entities[i] = (struct EntityTransform) {
+			.type = pool->type[i],
+			.looking_dir = pool->looking_dir[i],
+			.x = pool->x[i],
+			.y = pool->y[i],
+			.prev_x = pool->prev_x[i],
+			.prev_y = pool->prev_y[i],
+			.hitbox_width = pool->hitbox_width[i],
+			.hitbox_height = pool->hitbox_height[i],
+		};
+	snapshot->num_entities = pool->len;
+	snapshot->player = entity_index(pool, player);
+
+	// Changes carried over from a snapshot the reader never took may be
+	// for the same chunks as the new ones
+	const size_t carried = snapshot->num_changes;
+	for (size_t i = 0; i < world->num_changes; ++i) {
+		struct ChunkKey key = world->changes[i];
+		Chunk chunk = world_get_chunk(world, key.cx, key.cy);
+		if (snapshot_push_change(snapshot, carried, key, chunk) < 0)
+			return -1;
+	}
+	world_clear_changes(world);
+	return 0;
+}
+
+/**
+ * Makes sure a snapshot has room for a number of entities
+ * @param snapshot The snapshot
+ * @param n How many entities it needs room for
+ * @return 0 on success and a negative value on error
+ */
+static int snapshot_reserve_entities(struct Snapshot *snapshot, size_t n)
+{
+	if (n <= snapshot->entities_capacity)
+		return 0;
+
+	size_t capacity = snapshot->entities_capacity
+		? snapshot->entities_capacity : 16;
+	while (capacity < n)
+		capacity *= 2;
+	struct EntityTransform *entities = realloc(snapshot->entities,
+		capacity * sizeof(*entities));
+	if (!entities) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+	snapshot->entities = entities;
+	snapshot->entities_capacity = capacity;
+	return 0;
+}
+
+/**
+ * Adds a copy of a chunk to a snapshot's change list, replacing an older copy
+ * of it if there is one
+ * @param snapshot The snapshot
+ * @param search How many changes at the start of the list to look through for
+ * 	an older copy
+ * @param key The chunk's coordinates
+ * @param chunk The chunk, or NULL if it was removed
+ * @return 0 on success and a negative value on error
+ */
+static int snapshot_push_change(struct Snapshot *snapshot, size_t search,
+	struct ChunkKey key, Chunk chunk)
+{
+	Chunk copy = NULL;
+	if (chunk && !(copy = chunk_copy(chunk)))
+		return -1;
+
+	for (size_t i = 0; i < search; ++i) {
+		struct ChunkChange *change = &snapshot->changes[i];
+		if (change->key.cx == key.cx && change->key.cy == key.cy) {
+			chunk_free(change->chunk);
+			change->chunk = copy;
+			return 0;
+		}
+	}
+
+	if (snapshot->num_changes == snapshot->changes_capacity) {
+		size_t capacity = snapshot->changes_capacity
+			? snapshot->changes_capacity * 2 : 64;
+		struct ChunkChange *changes = realloc(snapshot->changes,
+			capacity * sizeof(*changes));
+		if (!changes) {
+			chunk_free(copy);
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		snapshot->changes = changes;
+		snapshot->changes_capacity = capacity;
+	}
+	snapshot->changes[snapshot->num_changes++] =
+		(struct ChunkChange) {key, copy};
+	return 0;
+}
+
+/**
+ * Makes the snapshot from snapshot_begin the one the reader takes next
+ * @param buffer The buffer
+ */
+void snapshot_publish(struct SnapshotBuffer *buffer)
+{
+	// The reader never swaps out an unpublished slot, so this always gets
+	// back the one snapshot_begin left in the middle
+	buffer->back = atomic_exchange_explicit(&buffer->middle,
+		buffer->back | SNAPSHOT_FRESH, memory_order_acq_rel);
+}
+
+/**
+ * Gets the latest published snapshot for the reader, which stays the reader's
+ * until the next call
+ * @param buffer The buffer
+ * @return The snapshot, which is the one from the last call if none were
+ * 	published since
+ */
+struct Snapshot *snapshot_acquire(struct SnapshotBuffer *buffer)
+{
+	unsigned middle = atomic_load_explicit(&buffer->middle,
+		memory_order_relaxed);
+	// This fails if the writer takes the snapshot back in the meantime,
+	// in which case a newer one is on its way
+	if (middle & SNAPSHOT_FRESH &&
+		atomic_compare_exchange_strong_explicit(&buffer->middle,
+			&middle, buffer->front, memory_order_acq_rel,
+			memory_order_relaxed))
+		buffer->front = middle & ~SNAPSHOT_FRESH;
+	return &buffer->slots[buffer->front];
+}
+
+/**
+ * Brings a world kept by the reader up to date with a snapshot
+ * The chunk copies are moved into the mirror, so applying a snapshot again
+ * only updates the entities.
+ * @param snapshot The snapshot from snapshot_acquire
+ * @param mirror The world, which only the reader changes
+ * @return 0 on success and a negative value on error
+ */
+int snapshot_apply(struct Snapshot *snapshot, World mirror)
+{
+	TRACE_ZONE("snapshot_apply");
+
+	for (size_t i = 0; i < snapshot->num_changes; ++i) {
+		struct ChunkChange *change = &snapshot->changes[i];
+		Chunk old = world_get_chunk(mirror, change->key.cx,
+			change->key.cy);
+		if (change->chunk) {
+			if (world_put_chunk(mirror, change->chunk) < 0)
+				return -1;
+			change->chunk = NULL;
+		} else {
+			chunkmap_remove(mirror->chunkmap, change->key);
+		}
+		chunk_free(old);
+	}
+	snapshot->num_changes = 0;
+
+	// The mirror's entities are replaced outright, which also drops any
+	// that were despawned
+	struct EntityPool *pool = &mirror->entities;
+	entity_pool_clear(pool);
+	for (size_t i = 0; i < snapshot->num_entities; ++i) {
+		const struct EntityTransform *transform =
+			&snapshot->entities[i];
+		if (entity_spawn(pool, transform->type, transform->x,
+			transform->y, transform->hitbox_width,
+			transform->hitbox_height, 0.0) == ENTITY_NONE)
+			return -1;
+		pool->prev_x[i] = transform->prev_x;
+		pool->prev_y[i] = transform->prev_y;
+		pool->looking_dir[i] = transform->looking_dir;
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "entity.h"
+#include "world.h"
+#include "stream.h"
+
+// Where an entity was at the end of a tick, and what else is needed to draw it
+struct EntityTransform {
+	enum EntityType type;
+	enum LookingDirection looking_dir;
+	double x, y;
+	double prev_x, prev_y;
+	double hitbox_width, hitbox_height;
+};
+
+// A chunk that was put into or changed in the simulated world
+struct ChunkChange {
+	struct ChunkKey key;
+	// A copy of the chunk owned by the snapshot, or NULL if it was removed
+	Chunk chunk;
+};
+
+// The state of the simulation after a tick, which the writer doesn't change
+// once it's published
+struct Snapshot {
+	uint64_t tick;
+	// The performance counter value the tick ended at
+	uint64_t time;
+	// The index of the player in entities, or SIZE_MAX if there isn't one
+	size_t player;
+	// Every entity in the world
+	struct EntityTransform *entities;
+	size_t num_entities, entities_capacity;
+	// Every chunk changed since the last snapshot the reader took, in the
+	// order they were changed
+	struct ChunkChange *changes;
+	size_t num_changes, changes_capacity;
+	// The counters of the stream filling the world, if there is one
+	struct StreamStats stream_stats;
+};
+
+// Passes snapshots from one writer thread to one reader thread without either
+// ever waiting for the other
+// There are three snapshots: one the writer fills, one the reader draws from,
+// and the last one published, which each side swaps its own for.
+struct SnapshotBuffer {
+	struct Snapshot slots[3];
+	// The slots the writer and reader have, only touched by their owner
+	unsigned back, front;
+	// The published slot, or'd with SNAPSHOT_FRESH until the reader takes it
+	atomic_uint middle;
+};
+
+#define SNAPSHOT_FRESH 4u
+
+void snapshot_buffer_init(struct SnapshotBuffer *);
+void snapshot_buffer_free(struct SnapshotBuffer *);
+struct Snapshot *snapshot_begin(struct SnapshotBuffer *);
+int snapshot_capture(struct Snapshot *, World, EntityHandle player);
+void snapshot_publish(struct SnapshotBuffer *);
+struct Snapshot *snapshot_acquire(struct SnapshotBuffer *);
+int snapshot_apply(struct Snapshot *, World mirror);
+
+#endif // SNAPSHOT_H
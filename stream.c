@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "stream.h"
+#include "terrain.h"
+#include "globals.h"
+#include "trace.h"
+
+// How much chunks in the direction the player is moving are preferred, as a
+// fraction of a chunk of distance. Under 1, so that the player's own chunk
+// still comes first.
+#define STREAM_AHEAD_BIAS 0.75
+
+// A missing chunk, and how soon it should be generated
+struct StreamCandidate {
+	int64_t cx, cy;
+	double score;
+};
+
+// Only the keys matter, which take up far less than the chunks did
+TYPED_MAP_DECLARE(static inline, EvictedSet, evictedset, struct ChunkKey,
+	bool)
+TYPED_MAP_DEFINE(static inline, EvictedSet, evictedset, struct ChunkKey,
+	bool, chunk_key_hash)
+
+static void stream_generate(void *data);
+static int stream_collect(ChunkStream stream, World world);
+static bool stream_pending(ChunkStream stream, int64_t cx, int64_t cy);
+static int stream_compare(const void *a, const void *b);
+static int stream_compare_used(const void *a, const void *b);
+
+/**
+ * Checks whether a chunk row is wholly above the terrain, where every tile is
+ * air and a missing chunk already reads as such, so it's never streamed in
+ * @param cy The chunk row
+ * @return Whether it is
+ */
+static bool stream_above_terrain(int64_t cy)
+{
+	return cy * CHUNK_LENGTH > TERRAIN_MAX_HEIGHT;
+}
+
+/**
+ * Creates a chunk stream
+ * @param jobs The job system to generate chunks on
+ * @param seed The world's seed
+ * @param radius How many chunks away from the player's chunk, along either
+ * 	axis, to stream in, which must be at least 1
+ * @return The stream, or NULL if an error occurred
+ */
+ChunkStream stream_new(JobSystem jobs, uint64_t seed, int radius)
+{
+	if (!jobs || radius < 1)
+		return NULL;
+
+	ChunkStream stream = calloc(1, sizeof(*stream));
+	const size_t side = 2 * (size_t) radius + 1;
+	if (!stream || !(stream->candidates = malloc(side * side *
+		sizeof(*stream->candidates))) ||
+		!(stream->evicted = evictedset_new(64))) {
+		if (stream)
+			free(stream->candidates);
+		free(stream);
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+
+	stream->jobs = jobs;
+	stream->seed = seed;
+	stream->level = simd_best();
+	stream->radius = radius;
+	stream->max_in_flight = STREAM_MAX_IN_FLIGHT;
+	stream->budget = SIZE_MAX;
+	job_counter_init(&stream->pending);
+	for (int i = 0; i < STREAM_MAX_IN_FLIGHT; ++i) {
+		stream->requests[i].stream = stream;
+		atomic_init(&stream->requests[i].done, false);
+	}
+	return stream;
+}
+
+/**
+ * Waits for a stream's chunks to be generated, then frees it with any that
+ * never made it into the world
+ * @param stream The stream
+ */
+void stream_free(ChunkStream stream)
+{
+	if (!stream)
+		return;
+
+	stream_wait(stream);
+	for (int i = 0; i < STREAM_MAX_IN_FLIGHT; ++i)
+		chunk_free(stream->requests[i].chunk);
+	free(stream->candidates);
+	free(stream->victims);
+	evictedset_free(stream->evicted);
+	entity_query_free(&stream->query);
+	free(stream);
+}
+
+/**
+ * Waits until every chunk a stream asked for has been generated, which
+ * stream_update then puts into the world
+ * @param stream The stream
+ */
+void stream_wait(ChunkStream stream)
+{
+	job_wait(stream->jobs, &stream->pending);
+}
+
+/**
+ * Puts the chunks generated since the last call into the world, then asks for
+ * the ones still missing around the player
+ * @param stream The stream
+ * @param world The world, which only this thread changes
+ * @param x The player's x-coordinate
+ * @param y The player's y-coordinate
+ * @param velocity_x The player's horizontal velocity
+ * @param velocity_y The player's vertical velocity
+ * @return 0 on success and a negative value on error
+ */
+int stream_update(ChunkStream stream, World world, double x, double y,
+	double velocity_x, double velocity_y)
+{
+	TRACE_ZONE("stream_update");
+	if (stream_collect(stream, world) < 0)
+		return -1;
+
+	const int64_t cx = (int64_t) floor(x) >> CHUNK_SHIFT;
+	const int64_t cy = (int64_t) floor(y) >> CHUNK_SHIFT;
+	if (cx != stream->cx || cy != stream->cy) {
+		stream->cx = cx;
+		stream->cy = cy;
+		stream->settled = false;
+		stream->evict_due = true;
+	}
+	if (stream->evict_due && stream_evict(stream, world) < 0)
+		return -1;
+	if (stream->settled)
+		return 0;
+
+	const double speed = hypot(velocity_x, velocity_y);
+	const double ahead_x = speed > 0.0 ? velocity_x / speed : 0.0;
+	const double ahead_y = speed > 0.0 ? velocity_y / speed : 0.0;
+	const int r = stream->radius;
+	size_t n = 0;
+	for (int dy = -r; dy <= r; ++dy) {
+		if (!stream->load && stream_above_terrain(cy + dy))
+			continue;
+		for (int dx = -r; dx <= r; ++dx) {
+			if (world_get_chunk(world, cx + dx, cy + dy) ||
+				stream_pending(stream, cx + dx, cy + dy))
+				continue;
+			stream->candidates[n++] = (struct StreamCandidate) {
+				cx + dx, cy + dy,
+				dx * dx + dy * dy - STREAM_AHEAD_BIAS *
+					(dx * ahead_x + dy * ahead_y),
+			};
+		}
+	}
+	qsort(stream->candidates, n, sizeof(*stream->candidates),
+		stream_compare);
+
+	struct Job jobs[STREAM_MAX_IN_FLIGHT];
+	size_t submitted = 0;
+	for (unsigned i = 0; i < stream->max_in_flight &&
+		i < STREAM_MAX_IN_FLIGHT && submitted < n; ++i) {
+		struct StreamRequest *request = &stream->requests[i];
+		if (request->used)
+			continue;
+		request->used = true;
+		request->cx = stream->candidates[submitted].cx;
+		request->cy = stream->candidates[submitted].cy;
+		jobs[submitted++] = (struct Job) {stream_generate, request};
+	}
+	if (job_submit(stream->jobs, jobs, submitted, &stream->pending) < 0) {
+		for (size_t i = 0; i < submitted; ++i)
+			((struct StreamRequest *) jobs[i].data)->used = false;
+		return -1;
+	}
+	stream->stats.requested += submitted;
+	// Whatever didn't fit is looked for again next time
+	stream->settled = submitted == n;
+
+	// With no worker threads, jobs only run in job_wait, so this thread
+	// generates what it just asked for itself
+	if (submitted && job_system_threads(stream->jobs) < 2) {
+		stream_wait(stream);
+		return stream_collect(stream, world);
+	}
+	return 0;
+}
+
+/**
+ * Checks whether the chunks around the player are all in the world, so that
+ * there's ground under it to collide with
+ * @param world The world
+ * @param x The player's x-coordinate
+ * @param y The player's y-coordinate
+ * @return Whether they are
+ */
+bool stream_ready(World world, double x, double y)
+{
+	const int64_t cx = (int64_t) floor(x) >> CHUNK_SHIFT;
+	const int64_t cy = (int64_t) floor(y) >> CHUNK_SHIFT;
+	for (int64_t dy = -1; dy <= 1; ++dy) {
+		if (stream_above_terrain(cy + dy))
+			continue;
+		for (int64_t dx = -1; dx <= 1; ++dx)
+			if (!world_get_chunk(world, cx + dx, cy + dy))
+				return false;
+	}
+	return true;
+}
+
+/**
+ * Loads or generates the chunk of a request, on any thread
+ * @param data The struct StreamRequest
+ */
+static void stream_generate(void *data)
+{
+	struct StreamRequest *request = data;
+	ChunkStream stream = request->stream;
+	request->chunk = NULL;
+	request->error = NULL;
+	if (!stream->load || (stream->load(stream->load_data, request->cx,
+		request->cy, &request->chunk) >= 0 && !request->chunk))
+		request->chunk = terrain_generate_chunk(stream->seed,
+			request->cx, request->cy, stream->level);
+	if (!request->chunk)
+		request->error = g_error_message;
+	atomic_store_explicit(&request->done, true, memory_order_release);
+}
+
+/**
+ * Puts every chunk that has been generated into the world and frees up its
+ * request
+ * A chunk that got into the world some other way while it was being generated,
+ * such as by a block being set in it, is kept instead.
+ * @param stream The stream
+ * @param world The world
+ * @return 0 on success and a negative value on error
+ */
+static int stream_collect(ChunkStream stream, World world)
+{
+	int ret = 0;
+	for (int i = 0; i < STREAM_MAX_IN_FLIGHT; ++i) {
+		struct StreamRequest *request = &stream->requests[i];
+		if (!request->used || !atomic_load_explicit(&request->done,
+			memory_order_acquire))
+			continue;
+
+		Chunk chunk = request->chunk;
+		request->chunk = NULL;
+		request->used = false;
+		atomic_store_explicit(&request->done, false,
+			memory_order_relaxed);
+		// The load function or terrain_generate_chunk failed, and
+		// the job passed on why
+		if (!chunk) {
+			g_error_message = request->error;
+			ret = -1;
+			continue;
+		}
+		if (world_get_chunk(world, chunk->cx, chunk->cy)) {
+			chunk_free(chunk);
+			continue;
+		}
+
+		if (world_put_chunk(world, chunk) < 0)
+			ret = -1;
+		// The chunk may have gone in before the error
+		if (world_get_chunk(world, chunk->cx, chunk->cy) != chunk) {
+			chunk_free(chunk);
+			continue;
+		}
+		++stream->stats.loaded;
+		stream->evict_due = true;
+
+		struct ChunkKey key = {chunk->cx, chunk->cy};
+		if (evictedset_get(stream->evicted, key)) {
+			evictedset_remove(stream->evicted, key);
+			++stream->stats.reloaded;
+		}
+	}
+	return ret;
+}
+
+/**
+ * Unloads the chunks outside the stream's square that were looked up least
+ * recently, until the world's chunks fit in the budget
+ * Modified chunks are handed to the save function first, and kept if it can't
+ * save them yet. The chunks unloaded are remembered to count reloads until
+ * there are more than STREAM_EVICTED_MIN of them and they outgrow their share
+ * of the budget. Chunks with entities in them or standing on them are kept,
+ * so that those don't fall through the world. Shared chunks are kept until the
+ * save reading them is done.
+ * @param stream The stream
+ * @param world The world
+ * @return 0 on success and a negative value on error
+ */
+int stream_evict(ChunkStream stream, World world)
+{
+	TRACE_ZONE("stream_evict");
+	stream->evict_due = false;
+
+	size_t bytes = 0, n = 0;
+	struct ChunkMapIterator it;
+	chunkmap_iterator_init(&it, world->chunkmap);
+	struct ChunkMapEntry *entry;
+	while ((entry = chunkmap_iterate(&it))) {
+		Chunk chunk = entry->value;
+		bytes += chunk_memory(chunk);
+		if (llabs(chunk->cx - stream->cx) <= stream->radius &&
+			llabs(chunk->cy - stream->cy) <= stream->radius)
+			continue;
+
+		if (n == stream->victims_capacity) {
+			size_t capacity = stream->victims_capacity
+				? stream->victims_capacity * 2 : 64;
+			Chunk *victims = realloc(stream->victims,
+				capacity * sizeof(*victims));
+			if (!victims) {
+				g_error_message = "malloc failed";
+				return -1;
+			}
+			stream->victims = victims;
+			stream->victims_capacity = capacity;
+		}
+		stream->victims[n++] = chunk;
+	}
+
+	if (bytes > stream->budget && n)
+		qsort(stream->victims, n, sizeof(*stream->victims),
+			stream_compare_used);
+	for (size_t i = 0; i < n && bytes > stream->budget; ++i) {
+		Chunk chunk = stream->victims[i];
+		if (((chunk->flags & CHUNK_MODIFIED) && !stream->save) ||
+			chunk->flags & CHUNK_SHARED)
+			continue;
+		// The chunk above holds anything standing on the top row
+		const double x = chunk->cx * CHUNK_LENGTH;
+		const double y = chunk->cy * CHUNK_LENGTH;
+		if (entity_query_rect(&world->entities, x, y, x + CHUNK_LENGTH,
+			y + CHUNK_LENGTH + 1, &stream->query) < 0)
+			return -1;
+		if (stream->query.len)
+			continue;
+
+		if (chunk->flags & CHUNK_MODIFIED) {
+			int saved = stream->save(stream->save_data, chunk);
+			if (saved < 0)
+				return -1;
+			if (!saved)
+				continue;
+			chunk->flags &= ~CHUNK_MODIFIED;
+			++stream->stats.saved;
+		}
+		if (evictedset_put(stream->evicted,
+			(struct ChunkKey) {chunk->cx, chunk->cy}, true) < 0 ||
+			world_remove_chunk(world, chunk) < 0)
+			return -1;
+		bytes -= chunk_memory(chunk);
+		chunk_free(chunk);
+		++stream->stats.evicted;
+	}
+
+	size_t limit = stream->budget / STREAM_EVICTED_SHARE /
+		sizeof(struct EvictedSetEntry);
+	if (limit < STREAM_EVICTED_MIN)
+		limit = STREAM_EVICTED_MIN;
+	if (evictedset_size(stream->evicted) > limit) {
+		EvictedSet evicted = evictedset_new(64);
+		if (!evicted)
+			return -1;
+		evictedset_free(stream->evicted);
+		stream->evicted = evicted;
+	}
+
+	stream->stats.resident_chunks = chunkmap_size(world->chunkmap);
+	stream->stats.resident_bytes = bytes;
+	stream->stats.evicted_keys = evictedset_size(stream->evicted);
+	return 0;
+}
+
+/**
+ * Checks whether a chunk is being generated
+ * @param stream The stream
+ * @param cx The chunk column
+ * @param cy The chunk row
+ * @return Whether it is
+ */
+static bool stream_pending(ChunkStream stream, int64_t cx, int64_t cy)
+{
+	for (int i = 0; i < STREAM_MAX_IN_FLIGHT; ++i) {
+		const struct StreamRequest *request = &stream->requests[i];
+		if (request->used && request->cx == cx && request->cy == cy)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Orders candidates so that the ones to generate first come first
+ * @param a One struct StreamCandidate
+ * @param b Another
+ * @return Less than, equal to or greater than 0 if a comes before, with or
+ * 	after b
+ */
+static int stream_compare(const void *a, const void *b)
+{
+	const struct StreamCandidate *ca = a, *cb = b;
+	return (ca->score > cb->score) - (ca->score < cb->score);
+}
+
+/**
+ * Orders chunks from the least to the most recently used
+ * @param a One Chunk
+ * @param b Another
+ * @return Less than, equal to or greater than 0 if a comes before, with or
+ * 	after b
+ */
+static int stream_compare_used(const void *a, const void *b)
+{
+	const Chunk ca = *(const Chunk *) a, cb = *(const Chunk *) b;
+	return (ca->last_used > cb->last_used) -
+		(ca->last_used < cb->last_used);
+}
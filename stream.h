@@ -0,0 +1,133 @@
+/* Streams terrain in around the player. Every batch of ticks, the simulation
+ * thread asks for the chunks missing from a square of chunks around the
+ * player, nearest first and those it's heading towards before those behind
+ * it. Jobs generate them in the background and the simulation thread puts
+ * them into its world once they're done, so neither thread ever waits on
+ * generation.
+ *
+ * Once the world's chunks take up more memory than the stream's budget, the
+ * ones outside the square that were looked up least recently are unloaded
+ * again, and generated anew if the player comes back. Given functions to save
+ * and load them, modified chunks are saved before they're unloaded and loaded
+ * instead of generated.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "world.h"
+#include "entity.h"
+#include "job.h"
+#include "simd.h"
+
+// The most chunks that are generated at once
+#define STREAM_MAX_IN_FLIGHT 32
+// The unloaded chunks remembered for counting reloads are forgotten once they
+// would take up more than 1/STREAM_EVICTED_SHARE of the budget, or this many
+// if that's more, so that roaming doesn't grow them without bound
+#define STREAM_EVICTED_SHARE 8
+#define STREAM_EVICTED_MIN 1024
+
+// A chunk being generated
+struct StreamRequest {
+	struct ChunkStream *stream;
+	int64_t cx, cy;
+	// Set by the job, which sets done once it has
+	Chunk chunk;
+	// Why the job failed if chunk is NULL, since the job's thread has its
+	// own g_error_message
+	char *error;
+	atomic_bool done;
+	// Whether the slot holds a request
+	bool used;
+};
+
+// Saves a modified chunk before the stream unloads it, returning 1 if it was
+// saved and 0 if it can't be yet, which keeps the chunk loaded for now
+typedef int (*StreamSaveFunction)(void *data, Chunk chunk);
+// Loads a chunk saved before, on any thread, setting *chunk to NULL if it
+// wasn't
+typedef int (*StreamLoadFunction)(void *data, int64_t cx, int64_t cy,
+	Chunk *chunk);
+
+// Counters for profiling. The resident ones are as of the last eviction pass,
+// and the rest are only ever incremented.
+struct StreamStats {
+	// Chunks queued for generation
+	uint64_t requested;
+	// Chunks put into the world
+	uint64_t loaded;
+	// Chunks put into the world again after being unloaded, as long as
+	// they were unloaded since the stream last forgot which were
+	uint64_t reloaded;
+	// Chunks unloaded to stay within the budget
+	uint64_t evicted;
+	// Modified chunks handed to the save function before being unloaded
+	uint64_t saved;
+	// The chunks in the world and the memory their tiles take up
+	size_t resident_chunks;
+	size_t resident_bytes;
+	// The unloaded chunks remembered for counting reloads
+	size_t evicted_keys;
+};
+
+struct ChunkStream {
+	JobSystem jobs;
+	uint64_t seed;
+	enum SimdLevel level;
+	// Chunks at most this many chunks away from the player's, along
+	// either axis, are streamed in
+	int radius;
+	// How many chunks are generated at once, at most STREAM_MAX_IN_FLIGHT
+	unsigned max_in_flight;
+	// How many bytes of chunks the world may hold before chunks outside
+	// the square are unloaded, SIZE_MAX by default
+	size_t budget;
+	// Called with save_data on modified chunks before they're unloaded.
+	// Without one, modified chunks are never unloaded.
+	StreamSaveFunction save;
+	void *save_data;
+	// Called with load_data before a chunk is generated, which it needn't
+	// be if it was saved. With one, chunks above the terrain are streamed
+	// in too, in case something was built there.
+	StreamLoadFunction load;
+	void *load_data;
+	struct StreamStats stats;
+
+	// Counts the requests that are still being generated
+	struct JobCounter pending;
+	struct StreamRequest requests[STREAM_MAX_IN_FLIGHT];
+	// The chunks found missing by the last look around the player, so
+	// that looking doesn't allocate
+	struct StreamCandidate *candidates;
+	// The player's chunk at the last look, which needn't look again
+	// until the player moves to another chunk if nothing was missing
+	int64_t cx, cy;
+	bool settled;
+	// Whether the world may have outgrown the budget since the last
+	// eviction pass
+	bool evict_due;
+	// The chunks the last eviction pass could unload, kept between passes
+	Chunk *victims;
+	size_t victims_capacity;
+	// The chunks that were unloaded and haven't been loaded again, which
+	// is emptied whenever it outgrows its share of the budget
+	struct EvictedSet *evicted;
+	// Finds entities standing in chunks about to be unloaded
+	struct EntityQuery query;
+};
+
+typedef struct ChunkStream *ChunkStream;
+
+ChunkStream stream_new(JobSystem, uint64_t seed, int radius);
+void stream_free(ChunkStream);
+int stream_update(ChunkStream, World, double x, double y, double velocity_x,
+	double velocity_y);
+bool stream_ready(World, double x, double y);
+void stream_wait(ChunkStream);
+int stream_evict(ChunkStream, World);
+
+#endif // STREAM_H
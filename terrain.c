@@ -0,0 +1,661 @@
+#include <stdlib.h>
+#include <math.h>
+#include "terrain.h"
+#include "globals.h"
+#include "trace.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// One layer of noise, whose lattice points are 1 << shift tiles apart. Every
+// shift is at least CHUNK_SHIFT, so a chunk always lies within one lattice
+// cell and only needs the gradients at its corners.
+struct Octave {
+	unsigned shift;
+	float amplitude;
+	// Makes every layer's gradients different for the same seed
+	uint64_t salt;
+};
+
+// The surface is this much noise around y=0
+static const struct Octave height_octaves[] = {
+	{8, 40.0f, 0x68E31DA4ull},
+	{6, 14.0f, 0xB5297A4Dull},
+	{4, 4.0f, 0x1B56C4E9ull},
+};
+// The crust of dirt under the surface is TERRAIN_CRUST tiles deep, give or
+// take half this noise
+static const struct Octave crust_octaves[] = {
+	{5, 8.0f, 0x7FEB352Dull},
+};
+#define TERRAIN_CRUST 6
+static const struct Octave bedrock_octaves[] = {
+	{4, 1.0f, 0x846CA68Bull},
+};
+// Caves are wherever this noise is above TERRAIN_CAVE_THRESHOLD
+static const struct Octave cave_octaves[] = {
+	{6, 1.0f, 0x2C1B3C6Dull},
+	{4, 0.5f, 0x297A2D39ull},
+};
+#define TERRAIN_CAVE_THRESHOLD 0.22f
+
+#define NUM_OCTAVES(octaves) (sizeof(octaves) / sizeof(*(octaves)))
+
+// The directions 2D gradients point in
+static const float gradients[8][2] = {
+	{1.0f, 0.0f}, {-1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, -1.0f},
+	{0.70710678f, 0.70710678f}, {-0.70710678f, 0.70710678f},
+	{0.70710678f, -0.70710678f}, {-0.70710678f, -0.70710678f},
+};
+
+// A row of 1D noise across a chunk. Tile i is at u0 + i * du of the way
+// across the lattice cell, whose ends have slopes g0 and g1.
+struct Noise1D {
+	float g0, g1;
+	float u0, du;
+	float amplitude;
+};
+
+// 2D noise over a chunk. Tile (rx, ry) is at (u0 + rx * d, v0 + ry * d) in
+// the lattice cell, whose corners have the gradients g[0] at (0, 0), g[1] at
+// (1, 0), g[2] at (0, 1) and g[3] at (1, 1).
+struct Noise2D {
+	float g[4][2];
+	float u0, v0, d;
+	float amplitude;
+};
+
+// The heights of a chunk column's surface, dirt crust and bedrock, by rx
+struct TerrainColumns {
+	int64_t surface[CHUNK_LENGTH];
+	int64_t crust[CHUNK_LENGTH];
+	int64_t bedrock[CHUNK_LENGTH];
+};
+
+// What world_generate_terrain's jobs share
+struct TerrainJob {
+	uint64_t seed;
+	int64_t cx1, cy1;
+	// How many chunks wide the area is
+	int64_t width;
+	enum SimdLevel level;
+	Chunk *chunks;
+};
+
+static uint64_t terrain_hash(uint64_t seed, uint64_t salt, int64_t ix,
+	int64_t iy);
+static void noise_1d(enum SimdLevel level, float *out,
+	const struct Noise1D *noise);
+static void noise_2d(enum SimdLevel level, float *out,
+	const struct Noise2D *noise);
+static void octaves_1d(enum SimdLevel level, float *out, uint64_t seed,
+	int64_t cx, const struct Octave *octaves, size_t n);
+static void octaves_2d(enum SimdLevel level, float *out, uint64_t seed,
+	int64_t cx, int64_t cy, const struct Octave *octaves, size_t n);
+static void terrain_columns(enum SimdLevel level, uint64_t seed, int64_t cx,
+	struct TerrainColumns *columns);
+static void terrain_generate_range(void *data, size_t begin, size_t end);
+
+/**
+ * Hashes a lattice point of a layer of noise into a gradient's random bits
+ * @param seed The world's seed
+ * @param salt The layer's salt
+ * @param ix The lattice point's x
+ * @param iy The lattice point's y, or 0 for 1D noise
+ * @return The hash
+ */
+static uint64_t terrain_hash(uint64_t seed, uint64_t salt, int64_t ix,
+	int64_t iy)
+{
+	// splitmix64's finalizer after folding in each coordinate
+	uint64_t h = seed ^ salt * 0x9E3779B97F4A7C15ull;
+	for (int i = 0; i < 2; ++i) {
+		h ^= (uint64_t) (i ? iy : ix) + 0x9E3779B97F4A7C15ull;
+		h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+		h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+		h ^= h >> 31;
+	}
+	return h;
+}
+
+/**
+ * Generates a chunk
+ * @param seed The world's seed
+ * @param cx The chunk's x-coordinate
+ * @param cy The chunk's y-coordinate
+ * @param level The kernels to use, which must be supported. Every level makes
+ * 	the same chunk.
+ * @return The chunk, or NULL if an error occurred
+ */
+Chunk terrain_generate_chunk(uint64_t seed, int64_t cx, int64_t cy,
+	enum SimdLevel level)
+{
+	TRACE_ZONE("terrain_generate_chunk");
+	Chunk chunk = chunk_new(cx, cy);
+	if (!chunk)
+		return NULL;
+
+	// Chunks wholly above the surface or in the bedrock don't need any
+	// noise
+	const int64_t y1 = cy * CHUNK_LENGTH;
+	const int64_t y2 = y1 + CHUNK_LENGTH - 1;
+	if (y1 > TERRAIN_MAX_HEIGHT)
+		return chunk;
+	if (y2 <= TERRAIN_BEDROCK_Y) {
+		chunk_fill(chunk, TILE_UNBREAKABLE_ROCK);
+		return chunk;
+	}
+
+	struct TerrainColumns columns;
+	terrain_columns(level, seed, cx, &columns);
+
+	float caves[CHUNK_AREA];
+	bool has_caves = false;
+	for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+		has_caves |= y1 < columns.crust[rx] &&
+			y2 > columns.bedrock[rx];
+	if (has_caves)
+		octaves_2d(level, caves, seed, cx, cy, cave_octaves,
+			NUM_OCTAVES(cave_octaves));
+
+	uint16_t tiles[CHUNK_AREA];
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry) {
+		const int64_t y = y1 + ry;
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx) {
+			const int i = ry * CHUNK_LENGTH + rx;
+			if (y > columns.surface[rx])
+				tiles[i] = TILE_AIR;
+			else if (y <= columns.bedrock[rx])
+				tiles[i] = TILE_UNBREAKABLE_ROCK;
+			else if (y == columns.surface[rx])
+				tiles[i] = TILE_GRASS;
+			else if (y >= columns.crust[rx])
+				tiles[i] = TILE_DIRT;
+			else if (caves[i] > TERRAIN_CAVE_THRESHOLD)
+				tiles[i] = TILE_AIR;
+			else
+				tiles[i] = TILE_DIRT;
+		}
+	}
+
+	if (chunk_set_tiles(chunk, tiles) < 0) {
+		chunk_free(chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+/**
+ * Finds how high the surface is at a column, which is where grass is
+ * @param seed The world's seed
+ * @param x The column
+ * @return The y-coordinate of the top solid tile
+ */
+int64_t terrain_surface_height(uint64_t seed, int64_t x)
+{
+	struct TerrainColumns columns;
+	terrain_columns(SIMD_SCALAR, seed, x >> CHUNK_SHIFT, &columns);
+	return columns.surface[x & CHUNK_MASK];
+}
+
+/**
+ * Works out the heights of everything in a chunk column that only depends on
+ * x
+ * @param level The kernels to use
+ * @param seed The world's seed
+ * @param cx The chunk column
+ * @param columns Where to put the heights
+ */
+static void terrain_columns(enum SimdLevel level, uint64_t seed, int64_t cx,
+	struct TerrainColumns *columns)
+{
+	float surface[CHUNK_LENGTH], crust[CHUNK_LENGTH];
+	float bedrock[CHUNK_LENGTH];
+	octaves_1d(level, surface, seed, cx, height_octaves,
+		NUM_OCTAVES(height_octaves));
+	octaves_1d(level, crust, seed, cx, crust_octaves,
+		NUM_OCTAVES(crust_octaves));
+	octaves_1d(level, bedrock, seed, cx, bedrock_octaves,
+		NUM_OCTAVES(bedrock_octaves));
+
+	for (int rx = 0; rx < CHUNK_LENGTH; ++rx) {
+		// 1D noise is within [-0.5, 0.5] times its amplitude
+		columns->surface[rx] = floorf(surface[rx]);
+		columns->crust[rx] = columns->surface[rx] - TERRAIN_CRUST -
+			(int64_t) floorf(crust[rx]);
+		int64_t bumps = floorf((bedrock[rx] + 0.5f) *
+			(TERRAIN_BEDROCK_BUMPS + 1));
+		if (bumps > TERRAIN_BEDROCK_BUMPS)
+			bumps = TERRAIN_BEDROCK_BUMPS;
+		columns->bedrock[rx] = TERRAIN_BEDROCK_Y + (bumps > 0
+			? bumps : 0);
+	}
+}
+
+/**
+ * Adds up layers of 1D noise across a chunk column
+ * @param level The kernels to use
+ * @param out Where to put the sum for each rx
+ * @param seed The world's seed
+ * @param cx The chunk column
+ * @param octaves The layers
+ * @param n How many layers there are
+ */
+static void octaves_1d(enum SimdLevel level, float *out, uint64_t seed,
+	int64_t cx, const struct Octave *octaves, size_t n)
+{
+	for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+		out[rx] = 0.0f;
+	for (size_t o = 0; o < n; ++o) {
+		const unsigned shift = octaves[o].shift;
+		const int64_t x = cx * CHUNK_LENGTH;
+		const int64_t ix = x >> shift;
+		// Slopes from -1 to 1, from the top 24 bits of the hash, which
+		// a float holds exactly
+		const float scale = 2.0f / (1 << 24);
+		struct Noise1D noise = {
+			.g0 = (terrain_hash(seed, octaves[o].salt, ix, 0) >>
+				40) * scale - 1.0f,
+			.g1 = (terrain_hash(seed, octaves[o].salt, ix + 1, 0) >>
+				40) * scale - 1.0f,
+			.u0 = ((x & ((1 << shift) - 1)) + 0.5f) / (1 << shift),
+			.du = 1.0f / (1 << shift),
+			.amplitude = octaves[o].amplitude,
+		};
+		noise_1d(level, out, &noise);
+	}
+}
+
+/**
+ * Adds up layers of 2D noise across a chunk
+ * @param level The kernels to use
+ * @param out Where to put the sum for each tile, in row-major order
+ * @param seed The world's seed
+ * @param cx The chunk's x-coordinate
+ * @param cy The chunk's y-coordinate
+ * @param octaves The layers
+ * @param n How many layers there are
+ */
+static void octaves_2d(enum SimdLevel level, float *out, uint64_t seed,
+	int64_t cx, int64_t cy, const struct Octave *octaves, size_t n)
+{
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		out[i] = 0.0f;
+	for (size_t o = 0; o < n; ++o) {
+		const unsigned shift = octaves[o].shift;
+		const int64_t x = cx * CHUNK_LENGTH;
+		const int64_t y = cy * CHUNK_LENGTH;
+		const int64_t ix = x >> shift;
+		const int64_t iy = y >> shift;
+		struct Noise2D noise = {
+			.u0 = ((x & ((1 << shift) - 1)) + 0.5f) / (1 << shift),
+			.v0 = ((y & ((1 << shift) - 1)) + 0.5f) / (1 << shift),
+			.d = 1.0f / (1 << shift),
+			.amplitude = octaves[o].amplitude,
+		};
+		for (int corner = 0; corner < 4; ++corner) {
+			uint64_t hash = terrain_hash(seed, octaves[o].salt,
+				ix + (corner & 1), iy + (corner >> 1));
+			noise.g[corner][0] = gradients[hash >> 61][0];
+			noise.g[corner][1] = gradients[hash >> 61][1];
+		}
+		noise_2d(level, out, &noise);
+	}
+}
+
+/**
+ * Smooths a position within a lattice cell so that noise has no creases at
+ * the lattice points
+ * @param t The position, from 0 to 1
+ * @return The smoothed position
+ */
+static inline float fade(float t)
+{
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+#ifdef SIMD_X86
+/**
+ * fade for four positions at once
+ * @param t The positions
+ * @return The smoothed positions
+ */
+static inline __m128 fade_sse(__m128 t)
+{
+	__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(
+		_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))),
+		_mm_set1_ps(10.0f));
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+/**
+ * fade for eight positions at once
+ * @param t The positions
+ * @return The smoothed positions
+ */
+SIMD_TARGET_AVX
+static inline __m256 fade_avx(__m256 t)
+{
+	__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(
+		_mm256_mul_ps(t, _mm256_set1_ps(6.0f)),
+		_mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+/**
+ * Adds 1D noise across a chunk with SSE, four tiles at a time
+ * @param out The sums for each rx
+ * @param noise The noise
+ */
+static void noise_1d_sse(float *out, const struct Noise1D *noise)
+{
+	const __m128 g0 = _mm_set1_ps(noise->g0);
+	const __m128 g1 = _mm_set1_ps(noise->g1);
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (int rx = 0; rx < CHUNK_LENGTH; rx += 4) {
+		__m128 i = _mm_add_ps(_mm_set1_ps(rx),
+			_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+		__m128 u = _mm_add_ps(_mm_set1_ps(noise->u0),
+			_mm_mul_ps(i, _mm_set1_ps(noise->du)));
+		__m128 f = fade_sse(u);
+		__m128 a = _mm_mul_ps(g0, u);
+		__m128 b = _mm_mul_ps(g1, _mm_sub_ps(u, one));
+		__m128 n = _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a)));
+		_mm_storeu_ps(&out[rx], _mm_add_ps(_mm_loadu_ps(&out[rx]),
+			_mm_mul_ps(_mm_set1_ps(noise->amplitude), n)));
+	}
+}
+
+/**
+ * Adds 1D noise across a chunk with AVX, eight tiles at a time
+ * @param out The sums for each rx
+ * @param noise The noise
+ */
+SIMD_TARGET_AVX
+static void noise_1d_avx(float *out, const struct Noise1D *noise)
+{
+	const __m256 g0 = _mm256_set1_ps(noise->g0);
+	const __m256 g1 = _mm256_set1_ps(noise->g1);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	for (int rx = 0; rx < CHUNK_LENGTH; rx += 8) {
+		__m256 i = _mm256_add_ps(_mm256_set1_ps(rx), _mm256_setr_ps(
+			0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+		__m256 u = _mm256_add_ps(_mm256_set1_ps(noise->u0),
+			_mm256_mul_ps(i, _mm256_set1_ps(noise->du)));
+		__m256 f = fade_avx(u);
+		__m256 a = _mm256_mul_ps(g0, u);
+		__m256 b = _mm256_mul_ps(g1, _mm256_sub_ps(u, one));
+		__m256 n = _mm256_add_ps(a, _mm256_mul_ps(f,
+			_mm256_sub_ps(b, a)));
+		_mm256_storeu_ps(&out[rx], _mm256_add_ps(
+			_mm256_loadu_ps(&out[rx]), _mm256_mul_ps(
+			_mm256_set1_ps(noise->amplitude), n)));
+	}
+}
+
+/**
+ * Adds 2D noise across a chunk with SSE, four tiles at a time
+ * @param out The sums for each tile
+ * @param noise The noise
+ */
+static void noise_2d_sse(float *out, const struct Noise2D *noise)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 amplitude = _mm_set1_ps(noise->amplitude);
+	__m128 g[4][2];
+	for (int corner = 0; corner < 4; ++corner) {
+		g[corner][0] = _mm_set1_ps(noise->g[corner][0]);
+		g[corner][1] = _mm_set1_ps(noise->g[corner][1]);
+	}
+
+	// Every row has the same columns
+	__m128 u[CHUNK_LENGTH / 4], fu[CHUNK_LENGTH / 4];
+	for (int k = 0; k < CHUNK_LENGTH / 4; ++k) {
+		__m128 i = _mm_add_ps(_mm_set1_ps(k * 4),
+			_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+		u[k] = _mm_add_ps(_mm_set1_ps(noise->u0),
+			_mm_mul_ps(i, _mm_set1_ps(noise->d)));
+		fu[k] = fade_sse(u[k]);
+	}
+
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry) {
+		const __m128 v = _mm_set1_ps(noise->v0 + (float) ry * noise->d);
+		const __m128 fv = fade_sse(v);
+		const __m128 v1 = _mm_sub_ps(v, one);
+		for (int k = 0; k < CHUNK_LENGTH / 4; ++k) {
+			__m128 u1 = _mm_sub_ps(u[k], one);
+			__m128 n00 = _mm_add_ps(_mm_mul_ps(g[0][0], u[k]),
+				_mm_mul_ps(g[0][1], v));
+			__m128 n10 = _mm_add_ps(_mm_mul_ps(g[1][0], u1),
+				_mm_mul_ps(g[1][1], v));
+			__m128 n01 = _mm_add_ps(_mm_mul_ps(g[2][0], u[k]),
+				_mm_mul_ps(g[2][1], v1));
+			__m128 n11 = _mm_add_ps(_mm_mul_ps(g[3][0], u1),
+				_mm_mul_ps(g[3][1], v1));
+			__m128 x0 = _mm_add_ps(n00, _mm_mul_ps(fu[k],
+				_mm_sub_ps(n10, n00)));
+			__m128 x1 = _mm_add_ps(n01, _mm_mul_ps(fu[k],
+				_mm_sub_ps(n11, n01)));
+			__m128 n = _mm_add_ps(x0, _mm_mul_ps(fv,
+				_mm_sub_ps(x1, x0)));
+			float *row = &out[ry * CHUNK_LENGTH + k * 4];
+			_mm_storeu_ps(row, _mm_add_ps(_mm_loadu_ps(row),
+				_mm_mul_ps(amplitude, n)));
+		}
+	}
+}
+
+/**
+ * Adds 2D noise across a chunk with AVX, eight tiles at a time
+ * @param out The sums for each tile
+ * @param noise The noise
+ */
+SIMD_TARGET_AVX
+static void noise_2d_avx(float *out, const struct Noise2D *noise)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 amplitude = _mm256_set1_ps(noise->amplitude);
+	__m256 g[4][2];
+	for (int corner = 0; corner < 4; ++corner) {
+		g[corner][0] = _mm256_set1_ps(noise->g[corner][0]);
+		g[corner][1] = _mm256_set1_ps(noise->g[corner][1]);
+	}
+
+	// Every row has the same columns
+	__m256 u[CHUNK_LENGTH / 8], fu[CHUNK_LENGTH / 8];
+	for (int k = 0; k < CHUNK_LENGTH / 8; ++k) {
+		__m256 i = _mm256_add_ps(_mm256_set1_ps(k * 8), _mm256_setr_ps(
+			0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+		u[k] = _mm256_add_ps(_mm256_set1_ps(noise->u0),
+			_mm256_mul_ps(i, _mm256_set1_ps(noise->d)));
+		fu[k] = fade_avx(u[k]);
+	}
+
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry) {
+		const __m256 v = _mm256_set1_ps(noise->v0 +
+			(float) ry * noise->d);
+		const __m256 fv = fade_avx(v);
+		const __m256 v1 = _mm256_sub_ps(v, one);
+		for (int k = 0; k < CHUNK_LENGTH / 8; ++k) {
+			__m256 u1 = _mm256_sub_ps(u[k], one);
+			__m256 n00 = _mm256_add_ps(_mm256_mul_ps(g[0][0], u[k]),
+				_mm256_mul_ps(g[0][1], v));
+			__m256 n10 = _mm256_add_ps(_mm256_mul_ps(g[1][0], u1),
+				_mm256_mul_ps(g[1][1], v));
+			__m256 n01 = _mm256_add_ps(_mm256_mul_ps(g[2][0], u[k]),
+				_mm256_mul_ps(g[2][1], v1));
+			__m256 n11 = _mm256_add_ps(_mm256_mul_ps(g[3][0], u1),
+				_mm256_mul_ps(g[3][1], v1));
+			__m256 x0 = _mm256_add_ps(n00, _mm256_mul_ps(fu[k],
+				_mm256_sub_ps(n10, n00)));
+			__m256 x1 = _mm256_add_ps(n01, _mm256_mul_ps(fu[k],
+				_mm256_sub_ps(n11, n01)));
+			__m256 n = _mm256_add_ps(x0, _mm256_mul_ps(fv,
+				_mm256_sub_ps(x1, x0)));
+			float *row = &out[ry * CHUNK_LENGTH + k * 8];
+			_mm256_storeu_ps(row, _mm256_add_ps(
+				_mm256_loadu_ps(row),
+				_mm256_mul_ps(amplitude, n)));
+		}
+	}
+}
+#endif
+
+/**
+ * Adds a layer of 1D noise across a chunk
+ * Every kernel does the same operations in the same order, so they all give
+ * exactly the same sums.
+ * @param level The kernel to use
+ * @param out The sums for each rx
+ * @param noise The noise
+ */
+static void noise_1d(enum SimdLevel level, float *out,
+	const struct Noise1D *noise)
+{
+	switch (level) {
+#ifdef SIMD_X86
+	case SIMD_SSE2:
+		noise_1d_sse(out, noise);
+		return;
+	case SIMD_AVX:
+		noise_1d_avx(out, noise);
+		return;
+#endif
+	default:
+		break;
+	}
+
+	for (int rx = 0; rx < CHUNK_LENGTH; ++rx) {
+		float u = noise->u0 + (float) rx * noise->du;
+		float f = fade(u);
+		float a = noise->g0 * u;
+		float b = noise->g1 * (u - 1.0f);
+		out[rx] += noise->amplitude * (a + f * (b - a));
+	}
+}
+
+/**
+ * Adds a layer of 2D noise across a chunk
+ * Every kernel does the same operations in the same order, so they all give
+ * exactly the same sums.
+ * @param level The kernel to use
+ * @param out The sums for each tile
+ * @param noise The noise
+ */
+static void noise_2d(enum SimdLevel level, float *out,
+	const struct Noise2D *noise)
+{
+	switch (level) {
+#ifdef SIMD_X86
+	case SIMD_SSE2:
+		noise_2d_sse(out, noise);
+		return;
+	case SIMD_AVX:
+		noise_2d_avx(out, noise);
+		return;
+#endif
+	default:
+		break;
+	}
+
+	const float (*g)[2] = noise->g;
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry) {
+		float v = noise->v0 + (float) ry * noise->d;
+		float fv = fade(v);
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx) {
+			float u = noise->u0 + (float) rx * noise->d;
+			float fu = fade(u);
+			float n00 = g[0][0] * u + g[0][1] * v;
+			float n10 = g[1][0] * (u - 1.0f) + g[1][1] * v;
+			float n01 = g[2][0] * u + g[2][1] * (v - 1.0f);
+			float n11 = g[3][0] * (u - 1.0f) + g[3][1] * (v - 1.0f);
+			float x0 = n00 + fu * (n10 - n00);
+			float x1 = n01 + fu * (n11 - n01);
+			out[ry * CHUNK_LENGTH + rx] += noise->amplitude *
+				(x0 + fv * (x1 - x0));
+		}
+	}
+}
+
+/**
+ * Generates some of the chunks of world_generate_terrain
+ * @param data The struct TerrainJob
+ * @param begin The first chunk, counting across rows from the bottom left
+ * @param end The chunk after the last
+ */
+static void terrain_generate_range(void *data, size_t begin, size_t end)
+{
+	const struct TerrainJob *job = data;
+	for (size_t i = begin; i < end; ++i)
+		job->chunks[i] = terrain_generate_chunk(job->seed,
+			job->cx1 + (int64_t) i % job->width,
+			job->cy1 + (int64_t) i / job->width, job->level);
+}
+
+/**
+ * Generates a rectangle of chunks into a world, replacing any chunks already
+ * there
+ * @param world The world
+ * @param jobs The job system to generate the chunks on, or NULL to generate
+ * 	them on this thread
+ * @param seed The world's seed
+ * @param cx1 The left chunk column
+ * @param cy1 The bottom chunk row
+ * @param cx2 The right chunk column (inclusive)
+ * @param cy2 The top chunk row (inclusive)
+ * @return 0 on success and a negative value on error
+ */
+int world_generate_terrain(World world, JobSystem jobs, uint64_t seed,
+	int64_t cx1, int64_t cy1, int64_t cx2, int64_t cy2)
+{
+	TRACE_ZONE("world_generate_terrain");
+	if (!world || cx2 < cx1 || cy2 < cy1)
+		return -1;
+
+	const size_t n = (cx2 - cx1 + 1) * (cy2 - cy1 + 1);
+	struct TerrainJob job = {
+		.seed = seed,
+		.cx1 = cx1,
+		.cy1 = cy1,
+		.width = cx2 - cx1 + 1,
+		.level = simd_best(),
+		.chunks = calloc(n, sizeof(Chunk)),
+	};
+	if (!job.chunks) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+
+	// Chunks are independent, so they're generated in parallel and only
+	// put into the world on this thread
+	int ret = 0;
+	if (jobs)
+		ret = job_parallel_for(jobs, n, 0, terrain_generate_range,
+			&job);
+	else
+		terrain_generate_range(&job, 0, n);
+
+	for (size_t i = 0; i < n; ++i) {
+		Chunk chunk = job.chunks[i];
+		// terrain_generate_chunk only fails to allocate, and may have
+		// said so on another thread
+		if (ret >= 0 && !chunk)
+			g_error_message = "malloc failed";
+		if (ret < 0 || !chunk) {
+			chunk_free(chunk);
+			ret = -1;
+			continue;
+		}
+		Chunk old = world_get_chunk(world, chunk->cx, chunk->cy);
+		if (world_put_chunk(world, chunk) < 0)
+			ret = -1;
+		// The chunk may have gone in before the error
+		if (world_get_chunk(world, chunk->cx, chunk->cy) == chunk)
+			chunk_free(old);
+		else
+			chunk_free(chunk);
+	}
+	free(job.chunks);
+	return ret;
+}
@@ -0,0 +1,28 @@
+/* Seeded terrain made from gradient noise: a heightmap with a grass surface,
+ * a crust of dirt that caves don't break through, caves below it and a floor
+ * of bedrock. Every chunk only depends on the seed and its coordinates, so
+ * chunks can be generated in any order and on any thread.
+ */
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stdint.h>
+#include "world.h"
+#include "job.h"
+#include "simd.h"
+
+// No surface is higher than this
+#define TERRAIN_MAX_HEIGHT 40
+// Every tile at or below this is bedrock, and the bedrock's bumpy top is at
+// most TERRAIN_BEDROCK_BUMPS tiles above it
+#define TERRAIN_BEDROCK_Y -128
+#define TERRAIN_BEDROCK_BUMPS 4
+
+Chunk terrain_generate_chunk(uint64_t seed, int64_t cx, int64_t cy,
+	enum SimdLevel);
+int64_t terrain_surface_height(uint64_t seed, int64_t x);
+int world_generate_terrain(World, JobSystem, uint64_t seed, int64_t cx1,
+	int64_t cy1, int64_t cx2, int64_t cy2);
+
+#endif // TERRAIN_H
@@ -0,0 +1,145 @@
+#include "../world.h"
+#include "../stream.h"
+#include "../snapshot.h"
+#include "../job.h"
+#include "testing.h"
+
+#define SEED 777
+// Somewhere underground in chunk (0, -3), so that every chunk around it is
+// streamed in
+#define X 8.5
+#define Y -40.5
+#define CY (-3)
+// Far enough that the two squares of chunks don't overlap
+#define FAR (10.0 * CHUNK_LENGTH)
+
+static struct Snapshot snapshot;
+
+// The chunks saved by save, which saves nothing while held is set
+static struct ChunkKey saved[16];
+static int num_saved;
+static bool held;
+
+/**
+ * Records a chunk as saved, unless saves are held
+ * @param data Unused
+ * @param chunk The chunk
+ * @return 1 if the chunk was saved and 0 if not
+ */
+static int save(void *data, Chunk chunk)
+{
+	(void) data;
+	assert(chunk->flags & CHUNK_MODIFIED);
+	if (held)
+		return 0;
+	saved[num_saved++] = (struct ChunkKey) {chunk->cx, chunk->cy};
+	return 1;
+}
+
+/**
+ * Passes a world's changes on to its mirror through a snapshot
+ * @param world The world
+ * @param mirror The mirror
+ */
+static void sync(World world, World mirror)
+{
+	assert(snapshot_capture(&snapshot, world, ENTITY_NONE) >= 0);
+	assert(snapshot_apply(&snapshot, mirror) >= 0);
+}
+
+int main(void)
+{
+	// With no worker threads, stream_update generates chunks right away
+	JobSystem jobs = job_system_new(1);
+	assert(jobs);
+	World world = world_new();
+	World mirror = world_new();
+	assert(world && mirror);
+	world_track_changes(world);
+	ChunkStream stream = stream_new(jobs, SEED, 1);
+	assert(stream);
+
+	// Within the budget, nothing is unloaded
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	assert(stream->stats.loaded == 9);
+	assert(stream_update(stream, world, X + FAR, Y, 0.0, 0.0) >= 0);
+	assert(stream->stats.loaded == 18);
+	assert(stream_evict(stream, world) >= 0);
+	assert(stream->stats.evicted == 0);
+	assert(stream->stats.resident_chunks == 18);
+	sync(world, mirror);
+	assert(world_get_chunk(mirror, -1, CY));
+
+	// The least recently used chunk goes first, and the mirror loses it
+	// too
+	for (int64_t cy = CY - 1; cy <= CY + 1; ++cy)
+		for (int64_t cx = -1; cx <= 1; ++cx)
+			if (cx != -1 || cy != CY)
+				assert(world_get_chunk(world, cx, cy));
+	stream->budget = stream->stats.resident_bytes - 1;
+	assert(stream_evict(stream, world) >= 0);
+	assert(stream->stats.evicted == 1);
+	assert(stream->stats.resident_chunks == 17);
+	assert(!world_get_chunk(world, -1, CY));
+	sync(world, mirror);
+	assert(!world_get_chunk(mirror, -1, CY));
+	assert(world_get_chunk(mirror, 0, CY));
+
+	// Without a save function, modified chunks are kept, and so are
+	// chunks with entities in them. Nothing around the player goes.
+	assert(world_set_block(world, X, Y, TILE_LOG) >= 0);
+	EntityHandle cow = entity_spawn_cow(&world->entities,
+		CHUNK_LENGTH + 8.5, Y);
+	assert(cow != ENTITY_NONE);
+	stream->budget = 0;
+	assert(stream_evict(stream, world) >= 0);
+	assert(stream->stats.evicted == 7);
+	assert(stream->stats.saved == 0);
+	assert(world_get_chunk(world, 0, CY));
+	assert(world_get_chunk(world, 1, CY));
+	assert(stream->stats.resident_chunks == 11);
+
+	// With one, they're saved first, and kept while it can't save them
+	stream->save = save;
+	held = true;
+	assert(stream_evict(stream, world) >= 0);
+	assert(stream->stats.evicted == 7);
+	assert(num_saved == 0 && world_get_chunk(world, 0, CY));
+	held = false;
+	assert(stream_evict(stream, world) >= 0);
+	assert(stream->stats.evicted == 8);
+	assert(stream->stats.saved == 1);
+	assert(num_saved == 1 && saved[0].cx == 0 && saved[0].cy == CY);
+	assert(!world_get_chunk(world, 0, CY));
+
+	// Coming back unloads the chunks left behind and reloads the rest
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	assert(stream->stats.evicted == 17);
+	assert(stream->stats.reloaded == 8);
+	assert(stream->stats.loaded == 26);
+	assert(world_get_block(world, X, Y) != TILE_LOG);
+	sync(world, mirror);
+	assert(world_get_chunk(mirror, -1, CY));
+	assert(!world_get_chunk(mirror, FAR / CHUNK_LENGTH, CY));
+
+	// Roaming unloads chunk after chunk, but the ones remembered for
+	// counting reloads stay bounded
+	size_t most = 0;
+	for (int i = 1; i <= 400; ++i) {
+		assert(stream_update(stream, world,
+			X + FAR + i * 3.0 * CHUNK_LENGTH, Y, 0.0, 0.0) >= 0);
+		if (stream->stats.evicted_keys > most)
+			most = stream->stats.evicted_keys;
+	}
+	assert(stream->stats.evicted > 2 * STREAM_EVICTED_MIN);
+	assert(most <= STREAM_EVICTED_MIN);
+
+	stream_free(stream);
+	world_free(world);
+	world_free(mirror);
+	free(snapshot.entities);
+	free(snapshot.changes);
+	job_system_free(jobs);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include "../world.h"
+#include "testing.h"
+
+int main(void)
+{
+	Chunk chunk = chunk_new(0, 0);
+	assert(chunk && chunk_is_uniform(chunk));
+
+	// Every tile gets a different block, which needs all 8 bits
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		assert(chunk_set_tile(chunk, i % CHUNK_LENGTH, i / CHUNK_LENGTH,
+			i) >= 0);
+	assert(chunk->bits == 8);
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		assert(chunk_get_tile(chunk, i % CHUNK_LENGTH,
+			i / CHUNK_LENGTH) == (enum BlockID) i);
+
+	// A 257th block has to reuse the entry of the tile it replaces
+	assert(chunk_set_tile(chunk, 3, 3, 1000) >= 0);
+	assert(chunk_get_tile(chunk, 3, 3) == 1000);
+	assert(chunk_get_tile(chunk, 4, 3) == 3 * CHUNK_LENGTH + 4);
+
+	// Going back to two blocks lets compaction shrink the indices
+	assert(chunk_fill_rect(chunk, 0, 0, CHUNK_LENGTH - 1, 7, TILE_DIRT) >= 0);
+	assert(chunk_fill_rect(chunk, 0, 8, CHUNK_LENGTH - 1,
+		CHUNK_LENGTH - 1, TILE_AIR) >= 0);
+	assert(chunk_compact(chunk) >= 0);
+	assert(chunk->bits == 1 && chunk->palette_len == 2);
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+			assert(chunk_get_tile(chunk, rx, ry) ==
+				(ry < 8 ? TILE_DIRT : TILE_AIR));
+
+	chunk_free(chunk);
+	puts("passed");
+	return 0;
+}
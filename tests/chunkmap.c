@@ -0,0 +1,40 @@
+#include "../world.h"
+#include "testing.h"
+
+#define SIDE 100
+
+int main(void)
+{
+	ChunkMap map = chunkmap_new(4);
+	// Chunks are only used as values here and never dereferenced
+	Chunk chunks[SIDE * SIDE];
+
+	for (int y = 0; y < SIDE; ++y)
+		for (int x = 0; x < SIDE; ++x) {
+			struct ChunkKey key = {x - SIDE / 2, y - SIDE / 2};
+			chunks[y * SIDE + x] = (Chunk) &chunks[y * SIDE + x];
+			assert(chunkmap_put(map, key, chunks[y * SIDE + x]) >= 0);
+		}
+	assert(chunkmap_size(map) == SIDE * SIDE);
+
+	// Remove the left half of the square
+	for (int y = 0; y < SIDE; ++y)
+		for (int x = 0; x < SIDE / 2; ++x)
+			chunkmap_remove(map,
+				(struct ChunkKey) {x - SIDE / 2, y - SIDE / 2});
+
+	for (int y = 0; y < SIDE; ++y)
+		for (int x = 0; x < SIDE; ++x) {
+			Chunk *value = chunkmap_get(map,
+				(struct ChunkKey) {x - SIDE / 2, y - SIDE / 2});
+			if (x < SIDE / 2)
+				assert(!value)
+			else
+				assert(value && *value == chunks[y * SIDE + x])
+		}
+	assert(chunkmap_size(map) == SIDE * SIDE / 2);
+
+	chunkmap_free(map);
+	puts("passed");
+	return 0;
+}
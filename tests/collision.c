@@ -0,0 +1,40 @@
+#include <math.h>
+#include "../world.h"
+#include "../entity.h"
+#include "../physics.h"
+#include "testing.h"
+
+int main(void)
+{
+	World world = world_new();
+	// Ground whose top face is at y=0, and a wall whose left face is at x=5
+	assert(world_fill_block(world, -40, -4, 40, -1, TILE_DIRT) >= 0);
+	assert(world_fill_block(world, 5, 0, 5, 3, TILE_LOG) >= 0);
+
+	assert(world_query_solid_rows(world, 0, -2, 4, 1) == 0x3);
+	assert(world_query_solid_columns(world, 3, 0, 6, 0) == 0x4);
+	assert(world_query_solid_aabb(world, 4, 2, 5, 2));
+	assert(!world_query_solid_aabb(world, -10, 0, 4, 30));
+
+	struct EntityPool *pool = &world->entities;
+	EntityHandle player = entity_spawn_player(pool, 0.0, 3.0);
+	assert(player != ENTITY_NONE);
+	size_t i = entity_index(pool, player);
+
+	// Falling lands on the ground
+	for (int tick = 0; tick < 120; ++tick)
+		entity_update_physics(pool, i, world, 1.0 / 60);
+	assert(fabs(pool->y[i]) < 1e-9);
+	assert(pool->on_ground[i]);
+
+	// Walking right stops at the wall
+	pool->desired_velocity_x[i] = 5.0;
+	for (int tick = 0; tick < 120; ++tick)
+		entity_update_physics(pool, i, world, 1.0 / 60);
+	assert(fabs(pool->x[i] + pool->hitbox_width[i] / 2.0 - 5.0) < 1e-9);
+	assert(fabs(pool->y[i]) < 1e-9);
+
+	world_free(world);
+	puts("passed");
+	return 0;
+}
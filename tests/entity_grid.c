@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdbool.h>
+#include "../entity.h"
+#include "testing.h"
+
+#define ENTITIES 2000
+#define ROUNDS 50
+
+static uint64_t seed = 0x9E3779B97F4A7C15ull;
+
+/**
+ * Gets a random number
+ * @param low The lowest it can be
+ * @param high The highest it can be
+ * @return The number
+ */
+static double random_between(double low, double high)
+{
+	seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+	return low + (double) (seed >> 11) / (1ull << 53) * (high - low);
+}
+
+/**
+ * Checks that a query found exactly the entities a check accepts
+ * @param pool The pool
+ * @param result What the query found
+ * @param accepts Whether each entity should have been found
+ */
+static void assert_found(const struct EntityPool *pool,
+	const struct EntityQuery *result, const bool *accepts)
+{
+	static bool found[ENTITIES];
+	for (size_t i = 0; i < pool->len; ++i)
+		found[i] = false;
+	for (size_t j = 0; j < result->len; ++j) {
+		assert(result->indices[j] < pool->len);
+		assert(!found[result->indices[j]]);
+		found[result->indices[j]] = true;
+	}
+	for (size_t i = 0; i < pool->len; ++i)
+		assert(found[i] == accepts[i]);
+}
+
+int main(void)
+{
+	struct EntityPool pool;
+	entity_pool_init(&pool);
+	EntityHandle handles[ENTITIES];
+	for (int i = 0; i < ENTITIES; ++i) {
+		handles[i] = i % 2
+			? entity_spawn_cow(&pool, random_between(-200, 200),
+				random_between(-200, 200))
+			: entity_spawn_player(&pool, random_between(-200, 200),
+				random_between(-200, 200));
+		assert(handles[i] != ENTITY_NONE);
+	}
+
+	struct EntityQuery result = {0};
+	static bool accepts[ENTITIES];
+	for (int round = 0; round < ROUNDS; ++round) {
+		// Move every entity a bit, some across cells, and despawn a
+		// few
+		for (size_t i = 0; i < pool.len; ++i) {
+			pool.x[i] += random_between(-3, 3);
+			pool.y[i] += random_between(-3, 3);
+			assert(entity_moved(&pool, i) >= 0);
+		}
+		for (int k = 0; k < 10; ++k)
+			entity_despawn(&pool, handles[(round * 10 + k) * 3 %
+				ENTITIES]);
+
+		// Queries find what checking every entity does
+		double x1 = random_between(-220, 200);
+		double y1 = random_between(-220, 200);
+		double x2 = x1 + random_between(0, 60);
+		double y2 = y1 + random_between(0, 60);
+		assert(entity_query_rect(&pool, x1, y1, x2, y2, &result) >= 0);
+		for (size_t i = 0; i < pool.len; ++i)
+			accepts[i] = pool.x[i] - pool.hitbox_width[i] / 2 <= x2 &&
+				pool.x[i] + pool.hitbox_width[i] / 2 >= x1 &&
+				pool.y[i] <= y2 &&
+				pool.y[i] + pool.hitbox_height[i] >= y1;
+		assert_found(&pool, &result, accepts);
+
+		double x = random_between(-200, 200);
+		double y = random_between(-200, 200);
+		double radius = random_between(0, 30);
+		assert(entity_query_radius(&pool, x, y, radius, &result) >= 0);
+		for (size_t i = 0; i < pool.len; ++i) {
+			// The closest point of the hitbox to (x, y)
+			double cx = fmin(fmax(x, pool.x[i] -
+				pool.hitbox_width[i] / 2),
+				pool.x[i] + pool.hitbox_width[i] / 2);
+			double cy = fmin(fmax(y, pool.y[i]),
+				pool.y[i] + pool.hitbox_height[i]);
+			accepts[i] = (x - cx) * (x - cx) + (y - cy) * (y - cy) <=
+				radius * radius;
+		}
+		assert_found(&pool, &result, accepts);
+
+		size_t e = round % pool.len;
+		assert(entity_query_overlaps(&pool, e, &result) >= 0);
+		for (size_t i = 0; i < pool.len; ++i)
+			accepts[i] = i != e &&
+				fabs(pool.x[i] - pool.x[e]) <=
+				(pool.hitbox_width[i] + pool.hitbox_width[e]) /
+				2 && pool.y[i] <= pool.y[e] +
+				pool.hitbox_height[e] &&
+				pool.y[e] <= pool.y[i] + pool.hitbox_height[i];
+		assert_found(&pool, &result, accepts);
+	}
+
+	// An entity is found by any part of its hitbox, even far from where
+	// it stands
+	entity_pool_clear(&pool);
+	EntityHandle cow = entity_spawn_cow(&pool, 15.5, 15.5);
+	assert(entity_query_rect(&pool, 16.0, 16.0, 16.2, 16.2, &result) >= 0);
+	assert(result.len == 1 && result.indices[0] ==
+		entity_index(&pool, cow));
+	assert(entity_query_rect(&pool, 17.0, 15.0, 18.0, 16.0, &result) >= 0);
+	assert(result.len == 0);
+
+	entity_query_free(&result);
+	entity_pool_free(&pool);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <string.h>
+#include "../entity.h"
+#include "testing.h"
+
+int main(void)
+{
+	struct EntityPool pool;
+	entity_pool_init(&pool);
+
+	EntityHandle player = entity_spawn_player(&pool, 1.0, 2.0);
+	EntityHandle cows[100];
+	for (int i = 0; i < 100; ++i) {
+		cows[i] = entity_spawn_cow(&pool, i, 0.0);
+		assert(cows[i] != ENTITY_NONE);
+	}
+	assert(pool.len == 101 && pool.num_players == 1);
+	assert(entity_player(&pool, player));
+	assert(!entity_player(&pool, cows[0]));
+
+	// Despawning moves the last entity into the gap, and its handle follows
+	entity_despawn(&pool, cows[10]);
+	assert(entity_index(&pool, cows[10]) == SIZE_MAX);
+	assert(pool.len == 100);
+	assert(pool.x[entity_index(&pool, cows[99])] == 99.0);
+	assert(pool.x[entity_index(&pool, player)] == 1.0);
+	entity_despawn(&pool, cows[10]);
+	assert(pool.len == 100);
+
+	// The freed slot is reused, but the old handle stays stale
+	EntityHandle cow = entity_spawn_cow(&pool, -1.0, 0.0);
+	assert(cow != cows[10]);
+	assert((cow & ENTITY_INDEX_MASK) == (cows[10] & ENTITY_INDEX_MASK));
+	assert(entity_index(&pool, cows[10]) == SIZE_MAX);
+	assert(pool.x[entity_index(&pool, cow)] == -1.0);
+	assert(entity_index(&pool, ENTITY_NONE) == SIZE_MAX);
+
+	// Uuids are made on demand and lead back to their entity
+	assert(entity_find_uuid(&pool, pool.uuid[0]) == ENTITY_NONE);
+	uuid_t uuid;
+	uuid_copy(uuid, entity_uuid(&pool, cows[50]));
+	assert(!uuid_is_null(uuid));
+	assert(!memcmp(entity_uuid(&pool, cows[50]), uuid, sizeof(uuid)));
+	assert(entity_find_uuid(&pool, uuid) == cows[50]);
+	entity_despawn(&pool, cows[50]);
+	assert(entity_find_uuid(&pool, uuid) == ENTITY_NONE);
+
+	entity_despawn(&pool, player);
+	assert(pool.num_players == 0);
+	assert(!entity_player(&pool, player));
+
+	entity_pool_clear(&pool);
+	assert(pool.len == 0);
+	assert(entity_index(&pool, cow) == SIZE_MAX);
+
+	// Slots freed by clearing are reused too, and the handles from before
+	// stay stale
+	EntityHandle again = entity_spawn_cow(&pool, 0.0, 0.0);
+	assert((again & ENTITY_INDEX_MASK) == (player & ENTITY_INDEX_MASK));
+	assert(again != player);
+	assert(entity_index(&pool, player) == SIZE_MAX);
+	assert(entity_index(&pool, again) == 0);
+	entity_pool_free(&pool);
+	puts("passed");
+	return 0;
+}
@@ -19,6 +19,16 @@ int main(void)
 		for (int x = X1; x <= X2; ++x)
 			assert(world_get_block(world, x, y) == FILL_BLOCK);
 
+	// Nothing around the area may have been touched
+	for (int y = Y1 - 1; y <= Y2 + 1; ++y) {
+		assert(world_get_block(world, X1 - 1, y) == TILE_AIR);
+		assert(world_get_block(world, X2 + 1, y) == TILE_AIR);
+	}
+	for (int x = X1 - 1; x <= X2 + 1; ++x) {
+		assert(world_get_block(world, x, Y1 - 1) == TILE_AIR);
+		assert(world_get_block(world, x, Y2 + 1) == TILE_AIR);
+	}
+
 	puts("passed");
 	return 0;
 }
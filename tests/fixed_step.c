@@ -0,0 +1,71 @@
+#include "../world.h"
+#include "../entity.h"
+#include "../physics.h"
+#include "testing.h"
+
+#define TICKS 600
+
+// Where a player ended up, and where it was a tick before
+struct Position {
+	double x, y, prev_x, prev_y;
+};
+
+/**
+ * Walks a player right over flat ground for TICKS ticks, with frames of
+ * varying lengths
+ * @param frame_lengths The lengths of frames to cycle through, in seconds
+ * @param num_lengths How many there are
+ * @return Where the player ended up
+ */
+static struct Position walk(const double *frame_lengths, int num_lengths)
+{
+	World world = world_new();
+	assert(world && world_fill_block(world, -100, -4, 100, -1,
+		TILE_DIRT) >= 0);
+	assert(world_fill_block(world, 6, 0, 6, 0, TILE_LOG) >= 0);
+	struct EntityPool *pool = &world->entities;
+	EntityHandle player = entity_spawn_player(pool, 0.0, 0.0);
+	assert(player != ENTITY_NONE);
+	size_t p = entity_index(pool, player);
+	pool->desired_velocity_x[p] = 5.0;
+
+	struct FixedStep step = {.dt = 1.0 / 60, .max_ticks = 1000};
+	unsigned ticks = 0;
+	for (int frame = 0; ticks < TICKS; ++frame) {
+		unsigned n = fixed_step_advance(&step,
+			frame_lengths[frame % num_lengths]);
+		double alpha = fixed_step_alpha(&step);
+		assert(alpha >= 0.0 && alpha <= 1.0);
+		for (unsigned i = 0; i < n && ticks < TICKS; ++i, ++ticks) {
+			// Jumping over the log partway
+			if (ticks == 40)
+				pool->velocity_y[p] = 5.0;
+			world_update_physics(world, step.dt);
+		}
+	}
+
+	struct Position position = {pool->x[p], pool->y[p],
+		pool->prev_x[p], pool->prev_y[p]};
+	world_free(world);
+	return position;
+}
+
+int main(void)
+{
+	const double steady[] = {1.0 / 60};
+	const double uneven[] = {0.001, 0.04, 1.0 / 144, 0.1, 0.0, 0.013};
+	struct Position a = walk(steady, 1);
+	struct Position b = walk(uneven, 6);
+	assert(a.x > 6.0);
+	assert(a.x == b.x && a.y == b.y);
+	assert(a.prev_x == b.prev_x && a.prev_y == b.prev_y);
+
+	// Time past max_ticks is dropped instead of being caught up on
+	struct FixedStep step = {.dt = 0.01, .max_ticks = 4};
+	assert(fixed_step_advance(&step, 1.005) == 4);
+	assert(step.accumulator < step.dt);
+	assert(fixed_step_advance(&step, 0.0) == 0);
+
+	puts("passed");
+	return 0;
+}
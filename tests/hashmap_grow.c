@@ -0,0 +1,56 @@
+#include "../hashmap.h"
+#include "testing.h"
+
+#define NUM_KEYS 100000
+
+static int keys[NUM_KEYS];
+
+int main(void)
+{
+	// Far fewer slots than keys, so the map has to grow many times
+	HashMap map = hashmap_new(4);
+
+	for (int i = 0; i < NUM_KEYS; ++i) {
+		keys[i] = i;
+		size_t hash = SuperFastHash((char *) &keys[i], sizeof(int));
+		assert(hashmap_put(map, &keys[i], sizeof(int), &keys[i], hash) >= 0);
+
+		// Entries must stay reachable while they are being migrated
+		if (i % 1000 == 0)
+			for (int j = 0; j <= i; j += 97) {
+				hash = SuperFastHash((char *) &keys[j], sizeof(int));
+				void **value_ptr = hashmap_get(map, &keys[j],
+					sizeof(int), hash);
+				assert(value_ptr && *value_ptr == &keys[j]);
+			}
+	}
+
+	// Remove every odd key
+	for (int i = 1; i < NUM_KEYS; i += 2) {
+		size_t hash = SuperFastHash((char *) &keys[i], sizeof(int));
+		hashmap_remove(map, &keys[i], sizeof(int), hash);
+	}
+
+	for (int i = 0; i < NUM_KEYS; ++i) {
+		size_t hash = SuperFastHash((char *) &keys[i], sizeof(int));
+		void **value_ptr = hashmap_get(map, &keys[i], sizeof(int), hash);
+		if (i % 2)
+			assert(!value_ptr)
+		else
+			assert(value_ptr && *value_ptr == &keys[i])
+	}
+
+	struct HashMapIterator it;
+	struct HashMapNode *node;
+	int num_items = 0;
+	hashmap_iterator_init(&it, map);
+	while ((node = hashmap_iterate(&it))) {
+		assert(*(int *) node->key % 2 == 0);
+		++num_items;
+	}
+	assert(num_items == NUM_KEYS / 2);
+
+	hashmap_free(map);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include <math.h>
+#include <string.h>
+#include "../world.h"
+#include "../entity.h"
+#include "../physics.h"
+#include "../integrate.h"
+#include "testing.h"
+
+// Not a multiple of any vector width, so the kernels' leftovers are covered
+#define ENTITIES 1003
+#define TICKS 300
+#define TOLERANCE 1e-9
+
+/**
+ * Fills a pool with entities spread over flat ground, walking in every
+ * direction at every speed, some of them high enough to fall a while
+ * @param pool The pool
+ */
+static void spawn(struct EntityPool *pool)
+{
+	entity_pool_init(pool);
+	uint64_t seed = 0x9E3779B97F4A7C15ull;
+	for (int i = 0; i < ENTITIES; ++i) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		double x = (double) (seed >> 40 & 0x3FF) - 512.0;
+		double y = (double) (seed >> 20 & 0x1F);
+		assert(entity_spawn_cow(pool, x, y) != ENTITY_NONE);
+		pool->desired_velocity_x[i] = (double) (seed >> 50) / 256.0 -
+			32.0;
+		if (i % 3 == 0)
+			pool->velocity_y[i] = 5.0;
+	}
+}
+
+/**
+ * Checks that two pools hold the same entities, give or take rounding
+ * @param a One pool
+ * @param b The other
+ */
+static void assert_close(const struct EntityPool *a,
+	const struct EntityPool *b)
+{
+	assert(a->len == b->len);
+	for (size_t i = 0; i < a->len; ++i) {
+		assert(fabs(a->x[i] - b->x[i]) < TOLERANCE);
+		assert(fabs(a->y[i] - b->y[i]) < TOLERANCE);
+		assert(fabs(a->velocity_x[i] - b->velocity_x[i]) < TOLERANCE);
+		assert(fabs(a->velocity_y[i] - b->velocity_y[i]) < TOLERANCE);
+		assert(fabs(a->acceleration_x[i] - b->acceleration_x[i]) <
+			TOLERANCE);
+	}
+}
+
+int main(void)
+{
+	// Every kernel moves entities the same as the scalar one
+	struct EntityPool expected, actual;
+	spawn(&expected);
+	for (int tick = 0; tick < TICKS; ++tick)
+		integrate_entities(&expected, 0, expected.len, 1.0 / 60,
+			SIMD_SCALAR);
+	for (int kernel = 0; kernel < NUM_SIMD_LEVELS; ++kernel) {
+		if (!simd_supported(kernel))
+			continue;
+		spawn(&actual);
+		for (int tick = 0; tick < TICKS; ++tick) {
+			// Ranges that don't start on a vector boundary too
+			integrate_entities(&actual, 0, 5, 1.0 / 60, kernel);
+			integrate_entities(&actual, 5, actual.len, 1.0 / 60,
+				kernel);
+		}
+		assert_close(&expected, &actual);
+		entity_pool_free(&actual);
+	}
+	assert(simd_supported(simd_best()));
+	entity_pool_free(&expected);
+
+	// A world moving every entity at once ends up where moving them one at
+	// a time does
+	World batched = world_new();
+	World single = world_new();
+	assert(batched && single);
+	assert(world_generate_flat(batched) >= 0);
+	assert(world_generate_flat(single) >= 0);
+	assert(world_fill_block(batched, -20, 0, -20, 3, TILE_LOG) >= 0);
+	assert(world_fill_block(single, -20, 0, -20, 3, TILE_LOG) >= 0);
+	entity_pool_free(&batched->entities);
+	entity_pool_free(&single->entities);
+	spawn(&batched->entities);
+	spawn(&single->entities);
+	for (int tick = 0; tick < TICKS; ++tick) {
+		world_update_physics(batched, 1.0 / 60);
+		for (size_t i = 0; i < single->entities.len; ++i)
+			entity_update_physics(&single->entities, i, single,
+				1.0 / 60);
+	}
+	assert_close(&single->entities, &batched->entities);
+	world_free(batched);
+	world_free(single);
+
+	puts("passed");
+	return 0;
+}
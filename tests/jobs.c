@@ -0,0 +1,124 @@
+#include <stdatomic.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "../job.h"
+#include "testing.h"
+
+#define ROUNDS 20
+#define JOBS 20000
+#define CHILDREN 64
+#define LOOP_LENGTH 1000000
+
+static JobSystem jobs;
+static atomic_int ran;
+static atomic_int first_stage;
+static unsigned char visits[LOOP_LENGTH];
+
+static void count(void *data)
+{
+	(void) data;
+	atomic_fetch_add(&ran, 1);
+}
+
+static void first(void *data)
+{
+	(void) data;
+	atomic_fetch_add(&first_stage, 1);
+}
+
+static void second(void *data)
+{
+	// Only runs once every job of the first stage has finished
+	assert(atomic_load(&first_stage) == *(int *) data);
+	atomic_fetch_add(&ran, 1);
+}
+
+// Submits more jobs from within a job and waits for them, which has to keep
+// the thread busy with other jobs instead of deadlocking
+static void parent(void *data)
+{
+	(void) data;
+	struct Job children[CHILDREN];
+	for (int i = 0; i < CHILDREN; ++i)
+		children[i] = (struct Job) {count, NULL};
+
+	struct JobCounter done;
+	job_counter_init(&done);
+	assert(job_submit(jobs, children, CHILDREN, &done) >= 0);
+	job_wait(jobs, &done);
+}
+
+static void visit(void *data, size_t begin, size_t end)
+{
+	(void) data;
+	for (size_t i = begin; i < end; ++i)
+		++visits[i];
+}
+
+/**
+ * Runs every kind of job many times on a job system
+ * @param threads How many threads the job system has
+ */
+static void stress(unsigned threads)
+{
+	static struct Job batch[JOBS];
+	jobs = job_system_new(threads);
+	assert(jobs && job_system_threads(jobs) == threads);
+
+	for (int round = 0; round < ROUNDS; ++round) {
+		struct JobCounter done;
+		job_counter_init(&done);
+
+		// More jobs than fit in a deque, from outside the workers
+		atomic_store(&ran, 0);
+		for (int i = 0; i < JOBS; ++i)
+			batch[i] = (struct Job) {count, NULL};
+		assert(job_submit(jobs, batch, JOBS, &done) >= 0);
+		job_wait(jobs, &done);
+		assert(atomic_load(&ran) == JOBS);
+
+		atomic_store(&ran, 0);
+		for (int i = 0; i < 64; ++i)
+			batch[i] = (struct Job) {parent, NULL};
+		assert(job_submit(jobs, batch, 64, &done) >= 0);
+		job_wait(jobs, &done);
+		assert(atomic_load(&ran) == 64 * CHILDREN);
+
+		// A second stage waiting on the first
+		struct JobCounter first_done;
+		job_counter_init(&first_done);
+		atomic_store(&ran, 0);
+		atomic_store(&first_stage, 0);
+		int stage_length = 1000;
+		for (int i = 0; i < stage_length; ++i)
+			batch[i] = (struct Job) {first, NULL};
+		assert(job_submit(jobs, batch, stage_length,
+			&first_done) >= 0);
+		for (int i = 0; i < 100; ++i)
+			batch[i] = (struct Job) {second, &stage_length};
+		assert(job_submit_after(jobs, &first_done, batch, 100,
+			&done) >= 0);
+		job_wait(jobs, &done);
+		assert(atomic_load(&ran) == 100);
+		assert(atomic_load(&first_done.pending) == 0);
+
+		memset(visits, 0, sizeof(visits));
+		assert(job_parallel_for(jobs, LOOP_LENGTH, 0, visit,
+			NULL) >= 0);
+		assert(job_parallel_for(jobs, LOOP_LENGTH, 777, visit,
+			NULL) >= 0);
+		for (int i = 0; i < LOOP_LENGTH; ++i)
+			assert(visits[i] == 2);
+	}
+
+	job_system_free(jobs);
+}
+
+int main(void)
+{
+	stress(1);
+	stress(2);
+	stress(8);
+	puts("passed");
+	return 0;
+}
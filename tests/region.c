@@ -0,0 +1,164 @@
+#include <unistd.h>
+#include "../world.h"
+#include "../terrain.h"
+#include "../region.h"
+#include "testing.h"
+
+#define SEED 4242
+
+static char dir[] = "/tmp/region_test.XXXXXX";
+
+/**
+ * Checks that two chunks have the same tiles
+ * @param a A chunk
+ * @param b Another chunk
+ */
+static void assert_same_tiles(Chunk a, Chunk b)
+{
+	assert(a && b);
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+			assert(chunk_get_tile(a, rx, ry) ==
+				chunk_get_tile(b, rx, ry));
+}
+
+/**
+ * Saves a chunk, loads it back and checks that nothing changed
+ * @param store The store
+ * @param chunk The chunk, which is freed
+ */
+static void round_trip(RegionStore store, Chunk chunk)
+{
+	assert(region_save_chunk(store, chunk) >= 0);
+	Chunk loaded;
+	assert(region_load_chunk(store, chunk->cx, chunk->cy, &loaded) >= 0);
+	assert(loaded && loaded->cx == chunk->cx && loaded->cy == chunk->cy);
+	assert_same_tiles(chunk, loaded);
+	chunk_free(loaded);
+	chunk_free(chunk);
+}
+
+/**
+ * Removes the directory a store was in, with its files
+ */
+static void remove_dir(void)
+{
+	char path[256];
+	const char *names[] = {
+		"seed", "r.0.0.region", "r.-1.0.region", "r.0.-1.region",
+		"r.-1.-1.region", "r.-2.-1.region",
+	};
+	for (size_t i = 0; i < sizeof(names) / sizeof(*names); ++i) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		unlink(path);
+	}
+	assert(rmdir(dir) == 0);
+}
+
+int main(void)
+{
+	assert(mkdtemp(dir));
+	RegionStore store = region_store_open(dir);
+	assert(store);
+
+	// Terrain chunks on both sides of region boundaries
+	const int64_t coords[][2] = {
+		{0, -1}, {31, -2}, {-1, -3}, {-32, -4}, {-33, -5}, {5, 0},
+	};
+	for (size_t i = 0; i < sizeof(coords) / sizeof(*coords); ++i)
+		round_trip(store, terrain_generate_chunk(SEED, coords[i][0],
+			coords[i][1], SIMD_SCALAR));
+
+	// A chunk with every block and no two neighbours alike, which leaves
+	// nothing to run together, and a uniform one
+	Chunk chunk = chunk_new(3, 3);
+	assert(chunk);
+	uint16_t tiles[CHUNK_AREA];
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		tiles[i] = i % NUM_TILES;
+	assert(chunk_set_tiles(chunk, tiles) >= 0);
+	uint8_t data[REGION_MAX_CHUNK_BYTES];
+	assert(region_encode_chunk(chunk, data) <= REGION_MAX_CHUNK_BYTES);
+	round_trip(store, chunk);
+	chunk = chunk_new(4, 3);
+	assert(chunk);
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		tiles[i] = TILE_UNBREAKABLE_ROCK;
+	assert(chunk_set_tiles(chunk, tiles) >= 0);
+	assert(region_encode_chunk(chunk, data) == 6);
+	round_trip(store, chunk);
+
+	// A chunk that was never saved isn't loaded, in a region that exists
+	// and in one that doesn't
+	Chunk loaded;
+	assert(region_load_chunk(store, 1, 1, &loaded) >= 0 && !loaded);
+	assert(region_load_chunk(store, 1000, 1000, &loaded) >= 0 &&
+		!loaded);
+
+	// Corrupt data is refused rather than decoded
+	chunk = chunk_new(0, 0);
+	assert(chunk);
+	const uint8_t bad_palette[] = {1, 0, 0xFF, 0xFF, 0, 255};
+	assert(region_decode_chunk(chunk, bad_palette,
+		sizeof(bad_palette)) < 0);
+	const uint8_t short_runs[] = {1, 0, TILE_AIR, 0, 0, 254};
+	assert(region_decode_chunk(chunk, short_runs, sizeof(short_runs)) < 0);
+	chunk_free(chunk);
+
+	// Only modified chunks are saved, and only once
+	World world = world_new();
+	assert(world);
+	for (int64_t cx = -2; cx <= 2; ++cx) {
+		chunk = terrain_generate_chunk(SEED, cx, -2, SIMD_SCALAR);
+		assert(chunk && world_put_chunk(world, chunk) >= 0);
+	}
+	assert(world_set_block(world, 5, -20, TILE_LOG) >= 0);
+	assert(world_set_block(world, -20, -20, TILE_GRASS) >= 0);
+	struct RegionStats before, after;
+	region_store_stats(store, &before);
+	assert(region_save_world(store, world) >= 0);
+	region_store_stats(store, &after);
+	assert(after.chunks_saved == before.chunks_saved + 2);
+	assert(region_save_world(store, world) >= 0);
+	region_store_stats(store, &before);
+	assert(before.chunks_saved == after.chunks_saved);
+	assert(region_flush(store) >= 0);
+
+	// A chunk that grows past the space it was given is moved, and one
+	// that shrinks stays where it is
+	chunk = world_get_chunk(world, 0, -2);
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		tiles[i] = (i * 7) % NUM_TILES;
+	assert(chunk_set_tiles(chunk, tiles) >= 0);
+	assert(region_save_chunk(store, chunk) >= 0);
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		tiles[i] = TILE_DIRT;
+	assert(chunk_set_tiles(chunk, tiles) >= 0);
+	assert(region_save_chunk(store, chunk) >= 0);
+	region_store_close(store);
+
+	// Everything is still there after the store is opened again
+	store = region_store_open(dir);
+	assert(store);
+	assert(region_load_chunk(store, 0, -2, &loaded) >= 0);
+	assert_same_tiles(world_get_chunk(world, 0, -2), loaded);
+	chunk_free(loaded);
+	assert(region_load_chunk(store, -2, -2, &loaded) >= 0);
+	assert(loaded && chunk_get_tile(loaded, -20 & 15, -20 & 15) ==
+		TILE_GRASS);
+	assert_same_tiles(world_get_chunk(world, -2, -2), loaded);
+	chunk_free(loaded);
+	assert(region_load_chunk(store, -1, -2, &loaded) >= 0 && !loaded);
+
+	// The seed is saved the first time and kept after that
+	uint64_t seed = SEED;
+	assert(region_store_seed(store, &seed) >= 0 && seed == SEED);
+	seed = 1;
+	assert(region_store_seed(store, &seed) >= 0 && seed == SEED);
+
+	region_store_close(store);
+	world_free(world);
+	remove_dir();
+	puts("passed");
+	return 0;
+}
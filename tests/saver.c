@@ -0,0 +1,148 @@
+#include <string.h>
+#include <unistd.h>
+#include "../world.h"
+#include "../terrain.h"
+#include "../region.h"
+#include "../saver.h"
+#include "testing.h"
+
+#define SEED 99
+// Chunks along the surface, all in region (0, -1)
+#define CHUNKS 8
+#define CY (-1)
+
+static char dir[] = "/tmp/saver_test.XXXXXX";
+
+/**
+ * Checks that the saved version of a chunk has the tiles of another
+ * @param store The store
+ * @param expected The chunk with the tiles
+ */
+static void assert_saved(RegionStore store, Chunk expected)
+{
+	Chunk loaded;
+	assert(region_load_chunk(store, expected->cx, expected->cy,
+		&loaded) >= 0 && loaded);
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+			assert(chunk_get_tile(loaded, rx, ry) ==
+				chunk_get_tile(expected, rx, ry));
+	chunk_free(loaded);
+}
+
+int main(void)
+{
+	assert(mkdtemp(dir));
+	RegionStore store = region_store_open(dir);
+	assert(store);
+	Saver saver = saver_new(store);
+	assert(saver);
+	World world = world_new();
+	assert(world);
+	for (int64_t cx = 0; cx < CHUNKS; ++cx) {
+		Chunk chunk = terrain_generate_chunk(SEED, cx, CY, SIMD_SCALAR);
+		assert(chunk && world_put_chunk(world, chunk) >= 0);
+	}
+	EntityHandle player = entity_spawn_player(&world->entities, 3.5, -2.0);
+	EntityHandle cow = entity_spawn_cow(&world->entities, 20.5, -3.0);
+	assert(player != ENTITY_NONE && cow != ENTITY_NONE);
+	world->entities.velocity_x[entity_index(&world->entities, cow)] = 1.5;
+	entity_player(&world->entities, player)->inventory[2] =
+		(struct Item) {ITEM_LOG, true, {.quantity = 7}};
+
+	// Only modified chunks go into the snapshot, and they're shared until
+	// the save is collected
+	assert(world_set_block(world, 5, -3, TILE_LOG) >= 0);
+	assert(world_set_block(world, 40, -3, TILE_LOG) >= 0);
+	Chunk first = world_get_chunk(world, 0, CY);
+	Chunk second = world_get_chunk(world, 2, CY);
+	Chunk before = chunk_copy(first);
+	assert(before);
+	assert(saver_begin(saver, world) == 1);
+	assert(saver->num_chunks == 2);
+	assert(first->flags & CHUNK_SHARED && !(first->flags & CHUNK_MODIFIED));
+	assert(!(world_get_chunk(world, 1, CY)->flags & CHUNK_SHARED));
+	// Another save can't begin until this one is collected
+	assert(saver_begin(saver, world) == 0);
+
+	// Changing a shared chunk puts a copy in its place and leaves the
+	// snapshot as it was, while an unshared one changes in place
+	assert(world_set_block(world, 6, -3, TILE_GRASS) >= 0);
+	assert(world_set_block(world, 20, -3, TILE_GRASS) >= 0);
+	Chunk changed = world_get_chunk(world, 0, CY);
+	assert(changed != first && first->flags & CHUNK_DETACHED);
+	assert(changed->flags & CHUNK_MODIFIED &&
+		!(changed->flags & CHUNK_SHARED));
+	assert(world->stats.chunks_unshared == 1);
+	assert(world_get_chunk(world, 1, CY)->flags & CHUNK_MODIFIED);
+
+	// Once collected, the snapshot's version is on disk and the detached
+	// chunk is gone
+	assert(saver_wait(saver) >= 0);
+	assert(world_get_chunk(world, 2, CY) == second);
+	assert(!(second->flags & CHUNK_SHARED));
+	assert(saver->stats.saves == 1 && saver->stats.chunks_saved == 2);
+	assert(saver->stats.last_latency_us <= saver->stats.max_latency_us);
+	assert_saved(store, before);
+	assert_saved(store, second);
+	chunk_free(before);
+
+	// The next save picks up what changed during the last one
+	assert(saver_begin(saver, world) == 1);
+	assert(saver->num_chunks == 2);
+	assert(saver_wait(saver) >= 0);
+	assert_saved(store, world_get_chunk(world, 0, CY));
+	assert_saved(store, world_get_chunk(world, 1, CY));
+	assert(saver->stats.chunks_saved == 4);
+
+	// A chunk can't be saved right away while a save is in progress, so
+	// that an older snapshot can't overwrite it, but can once it's
+	// collected
+	assert(world_set_block(world, 7, -3, TILE_DIRT) >= 0);
+	assert(saver_begin(saver, world) == 1);
+	assert(world_set_block(world, 8, -3, TILE_LOG) >= 0);
+	Chunk latest = world_get_chunk(world, 0, CY);
+	while (saver->busy) {
+		int saved = saver_save_chunk(saver, latest);
+		assert(saved >= 0);
+		assert(saved == !saver->busy);
+		if (saver->busy)
+			SDL_Delay(1);
+	}
+	assert(saver_save_chunk(saver, latest) == 1);
+	assert_saved(store, latest);
+
+	// The entities come back with their state and uuids
+	const uint8_t *uuid = entity_uuid(&world->entities, cow);
+	assert(uuid);
+	uuid_t cow_uuid;
+	uuid_copy(cow_uuid, uuid);
+	World loaded = world_new();
+	assert(loaded);
+	assert(saver_load_entities(store, &loaded->entities) == 2);
+	EntityHandle found = entity_find_uuid(&loaded->entities, cow_uuid);
+	assert(found != ENTITY_NONE);
+	size_t i = entity_index(&loaded->entities, found);
+	assert(loaded->entities.type[i] == COW_ENTITY);
+	assert(loaded->entities.x[i] == 20.5 && loaded->entities.y[i] == -3.0);
+	assert(loaded->entities.velocity_x[i] == 1.5);
+	for (i = 0; loaded->entities.type[i] != PLAYER_ENTITY; ++i)
+		;
+	const struct Item *item = &entity_player(&loaded->entities,
+		loaded->entities.handle[i])->inventory[2];
+	assert(item->type == ITEM_LOG && item->stackable &&
+		item->quantity == 7);
+	world_free(loaded);
+
+	saver_free(saver);
+	world_free(world);
+	region_store_close(store);
+	char path[256];
+	snprintf(path, sizeof(path), "%s/r.0.-1.region", dir);
+	assert(unlink(path) == 0);
+	snprintf(path, sizeof(path), "%s/entities", dir);
+	assert(unlink(path) == 0);
+	assert(rmdir(dir) == 0);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "../world.h"
+#include "../entity.h"
+#include "../render.h"
+#include "../globals.h"
+#include "testing.h"
+
+int main(void)
+{
+	g_surface = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
+		0xFF0000, 0xFF00, 0xFF, 0);
+	SDL_Surface *expected = SDL_CreateRGBSurface(0, SCREEN_WIDTH,
+		SCREEN_HEIGHT, 32, 0xFF0000, 0xFF00, 0xFF, 0);
+	assert(g_surface && expected);
+	assert(render_init() >= 0);
+
+	World world = world_new();
+	assert(world_generate_flat(world) >= 0);
+	EntityHandle cow = entity_spawn_cow(&world->entities, 2.0, 0.0);
+	assert(cow != ENTITY_NONE);
+
+	struct PlayerView view = {.center_x = 0.3, .center_y = 1.1,
+		.width = 25, .alpha = 1};
+	assert(sprites_update(&view) >= 0);
+	assert(render_frame(world, &view, RENDER_SCROLL) >= 0);
+
+	// Walk diagonally while the world and the cow change. Each scrolled
+	// frame must match the same frame drawn from scratch.
+	for (int i = 0; i < 200; ++i) {
+		view.center_x += 0.137;
+		view.center_y += i < 100 ? -0.05 : 0.071;
+		size_t c = entity_index(&world->entities, cow);
+		world->entities.x[c] += 0.09;
+		assert(entity_moved(&world->entities, c) >= 0);
+		if (i % 7 == 0)
+			assert(world_set_block(world, view.center_x + i % 5,
+				-1 - i % 3, TILE_AIR) >= 0);
+		if (i % 31 == 0)
+			assert(world_fill_block(world, view.center_x - 4, 2,
+				view.center_x, 3, TILE_LOG) >= 0);
+
+		assert(render_frame(world, &view, RENDER_SCROLL) >= 0);
+		assert(SDL_BlitSurface(g_surface, NULL, expected, NULL) >= 0);
+		assert(render_frame(world, &view, RENDER_FULL) >= 0);
+		for (int y = 0; y < SCREEN_HEIGHT; ++y)
+			assert(!memcmp(
+				(char *) g_surface->pixels + y * g_surface->pitch,
+				(char *) expected->pixels + y * expected->pitch,
+				SCREEN_WIDTH * 4));
+	}
+
+	// A chunk cleared down to air has nothing to draw, but still stops
+	// being redrawn once it has been
+	int64_t cx = (int64_t) view.center_x / CHUNK_LENGTH;
+	assert(world_fill_block(world, cx * CHUNK_LENGTH, 0,
+		(cx + 1) * CHUNK_LENGTH - 1, CHUNK_LENGTH - 1, TILE_AIR) >= 0);
+	Chunk air = world_get_chunk(world, cx, 0);
+	assert(air && chunk_is_uniform(air) && air->flags & CHUNK_RENDER_DIRTY);
+	assert(render_frame(world, &view, RENDER_SCROLL) >= 0);
+	assert(!(air->flags & CHUNK_RENDER_DIRTY));
+
+	world_free(world);
+	render_free();
+	SDL_FreeSurface(expected);
+	SDL_FreeSurface(g_surface);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdatomic.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "../world.h"
+#include "../entity.h"
+#include "../snapshot.h"
+#include "testing.h"
+
+#define PUBLISHES 5000
+
+static struct SnapshotBuffer buffer;
+static atomic_bool writer_done;
+
+/**
+ * Gets the x-coordinate of the only entity in a world
+ * @param world The world
+ * @return The x-coordinate
+ */
+static double entity_x(World world)
+{
+	assert(world->entities.len == 1);
+	return world->entities.x[0];
+}
+
+/**
+ * Publishes PUBLISHES snapshots, the nth of which adds a log at (n, 0) and
+ * moves a cow to x = n
+ * @param data Unused
+ * @return 0
+ */
+static int writer(void *data)
+{
+	(void) data;
+	World world = world_new();
+	assert(world);
+	world_track_changes(world);
+	EntityHandle cow = entity_spawn_cow(&world->entities, 0.0, 0.0);
+	assert(cow != ENTITY_NONE);
+
+	for (int tick = 1; tick <= PUBLISHES; ++tick) {
+		assert(world_set_block(world, tick, 0, TILE_LOG) >= 0);
+		size_t i = entity_index(&world->entities, cow);
+		world->entities.x[i] = tick;
+		assert(entity_moved(&world->entities, i) >= 0);
+		struct Snapshot *snapshot = snapshot_begin(&buffer);
+		assert(snapshot_capture(snapshot, world, cow) >= 0);
+		snapshot->tick = tick;
+		snapshot_publish(&buffer);
+	}
+	atomic_store(&writer_done, true);
+	world_free(world);
+	return 0;
+}
+
+int main(void)
+{
+	// A snapshot replaced before the reader took it still gets its chunk
+	// changes to the reader
+	World world = world_new();
+	assert(world);
+	world_track_changes(world);
+	assert(world_fill_block(world, 0, 0, 15, 15, TILE_DIRT) >= 0);
+	EntityHandle cow = entity_spawn_cow(&world->entities, 1.0, 2.0);
+	assert(cow != ENTITY_NONE);
+
+	snapshot_buffer_init(&buffer);
+	struct Snapshot *snapshot = snapshot_begin(&buffer);
+	assert(snapshot_capture(snapshot, world, cow) >= 0);
+	snapshot->tick = 1;
+	snapshot_publish(&buffer);
+
+	assert(world_set_block(world, 20, 0, TILE_LOG) >= 0);
+	assert(world_set_block(world, 3, 3, TILE_LOG) >= 0);
+	size_t i = entity_index(&world->entities, cow);
+	world->entities.x[i] = 5.0;
+	assert(entity_moved(&world->entities, i) >= 0);
+	snapshot = snapshot_begin(&buffer);
+	assert(snapshot_capture(snapshot, world, cow) >= 0);
+	snapshot->tick = 2;
+	snapshot_publish(&buffer);
+
+	World mirror = world_new();
+	assert(mirror);
+	snapshot = snapshot_acquire(&buffer);
+	assert(snapshot->tick == 2 && snapshot->player == 0);
+	assert(snapshot_apply(snapshot, mirror) >= 0);
+	assert(chunkmap_size(mirror->chunkmap) == 2);
+	assert(world_get_block(mirror, 0, 0) == TILE_DIRT);
+	assert(world_get_block(mirror, 3, 3) == TILE_LOG);
+	assert(world_get_block(mirror, 20, 0) == TILE_LOG);
+	assert(entity_x(mirror) == 5.0);
+
+	// With nothing new published, the reader keeps what it has
+	assert(snapshot_acquire(&buffer) == snapshot);
+	assert(snapshot_apply(snapshot, mirror) >= 0);
+	assert(chunkmap_size(mirror->chunkmap) == 2);
+	snapshot_buffer_free(&buffer);
+	world_free(world);
+	world_free(mirror);
+
+	// A reader racing a writer only ever sees whole snapshots, in order,
+	// and ends up with every change
+	snapshot_buffer_init(&buffer);
+	mirror = world_new();
+	assert(mirror);
+	SDL_Thread *thread = SDL_CreateThread(writer, "writer", NULL);
+	assert(thread);
+
+	uint64_t last_tick = 0;
+	for (;;) {
+		bool done = atomic_load(&writer_done);
+		snapshot = snapshot_acquire(&buffer);
+		assert(snapshot->tick >= last_tick);
+		last_tick = snapshot->tick;
+		assert(snapshot_apply(snapshot, mirror) >= 0);
+		if (last_tick) {
+			assert(entity_x(mirror) == last_tick);
+			assert(world_get_block(mirror, last_tick, 0) ==
+				TILE_LOG);
+			assert(world_get_block(mirror, last_tick + 1, 0) ==
+				TILE_AIR);
+		}
+		if (done)
+			break;
+	}
+	SDL_WaitThread(thread, NULL);
+
+	assert(last_tick == PUBLISHES);
+	for (int x = 1; x <= PUBLISHES; ++x)
+		assert(world_get_block(mirror, x, 0) == TILE_LOG);
+	snapshot_buffer_free(&buffer);
+	world_free(mirror);
+
+	puts("passed");
+	return 0;
+}
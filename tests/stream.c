@@ -0,0 +1,168 @@
+#include "../world.h"
+#include "../terrain.h"
+#include "../stream.h"
+#include "../job.h"
+#include "../globals.h"
+#include "testing.h"
+
+#define SEED 12345
+#define RADIUS 2
+// Somewhere underground, so that every chunk around it is streamed in
+#define X 1000.5
+#define Y -40.5
+#define CX ((int64_t) X >> CHUNK_SHIFT)
+#define CY (-3)
+
+/**
+ * Checks that a chunk in the world has the tiles the terrain generator gives
+ * it
+ * @param world The world
+ * @param cx The chunk column
+ * @param cy The chunk row
+ */
+static void assert_generated(World world, int64_t cx, int64_t cy)
+{
+	Chunk chunk = world_get_chunk(world, cx, cy);
+	Chunk expected = terrain_generate_chunk(SEED, cx, cy, SIMD_SCALAR);
+	assert(chunk && expected);
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+			assert(chunk_get_tile(chunk, rx, ry) ==
+				chunk_get_tile(expected, rx, ry));
+	chunk_free(expected);
+}
+
+/**
+ * Streams one chunk at a time around a player moving one way, with no worker
+ * threads, and checks which chunks come first
+ * @param velocity_x The player's horizontal velocity
+ */
+static void test_order(double velocity_x)
+{
+	JobSystem jobs = job_system_new(1);
+	assert(jobs);
+	World world = world_new();
+	assert(world);
+	ChunkStream stream = stream_new(jobs, SEED, RADIUS);
+	assert(stream);
+	stream->max_in_flight = 1;
+
+	// The player's own chunk comes first, then the one it's heading
+	// towards, and then the ones above and below before the one behind
+	int64_t ahead = velocity_x > 0.0 ? 1 : -1;
+	assert(stream_update(stream, world, X, Y, velocity_x, 0.0) >= 0);
+	assert(world_get_chunk(world, CX, CY));
+	assert(!world_get_chunk(world, CX + ahead, CY));
+	assert(stream_update(stream, world, X, Y, velocity_x, 0.0) >= 0);
+	assert(world_get_chunk(world, CX + ahead, CY));
+	assert(stream_update(stream, world, X, Y, velocity_x, 0.0) >= 0);
+	assert(stream_update(stream, world, X, Y, velocity_x, 0.0) >= 0);
+	assert(world_get_chunk(world, CX, CY - 1));
+	assert(world_get_chunk(world, CX, CY + 1));
+	assert(!world_get_chunk(world, CX - ahead, CY));
+	assert(!stream_ready(world, X, Y));
+
+	stream_free(stream);
+	world_free(world);
+	job_system_free(jobs);
+}
+
+static char load_error[] = "load failed";
+
+/**
+ * A load function that always fails
+ */
+static int failing_load(void *data, int64_t cx, int64_t cy, Chunk *chunk)
+{
+	(void) data;
+	(void) cx;
+	(void) cy;
+	(void) chunk;
+	g_error_message = load_error;
+	return -1;
+}
+
+/**
+ * Checks that why a chunk failed to load on a worker is reported on the thread
+ * updating the stream
+ */
+static void test_load_error(void)
+{
+	JobSystem jobs = job_system_new(4);
+	assert(jobs);
+	World world = world_new();
+	assert(world);
+	ChunkStream stream = stream_new(jobs, SEED, RADIUS);
+	assert(stream);
+	stream->load = failing_load;
+
+	g_error_message = NULL;
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	stream_wait(stream);
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) < 0);
+	assert(g_error_message == load_error);
+
+	stream_free(stream);
+	world_free(world);
+	job_system_free(jobs);
+}
+
+int main(void)
+{
+	assert((int64_t) Y >> CHUNK_SHIFT == CY);
+	test_order(1.0);
+	test_order(-1.0);
+	test_load_error();
+
+	JobSystem jobs = job_system_new(4);
+	assert(jobs);
+	World world = world_new();
+	assert(world);
+	ChunkStream stream = stream_new(jobs, SEED, RADIUS);
+	assert(stream);
+
+	// A chunk already in the world is kept
+	Chunk kept = chunk_new(CX + 1, CY);
+	assert(kept && world_put_chunk(world, kept) >= 0);
+
+	// With every chunk in flight at once, two updates bring them all in
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	stream_wait(stream);
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	assert(stream_ready(world, X, Y));
+	const uint64_t side = 2 * RADIUS + 1;
+	assert(stream->stats.requested == side * side - 1);
+	assert(stream->stats.loaded == side * side - 1);
+	for (int64_t cy = CY - RADIUS; cy <= CY + RADIUS; ++cy)
+		for (int64_t cx = CX - RADIUS; cx <= CX + RADIUS; ++cx)
+			if (cx != CX + 1 || cy != CY)
+				assert_generated(world, cx, cy);
+	assert(world_get_chunk(world, CX + 1, CY) == kept);
+
+	// Nothing more is asked for until the player moves to another chunk,
+	// which only brings in the new column
+	assert(stream_update(stream, world, X, Y, 0.0, 0.0) >= 0);
+	assert(stream->stats.requested == side * side - 1);
+	assert(stream_update(stream, world, X + CHUNK_LENGTH, Y, 0.0,
+		0.0) >= 0);
+	stream_wait(stream);
+	assert(stream_update(stream, world, X + CHUNK_LENGTH, Y, 0.0,
+		0.0) >= 0);
+	assert(stream->stats.loaded == side * side - 1 + side);
+	for (int64_t cy = CY - RADIUS; cy <= CY + RADIUS; ++cy)
+		assert_generated(world, CX + RADIUS + 1, cy);
+
+	// Chunks above the terrain are left out, since they're all air
+	const double high = TERRAIN_MAX_HEIGHT + CHUNK_LENGTH * 2;
+	assert(stream_update(stream, world, X, high, 0.0, 0.0) >= 0);
+	stream_wait(stream);
+	assert(stream_update(stream, world, X, high, 0.0, 0.0) >= 0);
+	assert(stream_ready(world, X, high));
+	assert(!world_get_chunk(world, CX, (int64_t) high >> CHUNK_SHIFT));
+
+	stream_free(stream);
+	world_free(world);
+	job_system_free(jobs);
+	puts("passed");
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include "../world.h"
+#include "../terrain.h"
+#include "../job.h"
+#include "testing.h"
+
+#define SEED 12345
+#define CX1 -6
+#define CX2 5
+#define CY1 (TERRAIN_BEDROCK_Y / CHUNK_LENGTH - 1)
+#define CY2 (TERRAIN_MAX_HEIGHT / CHUNK_LENGTH + 1)
+
+/**
+ * Checks that two worlds have the same tiles in the chunks generated
+ * @param a One world
+ * @param b The other
+ */
+static void assert_same(World a, World b)
+{
+	for (int64_t y = CY1 * CHUNK_LENGTH; y < (CY2 + 1) * CHUNK_LENGTH; ++y)
+		for (int64_t x = CX1 * CHUNK_LENGTH;
+			x < (CX2 + 1) * CHUNK_LENGTH; ++x)
+			assert(world_get_block(a, x, y) ==
+				world_get_block(b, x, y));
+}
+
+int main(void)
+{
+	World serial = world_new();
+	assert(serial);
+	assert(world_generate_terrain(serial, NULL, SEED, CX1, CY1, CX2,
+		CY2) >= 0);
+
+	// Chunks come out the same one at a time, in any order, with any
+	// kernel
+	for (int level = 0; level < NUM_SIMD_LEVELS; ++level) {
+		if (!simd_supported(level))
+			continue;
+		World world = world_new();
+		assert(world);
+		for (int64_t cy = CY2; cy >= CY1; --cy) {
+			for (int64_t cx = CX2; cx >= CX1; --cx) {
+				Chunk chunk = terrain_generate_chunk(SEED, cx,
+					cy, level);
+				assert(chunk && world_put_chunk(world,
+					chunk) >= 0);
+			}
+		}
+		assert_same(serial, world);
+		world_free(world);
+	}
+
+	// And on other threads
+	JobSystem jobs = job_system_new(4);
+	assert(jobs);
+	World parallel = world_new();
+	assert(parallel);
+	assert(world_generate_terrain(parallel, jobs, SEED, CX1, CY1, CX2,
+		CY2) >= 0);
+	assert_same(serial, parallel);
+	world_free(parallel);
+	job_system_free(jobs);
+
+	// Every column has grass at the surface with air above it, and
+	// bedrock at the bottom
+	int caves = 0;
+	for (int64_t x = CX1 * CHUNK_LENGTH; x < (CX2 + 1) * CHUNK_LENGTH;
+		++x) {
+		int64_t surface = terrain_surface_height(SEED, x);
+		assert(surface < TERRAIN_MAX_HEIGHT);
+		assert(surface > TERRAIN_BEDROCK_Y + TERRAIN_BEDROCK_BUMPS);
+		assert(world_get_block(serial, x, surface) == TILE_GRASS);
+		assert(world_get_block(serial, x, surface + 1) == TILE_AIR);
+		assert(world_get_block(serial, x, TERRAIN_BEDROCK_Y) ==
+			TILE_UNBREAKABLE_ROCK);
+		assert(world_get_block(serial, x, TERRAIN_BEDROCK_Y +
+			TERRAIN_BEDROCK_BUMPS + 1) != TILE_UNBREAKABLE_ROCK);
+		for (int64_t y = TERRAIN_BEDROCK_Y; y < surface; ++y)
+			caves += world_get_block(serial, x, y) == TILE_AIR;
+	}
+	// Some of the ground is caves, but not most of it
+	assert(caves > 0);
+	assert(caves < (CX2 - CX1 + 1) * CHUNK_LENGTH *
+		-TERRAIN_BEDROCK_Y / 2);
+
+	// Another seed makes another world
+	World other = world_new();
+	assert(other);
+	assert(world_generate_terrain(other, NULL, SEED + 1, CX1, CY1, CX2,
+		CY2) >= 0);
+	int differences = 0;
+	for (int64_t x = CX1 * CHUNK_LENGTH; x < (CX2 + 1) * CHUNK_LENGTH;
+		++x)
+		differences += terrain_surface_height(SEED, x) !=
+			terrain_surface_height(SEED + 1, x);
+	assert(differences > 0);
+	world_free(other);
+
+	world_free(serial);
+	puts("passed");
+	return 0;
+}
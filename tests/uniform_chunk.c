@@ -0,0 +1,37 @@
+#include "../world.h"
+#include "testing.h"
+
+int main(void)
+{
+	World world = world_new();
+
+	// New chunks don't allocate any tiles
+	assert(world_set_block(world, 0, 0, TILE_AIR) >= 0);
+	Chunk chunk = world_get_chunk(world, 0, 0);
+	assert(chunk && chunk_is_uniform(chunk) && chunk->uniform == TILE_AIR);
+
+	// The first differing block expands the chunk
+	assert(world_set_block(world, 5, 7, TILE_LOG) >= 0);
+	assert(!chunk_is_uniform(chunk));
+	assert(world_get_block(world, 5, 7) == TILE_LOG);
+	assert(world_get_block(world, 6, 7) == TILE_AIR);
+	assert(world_query_solid_aabb(world, 0, 0, 15, 15));
+	assert(!world_query_solid_aabb(world, 6, 0, 15, 15));
+
+	// Putting it back makes the chunk uniform again once it's compacted
+	assert(world_set_block(world, 5, 7, TILE_AIR) >= 0);
+	assert(!chunk_is_uniform(chunk));
+	assert(world_compact_step(world, 16) >= 0);
+	assert(chunk_is_uniform(chunk) && chunk->uniform == TILE_AIR);
+	assert(world->stats.chunks_folded == 1);
+
+	// Filling a whole chunk makes it uniform immediately
+	assert(world_fill_block(world, 16, 0, 31, 15, TILE_DIRT) >= 0);
+	chunk = world_get_chunk(world, 1, 0);
+	assert(chunk && chunk_is_uniform(chunk) && chunk->uniform == TILE_DIRT);
+	assert(world_query_solid_aabb(world, 15, 3, 16, 3));
+
+	world_free(world);
+	puts("passed");
+	return 0;
+}
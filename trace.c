@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "trace.h"
+#include "globals.h"
+
+#ifdef TRACING
+
+// How many events each thread keeps, which must be a power of two
+#define TRACE_RING_SIZE (1 << 16)
+
+struct TraceEvent {
+	// NULL for a frame marker
+	const char *name;
+	uint64_t start, end;
+};
+
+struct TraceBuffer {
+	struct TraceEvent events[TRACE_RING_SIZE];
+	// How many events were ever recorded, including overwritten ones
+	uint64_t count;
+	unsigned tid;
+	const char *thread_name;
+	struct TraceBuffer *next;
+};
+
+// Every thread's buffer, newest first. Buffers are never freed, since the
+// trace may outlive their threads.
+static _Atomic(struct TraceBuffer *) trace_buffers;
+static atomic_uint trace_next_tid;
+static _Thread_local struct TraceBuffer *trace_buffer;
+
+/**
+ * Gets the time events are recorded in
+ * @return Monotonic time in nanoseconds
+ */
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Gets the calling thread's buffer, creating it on the thread's first event
+ * @return The buffer, or NULL if it couldn't be allocated
+ */
+static struct TraceBuffer *trace_thread_buffer(void)
+{
+	if (trace_buffer)
+		return trace_buffer;
+
+	struct TraceBuffer *buffer = calloc(1, sizeof(*buffer));
+	if (!buffer)
+		return NULL;
+	buffer->tid = atomic_fetch_add(&trace_next_tid, 1);
+
+	buffer->next = atomic_load(&trace_buffers);
+	while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next,
+		buffer))
+		;
+	return trace_buffer = buffer;
+}
+
+/**
+ * Records an event in the calling thread's ring buffer
+ * @param name The event's name, or NULL for a frame marker
+ * @param start When it started
+ * @param end When it ended
+ */
+static void trace_record(const char *name, uint64_t start, uint64_t end)
+{
+	struct TraceBuffer *buffer = trace_thread_buffer();
+	if (!buffer)
+		return;
+	buffer->events[buffer->count++ & (TRACE_RING_SIZE - 1)] =
+		(struct TraceEvent) {name, start, end};
+}
+
+/**
+ * Starts timing a zone, which TRACE_ZONE does
+ * @param name The zone's name
+ * @return The zone, to be passed to trace_zone_end
+ */
+struct TraceZone trace_zone_begin(const char *name)
+{
+	return (struct TraceZone) {name, trace_now()};
+}
+
+/**
+ * Records a zone that ended, which TRACE_ZONE does when it goes out of scope
+ * @param zone The zone
+ */
+void trace_zone_end(struct TraceZone *zone)
+{
+	trace_record(zone->name, zone->start, trace_now());
+}
+
+/**
+ * Records the start of a frame
+ */
+void trace_frame(void)
+{
+	uint64_t now = trace_now();
+	trace_record(NULL, now, now);
+}
+
+/**
+ * Names the calling thread in exported traces
+ * @param name The name, which must outlive the trace
+ */
+void trace_thread_name(const char *name)
+{
+	struct TraceBuffer *buffer = trace_thread_buffer();
+	if (buffer)
+		buffer->thread_name = name;
+}
+
+/**
+ * Writes every thread's recorded events as Chrome trace-event JSON
+ * Threads still recording while this runs may have their newest events
+ * written half-updated, so it's meant to be called once they're done.
+ * @param path The file to write
+ * @return 0 on success and a negative value on error
+ */
+int trace_export(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		g_error_message = "couldn't open trace file";
+		return -1;
+	}
+
+	// Timestamps are written relative to the earliest event
+	uint64_t epoch = UINT64_MAX;
+	struct TraceBuffer *head = atomic_load(&trace_buffers);
+	for (struct TraceBuffer *buffer = head; buffer; buffer = buffer->next) {
+		uint64_t first = buffer->count > TRACE_RING_SIZE ?
+			buffer->count - TRACE_RING_SIZE : 0;
+		for (uint64_t i = first; i < buffer->count; ++i) {
+			const struct TraceEvent *event =
+				&buffer->events[i & (TRACE_RING_SIZE - 1)];
+			if (event->start < epoch)
+				epoch = event->start;
+		}
+	}
+
+	fputs("{\"traceEvents\": [\n", file);
+	const char *separator = "";
+	for (struct TraceBuffer *buffer = head; buffer; buffer = buffer->next) {
+		if (buffer->thread_name) {
+			fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+				"\"pid\": 1, \"tid\": %u, "
+				"\"args\": {\"name\": \"%s\"}}", separator,
+				buffer->tid, buffer->thread_name);
+			separator = ",\n";
+		}
+
+		uint64_t first = buffer->count > TRACE_RING_SIZE ?
+			buffer->count - TRACE_RING_SIZE : 0;
+		for (uint64_t i = first; i < buffer->count; ++i) {
+			const struct TraceEvent *event =
+				&buffer->events[i & (TRACE_RING_SIZE - 1)];
+			double ts = (event->start - epoch) / 1e3;
+			if (event->name)
+				fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", "
+					"\"pid\": 1, \"tid\": %u, \"ts\": %.3f, "
+					"\"dur\": %.3f}", separator, event->name,
+					buffer->tid, ts,
+					(event->end - event->start) / 1e3);
+			else
+				fprintf(file, "%s{\"name\": \"frame\", \"ph\": \"i\", "
+					"\"s\": \"g\", \"pid\": 1, \"tid\": %u, "
+					"\"ts\": %.3f}", separator, buffer->tid, ts);
+			separator = ",\n";
+		}
+	}
+	fputs("\n]}\n", file);
+
+	if (fclose(file) == EOF) {
+		g_error_message = "couldn't write trace file";
+		return -1;
+	}
+	return 0;
+}
+
+#else
+
+/**
+ * Writes an empty trace, since tracing wasn't compiled in
+ * @param path The file to write
+ * @return 0 on success and a negative value on error
+ */
+int trace_export(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		g_error_message = "couldn't open trace file";
+		return -1;
+	}
+	fputs("{\"traceEvents\": []}\n", file);
+	if (fclose(file) == EOF) {
+		g_error_message = "couldn't write trace file";
+		return -1;
+	}
+	return 0;
+}
+
+#endif // TRACING
@@ -0,0 +1,51 @@
+/* Scoped tracing zones, exported as Chrome trace-event JSON that Perfetto and
+ * chrome://tracing can open. Tracing is only compiled in when TRACING is
+ * defined (`make TRACING=1`). Without it, every macro expands to nothing.
+ *
+ * TRACE_ZONE("name") times everything from where it's declared to the end of
+ * the enclosing block. Events go into a ring buffer owned by the thread that
+ * recorded them, so recording never takes a lock, and only the most recent
+ * events of each thread are kept.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#ifdef TRACING
+
+struct TraceZone {
+	const char *name;
+	uint64_t start;
+};
+
+struct TraceZone trace_zone_begin(const char *name);
+void trace_zone_end(struct TraceZone *zone);
+void trace_frame(void);
+void trace_thread_name(const char *name);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// name must be a string literal, since only the pointer is kept
+#define TRACE_ZONE(name) \
+	struct TraceZone TRACE_CONCAT(trace_zone_, __LINE__) \
+		__attribute__((cleanup(trace_zone_end))) = \
+		trace_zone_begin(name)
+// Marks the start of a frame
+#define TRACE_FRAME() trace_frame()
+// Names the calling thread in exported traces
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+
+#else
+
+#define TRACE_ZONE(name) ((void) 0)
+#define TRACE_FRAME() ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+
+#endif // TRACING
+
+int trace_export(const char *path);
+
+#endif // TRACE_H
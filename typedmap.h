@@ -0,0 +1,429 @@
+/* Type-specialized hash maps, generated by macros in the style of C++
+ * templates. Each map stores its keys and values inline, hashes keys with a
+ * function chosen at compile time and compares them with a single memcmp of a
+ * constant size, which the compiler turns into one or two word compares.
+ *
+ * The tables are the same ones HashMap in hashmap.c is built on, defined by
+ * TYPED_MAP_TABLE_DEFINE below.
+ *
+ * Keys must not contain padding, since padding bytes take part in the compare.
+ *
+ * TYPED_MAP_DECLARE goes in a header (or at the top of a source file for a
+ * private map) and TYPED_MAP_DEFINE in exactly one source file. `scope` is
+ * empty for a map shared between files and `static inline` for a private one.
+ * hash_fn takes a Key and returns a uint64_t.
+ */
+
+#ifndef TYPEDMAP_H
+#define TYPEDMAP_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// From globals.h, which can't be included here since it includes the headers
+// that declare typed maps
+extern _Thread_local char *g_error_message;
+
+// The table grows once it is more than 3/4 full
+#define TYPED_MAP_LOAD_NUM 3
+#define TYPED_MAP_LOAD_DEN 4
+#define TYPED_MAP_MIN_CAPACITY 8
+// How many slots of the old table are migrated on every insert or erase while
+// the map is growing. Anything above 2 guarantees the old table is empty
+// before the new one needs to grow again.
+#define TYPED_MAP_MIGRATE_STEP 8
+
+// How full a map is, for profiling
+struct TypedMapStats {
+	size_t size;
+	// Slots in the live table
+	size_t capacity;
+	// The most slots any lookup probes, which is 1 if every entry is in its
+	// home slot
+	unsigned max_probe;
+};
+
+#define TYPED_MAP_DECLARE(scope, Name, prefix, Key, Value) \
+typedef struct Name *Name; \
+\
+struct Name##Entry { \
+	Key key; \
+	Value value; \
+}; \
+\
+struct Name##Iterator { \
+	Name map; \
+	/* 0 is the live table and 1 is the table being migrated out of */ \
+	int table; \
+	size_t index; \
+}; \
+\
+scope Name prefix##_new(size_t capacity); \
+scope void prefix##_free(Name map); \
+scope int prefix##_put(Name map, Key key, Value value); \
+scope Value *prefix##_get(Name map, Key key); \
+scope void prefix##_remove(Name map, Key key); \
+scope size_t prefix##_size(Name map); \
+scope void prefix##_stats(Name map, struct TypedMapStats *stats); \
+scope void prefix##_iterator_init(struct Name##Iterator *it, Name map); \
+scope struct Name##Entry *prefix##_iterate(struct Name##Iterator *it);
+
+/* The tables behind both the typed maps and HashMap. Every table is a flat
+ * array of entries probed linearly with Robin Hood hashing: an entry being
+ * inserted takes the slot of any resident entry that is closer to its home
+ * slot than the new entry is, which keeps probe lengths short and lets lookups
+ * stop early. The probe distance of every slot lives in a separate byte array
+ * so that probing only touches the entries that could match.
+ *
+ * Growing never rehashes everything at once. The full table is kept around as
+ * `old` and drained a few slots at a time by later inserts and erases, while
+ * lookups check both tables.
+ *
+ * This defines struct Name and static functions named prefix_*. Entry is the
+ * type stored in the slots and Key the type lookups are made with.
+ * entry_hash(const Entry *) gives an entry's hash and
+ * entry_matches(const Entry *, const Key *, uint64_t hash) whether it holds a
+ * key.
+ */
+#define TYPED_MAP_TABLE_DEFINE(Name, prefix, Entry, Key, entry_hash, \
+	entry_matches) \
+struct Name##Table { \
+	Entry *entries; \
+	/* Distance from the home slot plus one, or 0 for an empty slot */ \
+	uint8_t *dists; \
+	size_t capacity; \
+	size_t size; \
+	/* 64 - log2(capacity), used to pick the home slot from the hash */ \
+	unsigned shift; \
+}; \
+\
+struct Name { \
+	struct Name##Table live; \
+	struct Name##Table old; \
+	size_t migrate_index; \
+}; \
+\
+static inline int prefix##_table_init(struct Name##Table *table, \
+	size_t capacity) \
+{ \
+	table->entries = malloc(capacity * sizeof(*table->entries)); \
+	table->dists = calloc(capacity, sizeof(*table->dists)); \
+	if (!table->entries || !table->dists) { \
+		g_error_message = "malloc failed"; \
+		free(table->entries); \
+		free(table->dists); \
+		return -1; \
+	} \
+	table->capacity = capacity; \
+	table->size = 0; \
+	table->shift = 64; \
+	while (capacity > 1) { \
+		capacity >>= 1; \
+		--table->shift; \
+	} \
+	return 0; \
+} \
+\
+static inline void prefix##_table_free(struct Name##Table *table) \
+{ \
+	free(table->entries); \
+	free(table->dists); \
+	memset(table, 0, sizeof(*table)); \
+} \
+\
+/* The hash is scrambled with Fibonacci hashing first, since the top bits of \
+ * the product depend on every bit of the hash even when only its low bits \
+ * vary (like the hashes of nearby chunks) */ \
+static inline size_t prefix##_table_home(const struct Name##Table *table, \
+	uint64_t hash) \
+{ \
+	return (hash * 0x9E3779B97F4A7C15ull) >> table->shift; \
+} \
+\
+static inline Entry *prefix##_table_find(struct Name##Table *table, \
+	const Key *key, uint64_t hash) \
+{ \
+	if (!table->size) \
+		return NULL; \
+	size_t mask = table->capacity - 1; \
+	size_t i = prefix##_table_home(table, hash); \
+	for (unsigned dist = 1; dist <= table->dists[i]; ++dist) { \
+		if (entry_matches(&table->entries[i], key, hash)) \
+			return &table->entries[i]; \
+		i = (i + 1) & mask; \
+	} \
+	/* Reaching a slot whose entry is closer to home than we are means \
+	 * the key would have displaced it, so the key isn't here */ \
+	return NULL; \
+} \
+\
+/* Fails when a probe distance grows too long to be stored, in which case the \
+ * table is left unchanged */ \
+static inline int prefix##_table_insert(struct Name##Table *table, \
+	Entry entry) \
+{ \
+	size_t mask = table->capacity - 1; \
+	size_t i = prefix##_table_home(table, entry_hash(&entry)); \
+	unsigned dist = 1; \
+	/* Check that the probe fits before displacing anything */ \
+	for (size_t j = i, d = 1; table->dists[j]; j = (j + 1) & mask, ++d) \
+		if (d >= UINT8_MAX) \
+			return -1; \
+	for (;;) { \
+		if (!table->dists[i]) { \
+			table->entries[i] = entry; \
+			table->dists[i] = dist; \
+			++table->size; \
+			return 0; \
+		} \
+		/* Robin Hood: the entry further from home keeps the slot */ \
+		if (table->dists[i] < dist) { \
+			Entry displaced = table->entries[i]; \
+			unsigned displaced_dist = table->dists[i]; \
+			table->entries[i] = entry; \
+			table->dists[i] = dist; \
+			entry = displaced; \
+			dist = displaced_dist; \
+		} \
+		i = (i + 1) & mask; \
+		++dist; \
+	} \
+} \
+\
+/* Removes the entry in a slot by shifting the rest of its cluster back */ \
+static inline void prefix##_table_erase(struct Name##Table *table, \
+	size_t index) \
+{ \
+	size_t mask = table->capacity - 1; \
+	size_t next = (index + 1) & mask; \
+	while (table->dists[next] > 1) { \
+		table->entries[index] = table->entries[next]; \
+		table->dists[index] = table->dists[next] - 1; \
+		index = next; \
+		next = (next + 1) & mask; \
+	} \
+	table->dists[index] = 0; \
+	--table->size; \
+} \
+\
+/* Moves entries from the old table into the live one, visiting at most \
+ * `steps` old slots. Fails if an entry couldn't be moved, which then stays \
+ * in the old table. */ \
+static inline int prefix##_migrate(struct Name *map, size_t steps) \
+{ \
+	struct Name##Table *old = &map->old; \
+	if (!old->entries) \
+		return 0; \
+	while (steps-- && old->size) { \
+		size_t i = map->migrate_index; \
+		/* Erasing shifts the next entry of the cluster into slot i, \
+		 * so the index only advances past empty slots */ \
+		while (old->dists[i]) { \
+			if (prefix##_table_insert(&map->live, \
+				old->entries[i]) < 0) { \
+				g_error_message = "hashmap probe too long"; \
+				return -1; \
+			} \
+			prefix##_table_erase(old, i); \
+		} \
+		++map->migrate_index; \
+	} \
+	if (!old->size) \
+		prefix##_table_free(old); \
+	return 0; \
+} \
+\
+/* Replaces the live table with one twice its size and begins migrating \
+ * entries into it */ \
+static inline int prefix##_grow(struct Name *map) \
+{ \
+	/* Only one migration can be in flight at a time, and the old table \
+	 * still holds whatever didn't move if it can't finish */ \
+	if (prefix##_migrate(map, SIZE_MAX) < 0) \
+		return -1; \
+	struct Name##Table grown; \
+	if (prefix##_table_init(&grown, map->live.capacity * 2) < 0) \
+		return -1; \
+	prefix##_table_free(&map->old); \
+	map->old = map->live; \
+	map->live = grown; \
+	map->migrate_index = 0; \
+	return 0; \
+} \
+\
+/* Allocates an empty map with room for `capacity` entries under the load \
+ * factor */ \
+static inline struct Name *prefix##_create(size_t capacity) \
+{ \
+	struct Name *map = calloc(1, sizeof(*map)); \
+	if (!map) { \
+		g_error_message = "malloc failed"; \
+		return NULL; \
+	} \
+	size_t slots = TYPED_MAP_MIN_CAPACITY; \
+	while (slots * TYPED_MAP_LOAD_NUM / TYPED_MAP_LOAD_DEN < capacity) \
+		slots *= 2; \
+	if (prefix##_table_init(&map->live, slots) < 0) { \
+		free(map); \
+		return NULL; \
+	} \
+	return map; \
+} \
+\
+static inline void prefix##_destroy(struct Name *map) \
+{ \
+	if (!map) \
+		return; \
+	prefix##_table_free(&map->live); \
+	prefix##_table_free(&map->old); \
+	free(map); \
+} \
+\
+static inline Entry *prefix##_lookup(struct Name *map, const Key *key, \
+	uint64_t hash) \
+{ \
+	Entry *entry = prefix##_table_find(&map->live, key, hash); \
+	if (!entry && map->old.size) \
+		entry = prefix##_table_find(&map->old, key, hash); \
+	return entry; \
+} \
+\
+/* Inserts an entry whose key isn't in the map yet */ \
+static inline int prefix##_insert(struct Name *map, Entry entry) \
+{ \
+	struct Name##Table *live = &map->live; \
+	if ((live->size + 1) * TYPED_MAP_LOAD_DEN > \
+		live->capacity * TYPED_MAP_LOAD_NUM && \
+		prefix##_grow(map) < 0) \
+		return -1; \
+	/* An insert only fails when a probe sequence gets too long to \
+	 * record, which a bigger table fixes */ \
+	while (prefix##_table_insert(&map->live, entry) < 0) \
+		if (prefix##_grow(map) < 0) \
+			return -1; \
+	prefix##_migrate(map, TYPED_MAP_MIGRATE_STEP); \
+	return 0; \
+} \
+\
+static inline void prefix##_erase(struct Name *map, const Key *key, \
+	uint64_t hash) \
+{ \
+	struct Name##Table *tables[] = {&map->live, &map->old}; \
+	for (int i = 0; i < 2; ++i) { \
+		Entry *entry = prefix##_table_find(tables[i], key, hash); \
+		if (entry) { \
+			prefix##_table_erase(tables[i], \
+				entry - tables[i]->entries); \
+			break; \
+		} \
+	} \
+	prefix##_migrate(map, TYPED_MAP_MIGRATE_STEP); \
+} \
+\
+/* Finds the next entry at or after a position, where table 0 is the live \
+ * table and 1 the one being migrated out of, and leaves the position just \
+ * past it */ \
+static inline Entry *prefix##_next(struct Name *map, int *table, \
+	size_t *index) \
+{ \
+	while (*table < 2) { \
+		struct Name##Table *t = (*table == 0) \
+			? &map->live : &map->old; \
+		while (*index < t->capacity) { \
+			size_t i = (*index)++; \
+			if (t->dists[i]) \
+				return &t->entries[i]; \
+		} \
+		++*table; \
+		*index = 0; \
+	} \
+	return NULL; \
+}
+
+#define TYPED_MAP_DEFINE(scope, Name, prefix, Key, Value, hash_fn) \
+static inline uint64_t prefix##_entry_hash(const struct Name##Entry *entry) \
+{ \
+	return hash_fn(entry->key); \
+} \
+\
+/* Keys have no padding, so this is one fixed-width compare */ \
+static inline bool prefix##_entry_matches(const struct Name##Entry *entry, \
+	const Key *key, uint64_t hash) \
+{ \
+	(void) hash; \
+	return memcmp(&entry->key, key, sizeof(Key)) == 0; \
+} \
+\
+TYPED_MAP_TABLE_DEFINE(Name, prefix, struct Name##Entry, Key, \
+	prefix##_entry_hash, prefix##_entry_matches) \
+\
+scope Name prefix##_new(size_t capacity) \
+{ \
+	return prefix##_create(capacity); \
+} \
+\
+scope void prefix##_free(Name map) \
+{ \
+	prefix##_destroy(map); \
+} \
+\
+scope Value *prefix##_get(Name map, Key key) \
+{ \
+	struct Name##Entry *entry = \
+		prefix##_lookup(map, &key, hash_fn(key)); \
+	return entry ? &entry->value : NULL; \
+} \
+\
+scope int prefix##_put(Name map, Key key, Value value) \
+{ \
+	Value *existing = prefix##_get(map, key); \
+	if (existing) { \
+		*existing = value; \
+		return 0; \
+	} \
+	return prefix##_insert(map, \
+		(struct Name##Entry) {.key = key, .value = value}); \
+} \
+\
+scope void prefix##_remove(Name map, Key key) \
+{ \
+	prefix##_erase(map, &key, hash_fn(key)); \
+} \
+\
+scope size_t prefix##_size(Name map) \
+{ \
+	return map ? map->live.size + map->old.size : 0; \
+} \
+\
+/* Scans every slot, so this isn't meant to be called often */ \
+scope void prefix##_stats(Name map, struct TypedMapStats *stats) \
+{ \
+	memset(stats, 0, sizeof(*stats)); \
+	if (!map) \
+		return; \
+	stats->size = prefix##_size(map); \
+	stats->capacity = map->live.capacity; \
+	const struct Name##Table *tables[] = {&map->live, &map->old}; \
+	for (int t = 0; t < 2; ++t) \
+		for (size_t i = 0; i < tables[t]->capacity; ++i) \
+			if (tables[t]->dists[i] > stats->max_probe) \
+				stats->max_probe = tables[t]->dists[i]; \
+} \
+\
+scope void prefix##_iterator_init(struct Name##Iterator *it, Name map) \
+{ \
+	it->map = map; \
+	it->table = 0; \
+	it->index = 0; \
+} \
+\
+scope struct Name##Entry *prefix##_iterate(struct Name##Iterator *it) \
+{ \
+	if (!it->map) \
+		return NULL; \
+	return prefix##_next(it->map, &it->table, &it->index); \
+}
+
+#endif // TYPEDMAP_H
@@ -7,20 +7,39 @@
 #include "entity.h"
 #include "macros.h"
 #include "globals.h"
+#include "trace.h"
+
+TYPED_MAP_DEFINE(, ChunkMap, chunkmap, struct ChunkKey, Chunk, chunk_key_hash)
+
+// How many tiles past a box world_query_free_shift_* look for free space
+#define FREE_SHIFT_SEARCH 4
+
+// The indices of every uniform chunk. It is never written, since a chunk with
+// 0 bits per index has no index to change.
+static uint8_t uniform_indices[1];
+
+static Chunk world_touch_chunk(World world, int64_t cx, int64_t cy);
+static Chunk world_unshare_chunk(World world, Chunk chunk);
+static int world_note_change(World world, Chunk chunk);
+static int chunk_alloc(Chunk chunk, unsigned bits);
+static void chunk_make_uniform(Chunk chunk, enum BlockID tile);
+static int chunk_palette_index(Chunk chunk, enum BlockID tile,
+	int overwritten);
+static int chunk_repack(Chunk chunk, unsigned bits, const uint8_t *remap,
+	const uint16_t *palette, unsigned len);
+static unsigned chunk_get_index(Chunk chunk, int i);
+static void chunk_set_index(Chunk chunk, int i, unsigned index);
 
 /**
- * Hashes a pair of numbers using the Elegant Pairing function
- * http://szudzik.com/ElegantPairing.pdf (pg.8)
- * @param x The x coordinate
- * @param y The y coordinate
+ * Hashes a pair of chunk coordinates
+ * The maps scramble hashes again before use, so this only has to make every
+ * coordinate pair distinct.
+ * @param key The chunk coordinates
  * @return The hashed value
  */
-size_t hash_coordinate(int64_t x, int64_t y)
+uint64_t chunk_key_hash(struct ChunkKey key)
 {
-	uint64_t ux = x;
-	uint64_t uy = y;
-
-	return ux + ((ux >= uy) ? ux * ux + uy : uy * uy);
+	return (uint64_t) key.cx * 0xD6E8FEB86659FD93ull ^ (uint64_t) key.cy;
 }
 
 /**
@@ -32,17 +51,18 @@ World world_new(void)
 	World world = malloc(sizeof(*world));
 	if (!world)
 		return NULL;
-	world->chunkmap = hashmap_new(512);
+	world->chunkmap = chunkmap_new(512);
 	if (!world->chunkmap) {
 		free(world);
 		return NULL;
 	}
-	world->entitymap = hashmap_new(512);
-	if (!world->entitymap) {
-		hashmap_free(world->chunkmap);
-		free(world);
-		return NULL;
-	}
+	entity_pool_init(&world->entities);
+	memset(&world->stats, 0, sizeof(world->stats));
+	chunkmap_iterator_init(&world->compact_it, world->chunkmap);
+	world->track_changes = false;
+	world->changes = NULL;
+	world->num_changes = 0;
+	world->changes_capacity = 0;
 	return world;
 }
 
@@ -57,17 +77,17 @@ void world_free(World world)
 		return;
 
 	// Free all chunks by iterating hash map
-	struct HashMapIterator it;
-	struct HashMapNode *entry;
-	hashmap_iterator_init(&it, world->chunkmap);
-	while ((entry = hashmap_iterate(&it)))
-		chunk_free(entry->value);
-	hashmap_free(world->chunkmap);
+	struct ChunkMapIterator chunk_it;
+	struct ChunkMapEntry *chunk_entry;
+	chunkmap_iterator_init(&chunk_it, world->chunkmap);
+	while ((chunk_entry = chunkmap_iterate(&chunk_it)))
+		chunk_free(chunk_entry->value);
+	chunkmap_free(world->chunkmap);
 
-	hashmap_iterator_init(&it, world->entitymap);
-	while ((entry = hashmap_iterate(&it)))
-		entity_free(entry->value);
-	hashmap_free(world->entitymap);
+	entity_pool_free(&world->entities);
+
+	free(world->changes);
+	free(world);
 }
 
 /**
@@ -82,13 +102,12 @@ Chunk world_get_chunk(World world, int64_t cx, int64_t cy)
 	if (!world)
 		return NULL;
 
-	size_t hash = hash_coordinate(cx, cy);
-	int64_t key[] = {cx, cy};
-
-	Chunk *ptr = (Chunk *)
-		hashmap_get(world->chunkmap, key, sizeof(key), hash);
+	++world->stats.chunk_lookups;
+	Chunk *ptr = chunkmap_get(world->chunkmap,
+		(struct ChunkKey) {cx, cy});
 	if (!ptr)
 		return NULL;
+	(*ptr)->last_used = world->stats.chunk_lookups;
 	return *ptr;
 }
 
@@ -103,10 +122,124 @@ int world_put_chunk(World world, Chunk chunk)
 	if (!world || !chunk)
 		return -1;
 
-	size_t hash = hash_coordinate(chunk->cx, chunk->cy);
-	// The key and key_size fields happen to be the same size as cx & cy
-	return hashmap_put(world->chunkmap, chunk->cxy, sizeof(chunk->cxy),
-		chunk, hash);
+	if (chunkmap_put(world->chunkmap,
+		(struct ChunkKey) {chunk->cx, chunk->cy}, chunk) < 0)
+		return -1;
+	return world_note_change(world, chunk);
+}
+
+/**
+ * Takes a chunk out of the world without freeing it, listing it as a change so
+ * that its removal is passed on like any other
+ * @param world The world
+ * @param chunk The chunk, which must be in the world and mustn't be shared
+ * @return 0 on success and a negative value on error
+ */
+int world_remove_chunk(World world, Chunk chunk)
+{
+	if (!world || !chunk)
+		return -1;
+
+	if (world_note_change(world, chunk) < 0)
+		return -1;
+	chunkmap_remove(world->chunkmap,
+		(struct ChunkKey) {chunk->cx, chunk->cy});
+	return 0;
+}
+
+/**
+ * Starts listing the chunks that are put into the world or have tiles changed
+ * through it, so that the changes can be passed on elsewhere
+ * Changes made by calling the chunk_* functions on a chunk directly aren't
+ * listed.
+ * @param world The world
+ */
+void world_track_changes(World world)
+{
+	world->track_changes = true;
+}
+
+/**
+ * Adds a chunk to the world's change list if it isn't there already
+ * @param world The world
+ * @param chunk The chunk that changed
+ * @return 0 on success and a negative value on error
+ */
+static int world_note_change(World world, Chunk chunk)
+{
+	if (!world->track_changes || chunk->flags & CHUNK_CHANGE_LISTED)
+		return 0;
+
+	if (world->num_changes == world->changes_capacity) {
+		size_t capacity = world->changes_capacity
+			? world->changes_capacity * 2 : 64;
+		struct ChunkKey *changes = realloc(world->changes,
+			capacity * sizeof(*changes));
+		if (!changes) {
+			g_error_message = "malloc failed";
+			return -1;
+		}
+		world->changes = changes;
+		world->changes_capacity = capacity;
+	}
+	world->changes[world->num_changes++] =
+		(struct ChunkKey) {chunk->cx, chunk->cy};
+	chunk->flags |= CHUNK_CHANGE_LISTED;
+	return 0;
+}
+
+/**
+ * Empties the world's change list, after which changed chunks are listed again
+ * @param world The world
+ */
+void world_clear_changes(World world)
+{
+	for (size_t i = 0; i < world->num_changes; ++i) {
+		Chunk chunk = world_get_chunk(world, world->changes[i].cx,
+			world->changes[i].cy);
+		if (chunk)
+			chunk->flags &= ~CHUNK_CHANGE_LISTED;
+	}
+	world->num_changes = 0;
+}
+
+/**
+ * Compacts some of the chunks changed since they were last compacted, folding
+ * ones that became a single block back into the uniform representation
+ * This is meant to be called every frame, and picks up where the last call
+ * left off.
+ * @param world The world
+ * @param max_chunks The most chunks to look at in this call
+ * @return 0 on success and a negative value on error
+ */
+int world_compact_step(World world, size_t max_chunks)
+{
+	if (!world)
+		return -1;
+
+	// The iterator is kept between calls, during which chunks may have
+	// been added. That can make it skip or revisit some chunks, which only
+	// delays their compaction until the next sweep.
+	while (max_chunks--) {
+		struct ChunkMapEntry *entry =
+			chunkmap_iterate(&world->compact_it);
+		if (!entry) {
+			chunkmap_iterator_init(&world->compact_it,
+				world->chunkmap);
+			break;
+		}
+
+		// Shared chunks are left for a later sweep
+		Chunk chunk = entry->value;
+		if (!(chunk->flags & CHUNK_UNCOMPACTED) ||
+			chunk->flags & CHUNK_SHARED)
+			continue;
+		if (chunk_compact(chunk) < 0)
+			return -1;
+		if (chunk_is_uniform(chunk))
+			++world->stats.chunks_folded;
+	}
+	return 0;
 }
 
 /**
@@ -125,13 +258,57 @@ Chunk chunk_new(int64_t cx, int64_t cy)
 
 	chunk->cx = cx;
 	chunk->cy = cy;
+	// A new chunk may land at the address of one the renderer drew
+	chunk->flags = CHUNK_RENDER_DIRTY;
+	chunk->bits = 0;
+	chunk->last_used = 0;
 
 	// Chunks by default contain only air
-	chunk_fill(chunk, TILE_AIR);
+	chunk_make_uniform(chunk, TILE_AIR);
 
 	return chunk;
 }
 
+/**
+ * Gives a chunk new, uninitialized storage without freeing the old one
+ * @param chunk The chunk
+ * @param bits The number of bits per tile index, which can't be 0
+ * @return 0 on success and a negative value on error
+ */
+static int chunk_alloc(Chunk chunk, unsigned bits)
+{
+	size_t palette_size = sizeof(*chunk->palette) << bits;
+	uint16_t *palette = malloc(palette_size + CHUNK_AREA * bits / 8);
+	if (!palette) {
+		g_error_message = "malloc failed";
+		return -1;
+	}
+
+	chunk->palette = palette;
+	chunk->indices = (uint8_t *) palette + palette_size;
+	chunk->bits = bits;
+	chunk->palette_len = 0;
+	return 0;
+}
+
+/**
+ * Frees the storage of a chunk and makes every tile the same block
+ * @param chunk The chunk
+ * @param tile The block
+ */
+static void chunk_make_uniform(Chunk chunk, enum BlockID tile)
+{
+	if (chunk->bits)
+		free(chunk->palette);
+	chunk->bits = 0;
+	chunk->uniform = tile;
+	chunk->palette = &chunk->uniform;
+	chunk->palette_len = 1;
+	chunk->indices = uniform_indices;
+	memset(chunk->solid, block_is_solid(tile) ? 0xFF : 0,
+		sizeof(chunk->solid));
+}
+
 /**
  * Fills every tile in a chunk with a specified BlockID
  * @param chunk The chunk to fill
@@ -141,9 +318,326 @@ void chunk_fill(Chunk chunk, enum BlockID tile)
 {
 	if (!chunk)
 		return;
-	for (int i = 0; i < CHUNK_LENGTH; ++i)
-		for (int j = 0; j < CHUNK_LENGTH; ++j)
-			chunk->tiles[i][j] = tile;
+	chunk_make_uniform(chunk, tile);
+	chunk->flags &= ~CHUNK_UNCOMPACTED;
+	chunk->flags |= CHUNK_RENDER_DIRTY;
+}
+
+/**
+ * Fills a rectangle of tiles within a chunk
+ * @param chunk The chunk to fill
+ * @param rx1 The relative x-coordinate of the left column
+ * @param ry1 The relative y-coordinate of the bottom row
+ * @param rx2 The relative x-coordinate of the right column (inclusive)
+ * @param ry2 The relative y-coordinate of the top row (inclusive)
+ * @param tile The tile to use
+ * @return 0 on success and a negative value on error
+ */
+int chunk_fill_rect(Chunk chunk, int rx1, int ry1, int rx2, int ry2,
+	enum BlockID tile)
+{
+	if (!chunk)
+		return -1;
+	int index = chunk_palette_index(chunk, tile, ry1 * CHUNK_LENGTH + rx1);
+	if (index < 0)
+		return -1;
+	// The chunk is still uniform if it already was with this block
+	if (!chunk->bits)
+		return 0;
+
+	chunk->flags |= CHUNK_UNCOMPACTED | CHUNK_RENDER_DIRTY;
+	uint16_t columns = (uint16_t) (0xFFFFu << rx1) &
+		(uint16_t) (0xFFFFu >> (CHUNK_LENGTH - 1 - rx2));
+	for (int ry = ry1; ry <= ry2; ++ry) {
+		if (block_is_solid(tile))
+			chunk->solid[ry] |= columns;
+		else
+			chunk->solid[ry] &= ~columns;
+	}
+
+	if (rx1 == 0 && rx2 == CHUNK_LENGTH - 1) {
+		// Rows are a whole number of bytes, so whole rows can be set
+		// by repeating the index across a byte
+		const int row_size = CHUNK_LENGTH * chunk->bits / 8;
+		uint8_t pattern = index * (0xFF / ((1u << chunk->bits) - 1));
+		memset(chunk->indices + ry1 * row_size, pattern,
+			(ry2 - ry1 + 1) * row_size);
+		return 0;
+	}
+	for (int ry = ry1; ry <= ry2; ++ry)
+		for (int rx = rx1; rx <= rx2; ++rx)
+			chunk_set_index(chunk, ry * CHUNK_LENGTH + rx, index);
+	return 0;
+}
+
+/**
+ * Changes a tile of a chunk
+ * @param chunk The chunk
+ * @param rx The x-coordinate relative to the chunk
+ * @param ry The y-coordinate relative to the chunk
+ * @param tile The tile to use
+ * @return 0 on success and a negative value on error
+ */
+int chunk_set_tile(Chunk chunk, int rx, int ry, enum BlockID tile)
+{
+	int i = ry * CHUNK_LENGTH + rx;
+	int index = chunk_palette_index(chunk, tile, i);
+	if (index < 0)
+		return -1;
+	if (chunk->bits) {
+		chunk_set_index(chunk, i, index);
+		chunk->flags |= CHUNK_UNCOMPACTED | CHUNK_RENDER_DIRTY;
+		if (block_is_solid(tile))
+			chunk->solid[ry] |= 1u << rx;
+		else
+			chunk->solid[ry] &= ~(1u << rx);
+	}
+	return 0;
+}
+
+/**
+ * Replaces every tile of a chunk at once, packing them into the fewest bits
+ * that fit the blocks they contain
+ * This is much faster than setting the tiles one at a time, which may repack
+ * the chunk several times.
+ * @param chunk The chunk
+ * @param tiles The blocks of the chunk in row-major order, bottom row first
+ * @return 0 on success and a negative value on error
+ */
+int chunk_set_tiles(Chunk chunk, const uint16_t *tiles)
+{
+	// The palette in the order blocks first appear, and every tile's index
+	// into it
+	int16_t lookup[NUM_TILES];
+	uint16_t palette[1 << 8];
+	uint8_t indices[CHUNK_AREA];
+	unsigned len = 0;
+	memset(lookup, 0xFF, sizeof(lookup));
+	for (int i = 0; i < CHUNK_AREA; ++i) {
+		if (lookup[tiles[i]] < 0) {
+			lookup[tiles[i]] = len;
+			palette[len++] = tiles[i];
+		}
+		indices[i] = lookup[tiles[i]];
+	}
+
+	chunk->flags &= ~CHUNK_UNCOMPACTED;
+	chunk->flags |= CHUNK_RENDER_DIRTY;
+	if (len == 1) {
+		chunk_make_uniform(chunk, palette[0]);
+		return 0;
+	}
+
+	unsigned bits = 1;
+	while ((1u << bits) < len)
+		bits *= 2;
+	struct Chunk packed = *chunk;
+	if (chunk_alloc(&packed, bits) < 0)
+		return -1;
+	memcpy(packed.palette, palette, sizeof(*palette) * len);
+	packed.palette_len = len;
+	// Each byte is built whole rather than a tile at a time
+	const unsigned per_byte = 8 / bits;
+	for (int byte = 0; byte < CHUNK_AREA * (int) bits / 8; ++byte) {
+		unsigned value = 0;
+		for (unsigned k = 0; k < per_byte; ++k)
+			value |= indices[byte * per_byte + k] << (k * bits);
+		packed.indices[byte] = value;
+	}
+
+	memset(packed.solid, 0, sizeof(packed.solid));
+	for (int ry = 0; ry < CHUNK_LENGTH; ++ry)
+		for (int rx = 0; rx < CHUNK_LENGTH; ++rx)
+			if (block_is_solid(tiles[ry * CHUNK_LENGTH + rx]))
+				packed.solid[ry] |= 1u << rx;
+
+	if (chunk->bits)
+		free(chunk->palette);
+	*chunk = packed;
+	return 0;
+}
+
+/**
+ * Drops palette entries that no tile uses and repacks the tiles into the
+ * fewest bits that fit the rest, which folds chunks of a single block back
+ * into the uniform representation
+ * @param chunk The chunk
+ * @return 0 on success and a negative value on error
+ */
+int chunk_compact(Chunk chunk)
+{
+	chunk->flags &= ~CHUNK_UNCOMPACTED;
+	if (!chunk->bits)
+		return 0;
+
+	bool used[1 << 8] = {false};
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		used[chunk_get_index(chunk, i)] = true;
+
+	uint8_t remap[1 << 8];
+	uint16_t palette[1 << 8];
+	unsigned len = 0;
+	for (unsigned i = 0; i < chunk->palette_len; ++i)
+		if (used[i]) {
+			palette[len] = chunk->palette[i];
+			remap[i] = len++;
+		}
+
+	if (len == 1) {
+		chunk_make_uniform(chunk, palette[0]);
+		return 0;
+	}
+
+	unsigned bits = 1;
+	while ((1u << bits) < len)
+		bits *= 2;
+	if (len == chunk->palette_len && bits == chunk->bits)
+		return 0;
+	return chunk_repack(chunk, bits, remap, palette, len);
+}
+
+/**
+ * Finds the palette entry of a BlockID, adding one if the chunk doesn't
+ * contain the block yet
+ * A full palette is compacted, or repacked into more bits if every entry is in
+ * use.
+ * @param chunk The chunk
+ * @param tile The block
+ * @param overwritten A tile that is about to be set to the block
+ * @return The palette index, or a negative value on error
+ */
+static int chunk_palette_index(Chunk chunk, enum BlockID tile, int overwritten)
+{
+	for (int i = 0; i < chunk->palette_len; ++i)
+		if (chunk->palette[i] == tile)
+			return i;
+
+	if (chunk->palette_len == 1u << chunk->bits) {
+		if (chunk_compact(chunk) < 0)
+			return -1;
+	}
+	if (chunk->palette_len == 1u << chunk->bits && chunk->bits < 8) {
+		uint8_t remap[1 << 8];
+		for (unsigned i = 0; i < chunk->palette_len; ++i)
+			remap[i] = i;
+		unsigned bits = chunk->bits ? chunk->bits * 2 : 1;
+		if (chunk_repack(chunk, bits, remap, chunk->palette,
+			chunk->palette_len) < 0)
+			return -1;
+	}
+	if (chunk->palette_len == 1u << 8) {
+		// Every tile is a different block, so the entry of the tile
+		// being overwritten isn't used by any other
+		unsigned index = chunk_get_index(chunk, overwritten);
+		chunk->palette[index] = tile;
+		return index;
+	}
+
+	chunk->palette[chunk->palette_len] = tile;
+	return chunk->palette_len++;
+}
+
+/**
+ * Moves a chunk's tiles into new storage with a different palette
+ * @param chunk The chunk
+ * @param bits The new number of bits per tile index, which can't be 0
+ * @param remap The new palette index of every used old palette entry
+ * @param palette The new palette
+ * @param len The number of entries in the new palette
+ * @return 0 on success and a negative value on error
+ */
+static int chunk_repack(Chunk chunk, unsigned bits, const uint8_t *remap,
+	const uint16_t *palette, unsigned len)
+{
+	struct Chunk repacked = *chunk;
+	repacked.palette = NULL;
+	if (chunk_alloc(&repacked, bits) < 0)
+		return -1;
+
+	memcpy(repacked.palette, palette, sizeof(*palette) * len);
+	repacked.palette_len = len;
+
+	memset(repacked.indices, 0, CHUNK_AREA * bits / 8);
+	for (int i = 0; i < CHUNK_AREA; ++i)
+		chunk_set_index(&repacked, i, remap[chunk_get_index(chunk, i)]);
+
+	if (chunk->bits)
+		free(chunk->palette);
+	*chunk = repacked;
+	return 0;
+}
+
+/**
+ * Reads a packed palette index
+ * @param chunk The chunk
+ * @param i The tile's position in row-major order
+ * @return The palette index
+ */
+static unsigned chunk_get_index(Chunk chunk, int i)
+{
+	unsigned bit = i * chunk->bits;
+	return (chunk->indices[bit >> 3] >> (bit & 7)) &
+		((1u << chunk->bits) - 1);
+}
+
+/**
+ * Writes a packed palette index
+ * @param chunk The chunk
+ * @param i The tile's position in row-major order
+ * @param index The palette index
+ */
+static void chunk_set_index(Chunk chunk, int i, unsigned index)
+{
+	unsigned bit = i * chunk->bits;
+	unsigned mask = ((1u << chunk->bits) - 1) << (bit & 7);
+	uint8_t *byte = &chunk->indices[bit >> 3];
+	*byte = (*byte & ~mask) | ((index << (bit & 7)) & mask);
+}
+
+/**
+ * Measures how much memory a chunk takes up
+ * @param chunk The chunk
+ * @return The size in bytes of the chunk and its tile storage
+ */
+size_t chunk_memory(Chunk chunk)
+{
+	if (!chunk)
+		return 0;
+	if (!chunk->bits)
+		return sizeof(*chunk);
+	return sizeof(*chunk) + (sizeof(*chunk->palette) << chunk->bits) +
+		CHUNK_AREA * chunk->bits / 8;
+}
+
+/**
+ * Copies a chunk and its tiles
+ * @param chunk The chunk to copy
+ * @return The copy, or NULL if an error occurred
+ */
+Chunk chunk_copy(Chunk chunk)
+{
+	Chunk copy = malloc(sizeof(*copy));
+	if (!copy) {
+		g_error_message = "malloc failed";
+		return NULL;
+	}
+
+	*copy = *chunk;
+	// The copy is new to whichever world it's put in
+	copy->flags = (chunk->flags & CHUNK_UNCOMPACTED) | CHUNK_RENDER_DIRTY;
+	if (!chunk->bits) {
+		copy->palette = &copy->uniform;
+		return copy;
+	}
+
+	if (chunk_alloc(copy, chunk->bits) < 0) {
+		free(copy);
+		return NULL;
+	}
+	copy->palette_len = chunk->palette_len;
+	memcpy(copy->palette, chunk->palette,
+		chunk_memory(chunk) - sizeof(*chunk));
+	return copy;
 }
 
 /**
@@ -153,6 +647,7 @@ void chunk_fill(Chunk chunk, enum BlockID tile)
  */
 int world_generate_flat(World world)
 {
+	TRACE_ZONE("world_generate_flat");
 	if (!world)
 		return -1;
 
@@ -181,69 +676,349 @@ int world_generate_flat(World world)
  */
 int world_set_block(World world, int64_t x, int64_t y, enum BlockID tile)
 {
-	int64_t cx = floor(x / (double) CHUNK_LENGTH);
-	int64_t cy = floor(y / (double) CHUNK_LENGTH);
-	Chunk chunk = world_get_chunk(world, cx, cy);
+	struct WorldCursor cursor;
+	world_cursor_init(&cursor, world);
+	return world_cursor_set_block(&cursor, x, y, tile);
+}
+
+/**
+ * Get the block at (x, y) in the world
+ * @param world The world
+ * @param x The x-coordinate
+ * @param y The y-coordinate
+ * @return The block ID, or an air block if the chunk doesn't exist
+ */
+enum BlockID world_get_block(World world, int64_t x, int64_t y)
+{
+	struct WorldCursor cursor;
+	world_cursor_init(&cursor, world);
+	return world_cursor_get_block(&cursor, x, y);
+}
+
+/**
+ * Initializes a cursor that doesn't point at any chunk yet
+ * @param cursor The cursor to initialize
+ * @param world The world the cursor moves through
+ */
+void world_cursor_init(struct WorldCursor *cursor, World world)
+{
+	cursor->world = world;
+	cursor->chunk = NULL;
+	cursor->cx = 0;
+	cursor->cy = 0;
+	cursor->valid = false;
+}
+
+/**
+ * Points a cursor at the chunk containing a block, only looking the chunk up
+ * if it isn't the one the cursor is already in
+ * @param cursor The cursor
+ * @param x The block x-coordinate
+ * @param y The block y-coordinate
+ * @return The chunk, or NULL if it doesn't exist
+ */
+static inline Chunk world_cursor_seek(struct WorldCursor *cursor,
+	int64_t x, int64_t y)
+{
+	// Arithmetic shifts round towards negative infinity, like floor
+	int64_t cx = x >> CHUNK_SHIFT;
+	int64_t cy = y >> CHUNK_SHIFT;
+
+	if (!cursor->valid || cx != cursor->cx || cy != cursor->cy) {
+		cursor->chunk = world_get_chunk(cursor->world, cx, cy);
+		cursor->cx = cx;
+		cursor->cy = cy;
+		cursor->valid = true;
+	}
+	return cursor->chunk;
+}
+
+/**
+ * Change the block at (x, y), creating its chunk if it doesn't exist
+ * @param cursor The cursor to access the world through
+ * @param x The x-coordinate
+ * @param y The y-coordinate
+ * @param tile The tile to use
+ * @return 0 on success or a negative value on error
+ */
+int world_cursor_set_block(struct WorldCursor *cursor, int64_t x, int64_t y,
+	enum BlockID tile)
+{
+	Chunk chunk = world_cursor_seek(cursor, x, y);
 	if (!chunk) {
-		chunk = chunk_new(cx, cy);
+		chunk = world_touch_chunk(cursor->world, cursor->cx, cursor->cy);
 		if (!chunk)
 			return -1;
-		if (world_put_chunk(world, chunk) < 0)
+		cursor->chunk = chunk;
+	}
+	if (chunk->flags & CHUNK_SHARED) {
+		chunk = world_unshare_chunk(cursor->world, chunk);
+		if (!chunk)
 			return -1;
+		cursor->chunk = chunk;
 	}
-	int rx = x - cx * CHUNK_LENGTH;
-	int ry = y - cy * CHUNK_LENGTH;
-	chunk->tiles[ry][rx] = tile;
-	return 0;
+	if (chunk_set_tile(chunk, x & CHUNK_MASK, y & CHUNK_MASK, tile) < 0)
+		return -1;
+	chunk->flags |= CHUNK_MODIFIED;
+	return world_note_change(cursor->world, chunk);
 }
 
 /**
- * Get the block at (x, y) in the world
- * @param world The world
+ * Get the block at (x, y)
+ * @param cursor The cursor to access the world through
  * @param x The x-coordinate
  * @param y The y-coordinate
  * @return The block ID, or an air block if the chunk doesn't exist
  */
-enum BlockID world_get_block(World world, int64_t x, int64_t y)
+enum BlockID world_cursor_get_block(struct WorldCursor *cursor,
+	int64_t x, int64_t y)
 {
-	int64_t cx = floor(x / (double) CHUNK_LENGTH);
-	int64_t cy = floor(y / (double) CHUNK_LENGTH);
-	Chunk chunk = world_get_chunk(world, cx, cy);
+	Chunk chunk = world_cursor_seek(cursor, x, y);
 	if (!chunk)
 		return TILE_AIR;
-	int rx = x - cx * CHUNK_LENGTH;
-	int ry = y - cy * CHUNK_LENGTH;
-	return chunk->tiles[ry][rx];
+	return chunk_get_tile(chunk, x & CHUNK_MASK, y & CHUNK_MASK);
 }
 
 /**
- * Inserts an entity into the world
+ * Finds which rows of a region contain solid blocks
+ * Only the solidity bitboards of the chunks are read, a row of a chunk at a
+ * time.
  * @param world The world
- * @param entity The entity to insert into the world
- * @return 0 on success or a negative value on error
+ * @param x1 The x-coordinate of the left column
+ * @param y1 The y-coordinate of the bottom row
+ * @param x2 The x-coordinate of the right column (inclusive)
+ * @param y2 The y-coordinate of the top row (inclusive), at most 63 rows above
+ * 	y1
+ * @return A mask with bit (y - y1) set if row y has a solid block
  */
-int world_put_entity(World world, Entity entity)
+uint64_t world_query_solid_rows(World world, int64_t x1, int64_t y1,
+	int64_t x2, int64_t y2)
 {
-	return hashmap_put(world->entitymap, entity->uuid, sizeof(entity->uuid),
-		entity, entity_hash(entity));
+	uint64_t rows = 0;
+	if (!world || x2 < x1 || y2 < y1 || y2 - y1 >= 64)
+		return 0;
+
+	for (int64_t cy = y1 >> CHUNK_SHIFT; cy <= y2 >> CHUNK_SHIFT; ++cy) {
+		int ry1 = (cy == y1 >> CHUNK_SHIFT) ? (y1 & CHUNK_MASK) : 0;
+		int ry2 = (cy == y2 >> CHUNK_SHIFT)
+			? (y2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+
+		for (int64_t cx = x1 >> CHUNK_SHIFT; cx <= x2 >> CHUNK_SHIFT;
+			++cx) {
+			Chunk chunk = world_get_chunk(world, cx, cy);
+			if (!chunk)
+				continue;
+
+			int rx1 = (cx == x1 >> CHUNK_SHIFT) ? (x1 & CHUNK_MASK) : 0;
+			int rx2 = (cx == x2 >> CHUNK_SHIFT)
+				? (x2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+			uint16_t columns = (uint16_t) (0xFFFFu << rx1) &
+				(uint16_t) (0xFFFFu >> (CHUNK_LENGTH - 1 - rx2));
+
+			for (int ry = ry1; ry <= ry2; ++ry)
+				if (chunk->solid[ry] & columns)
+					rows |= 1ull <<
+						(cy * CHUNK_LENGTH + ry - y1);
+		}
+	}
+	return rows;
+}
+
+/**
+ * Finds which columns of a region contain solid blocks
+ * @param world The world
+ * @param x1 The x-coordinate of the left column
+ * @param y1 The y-coordinate of the bottom row
+ * @param x2 The x-coordinate of the right column (inclusive), at most 63
+ * 	columns right of x1
+ * @param y2 The y-coordinate of the top row (inclusive)
+ * @return A mask with bit (x - x1) set if column x has a solid block
+ */
+uint64_t world_query_solid_columns(World world, int64_t x1, int64_t y1,
+	int64_t x2, int64_t y2)
+{
+	uint64_t columns = 0;
+	if (!world || x2 < x1 || y2 < y1 || x2 - x1 >= 64)
+		return 0;
+
+	for (int64_t cx = x1 >> CHUNK_SHIFT; cx <= x2 >> CHUNK_SHIFT; ++cx) {
+		int rx1 = (cx == x1 >> CHUNK_SHIFT) ? (x1 & CHUNK_MASK) : 0;
+		int rx2 = (cx == x2 >> CHUNK_SHIFT)
+			? (x2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+		uint16_t mask = (uint16_t) (0xFFFFu << rx1) &
+			(uint16_t) (0xFFFFu >> (CHUNK_LENGTH - 1 - rx2));
+
+		for (int64_t cy = y1 >> CHUNK_SHIFT; cy <= y2 >> CHUNK_SHIFT;
+			++cy) {
+			Chunk chunk = world_get_chunk(world, cx, cy);
+			if (!chunk)
+				continue;
+
+			int ry1 = (cy == y1 >> CHUNK_SHIFT) ? (y1 & CHUNK_MASK) : 0;
+			int ry2 = (cy == y2 >> CHUNK_SHIFT)
+				? (y2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+
+			uint16_t solid = 0;
+			for (int ry = ry1; ry <= ry2; ++ry)
+				solid |= chunk->solid[ry];
+			solid &= mask;
+
+			// Line the chunk's columns up with the region's
+			int64_t offset = cx * CHUNK_LENGTH - x1;
+			columns |= (offset >= 0)
+				? (uint64_t) solid << offset
+				: (uint64_t) solid >> -offset;
+		}
+	}
+	return columns;
+}
+
+/**
+ * Checks whether any block in a region is solid
+ * @param world The world
+ * @param x1 The x-coordinate of the left column
+ * @param y1 The y-coordinate of the bottom row
+ * @param x2 The x-coordinate of the right column (inclusive)
+ * @param y2 The y-coordinate of the top row (inclusive)
+ * @return Whether a solid block overlaps the region
+ */
+bool world_query_solid_aabb(World world, int64_t x1, int64_t y1, int64_t x2,
+	int64_t y2)
+{
+	// Regions are checked in bands of 64 rows, which is only ever one for
+	// entity hitboxes
+	for (int64_t y = y1; y <= y2; y += 64) {
+		int64_t band_top = (y2 - y < 64) ? y2 : y + 63;
+		if (world_query_solid_rows(world, x1, y, x2, band_top))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Finds the shortest distance a box has to move along one axis to stop
+ * overlapping solid blocks, given which tiles along that axis are solid
+ * @param lanes Bit i is set if the lane (row or column) base + i is solid
+ * @param base The coordinate of the first lane in lanes
+ * @param low The low edge of the box on this axis
+ * @param high The high edge of the box on this axis
+ * @return The signed distance, or 0 if none is needed or none was found
+ */
+static double free_shift(uint64_t lanes, int64_t base, double low, double high)
+{
+	int64_t first = floor(low);
+	int64_t last = (int64_t) ceil(high) - 1;
+	// The number of lanes the box covers once it's aligned to the grid
+	int n = ceil(high - low);
+	if (n < 1 || n + 2 * FREE_SHIFT_SEARCH > 64)
+		return 0.0;
+	uint64_t box = (1ull << n) - 1;
+	int64_t end = base + n + 2 * FREE_SHIFT_SEARCH;
+
+	if (!((lanes >> (first - base)) & ((1ull << (last - first + 1)) - 1)))
+		return 0.0;
+
+	double best = 0.0;
+	// Move towards higher coordinates, with the low edge on a lane border
+	for (int64_t b = first + 1; b + n <= end; ++b)
+		if (!((lanes >> (b - base)) & box)) {
+			best = b - low;
+			break;
+		}
+	// Move towards lower coordinates, with the high edge on a lane border
+	for (int64_t t = last; t - n >= base; --t)
+		if (!((lanes >> (t - n - base)) & box)) {
+			if (best == 0.0 || t - high > -best)
+				best = t - high;
+			break;
+		}
+	return best;
+}
+
+/**
+ * Finds the shortest horizontal move that frees a box from solid blocks
+ * Touching a block doesn't count as overlapping it.
+ * @param world The world
+ * @param x1 The left edge of the box
+ * @param y1 The bottom edge of the box
+ * @param x2 The right edge of the box
+ * @param y2 The top edge of the box
+ * @return The signed distance to move, or 0 if the box is already free
+ */
+double world_query_free_shift_x(World world, double x1, double y1, double x2,
+	double y2)
+{
+	int64_t base = (int64_t) floor(x1) - FREE_SHIFT_SEARCH;
+	int64_t end = base + (int64_t) ceil(x2 - x1) + 2 * FREE_SHIFT_SEARCH;
+	uint64_t columns = world_query_solid_columns(world, base, floor(y1),
+		end - 1, (int64_t) ceil(y2) - 1);
+	return free_shift(columns, base, x1, x2);
+}
+
+/**
+ * Finds the shortest vertical move that frees a box from solid blocks
+ * Touching a block doesn't count as overlapping it.
+ * @param world The world
+ * @param x1 The left edge of the box
+ * @param y1 The bottom edge of the box
+ * @param x2 The right edge of the box
+ * @param y2 The top edge of the box
+ * @return The signed distance to move, or 0 if the box is already free
+ */
+double world_query_free_shift_y(World world, double x1, double y1, double x2,
+	double y2)
+{
+	int64_t base = (int64_t) floor(y1) - FREE_SHIFT_SEARCH;
+	int64_t end = base + (int64_t) ceil(y2 - y1) + 2 * FREE_SHIFT_SEARCH;
+	uint64_t rows = world_query_solid_rows(world, floor(x1), base,
+		(int64_t) ceil(x2) - 1, end - 1);
+	return free_shift(rows, base, y1, y2);
 }
 
 /**
  * Fills a region of blocks
+ * The region is split along chunk borders, so every chunk it touches is only
+ * looked up once and chunks it covers entirely are filled in one go.
  * @param world The world
- * @param x The x-coordinate of the top-left point
- * @param y The y-coordinate of the top-left point
- * @param w The width of the region
- * @param h The height of the region
+ * @param x1 The x-coordinate of the left column
+ * @param y1 The y-coordinate of the bottom row
+ * @param x2 The x-coordinate of the right column (inclusive)
+ * @param y2 The y-coordinate of the top row (inclusive)
  * @param block The BlockID to fill
  * @return 0 on success or a negative value on error
  */
 int world_fill_block(World world, int64_t x1, int64_t y1, int64_t x2, int64_t y2,
 	enum BlockID block)
 {
-	for (int64_t y = y1; y <= y2; ++y) {
-		for (int64_t x = x1; x <= x2; ++x) {
-			if (world_set_block(world, x, y, block) < 0)
+	if (!world)
+		return -1;
+
+	for (int64_t cy = y1 >> CHUNK_SHIFT; cy <= y2 >> CHUNK_SHIFT; ++cy) {
+		// The part of the region within this row of chunks
+		int ry1 = (cy == y1 >> CHUNK_SHIFT) ? (y1 & CHUNK_MASK) : 0;
+		int ry2 = (cy == y2 >> CHUNK_SHIFT)
+			? (y2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+
+		for (int64_t cx = x1 >> CHUNK_SHIFT; cx <= x2 >> CHUNK_SHIFT;
+			++cx) {
+			int rx1 = (cx == x1 >> CHUNK_SHIFT) ? (x1 & CHUNK_MASK) : 0;
+			int rx2 = (cx == x2 >> CHUNK_SHIFT)
+				? (x2 & CHUNK_MASK) : CHUNK_LENGTH - 1;
+
+			Chunk chunk = world_touch_chunk(world, cx, cy);
+			if (chunk)
+				chunk = world_unshare_chunk(world, chunk);
+			if (!chunk)
+				return -1;
+
+			if (rx1 == 0 && ry1 == 0 && rx2 == CHUNK_LENGTH - 1 &&
+				ry2 == CHUNK_LENGTH - 1)
+				chunk_fill(chunk, block);
+			else if (chunk_fill_rect(chunk, rx1, ry1, rx2, ry2,
+				block) < 0)
+				return -1;
+			chunk->flags |= CHUNK_MODIFIED;
+			if (world_note_change(world, chunk) < 0)
 				return -1;
 		}
 	}
@@ -251,12 +1026,63 @@ int world_fill_block(World world, int64_t x1, int64_t y1, int64_t x2, int64_t y2
 	return 0;
 }
 
+/**
+ * Gets a chunk, creating an empty one if it doesn't exist yet
+ * @param world The world
+ * @param cx The chunk x-coordinate
+ * @param cy The chunk y-coordinate
+ * @return The chunk, or NULL if an error occurred
+ */
+static Chunk world_touch_chunk(World world, int64_t cx, int64_t cy)
+{
+	Chunk chunk = world_get_chunk(world, cx, cy);
+	if (chunk)
+		return chunk;
+
+	chunk = chunk_new(cx, cy);
+	if (!chunk)
+		return NULL;
+	if (world_put_chunk(world, chunk) < 0) {
+		chunk_free(chunk);
+		return NULL;
+	}
+	return chunk;
+}
+
+/**
+ * Puts a copy of a shared chunk in its place in the world, leaving the
+ * original to the save reading it
+ * @param world The world
+ * @param chunk The chunk, which must be in the world
+ * @return The chunk now in the world, which is the chunk itself if it wasn't
+ * 	shared, or NULL if an error occurred
+ */
+static Chunk world_unshare_chunk(World world, Chunk chunk)
+{
+	if (!(chunk->flags & CHUNK_SHARED))
+		return chunk;
+
+	Chunk copy = chunk_copy(chunk);
+	if (!copy)
+		return NULL;
+	copy->flags = chunk->flags & ~CHUNK_SHARED;
+	*chunkmap_get(world->chunkmap,
+		(struct ChunkKey) {chunk->cx, chunk->cy}) = copy;
+	chunk->flags |= CHUNK_DETACHED;
+	++world->stats.chunks_unshared;
+	return copy;
+}
+
 /**
  * Releases all memory allocated for a chunk by chunk_new
  * @param chunk The chunk to free
  */
 void chunk_free(Chunk chunk)
 {
+	if (!chunk)
+		return;
+	if (chunk->bits)
+		free(chunk->palette);
 	free(chunk);
 }
 
@@ -3,8 +3,9 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "hashmap.h"
+#include "typedmap.h"
 #include "entity.h"
+#include "block.h"
 
 // -x -> +x
 
@@ -14,51 +15,175 @@
 
 // Chunks are square
 #define CHUNK_LENGTH 16
+// Block coordinates are split into chunk and relative coordinates with these
+// rather than dividing, so CHUNK_LENGTH must stay a power of two
+#define CHUNK_SHIFT 4
+#define CHUNK_MASK (CHUNK_LENGTH - 1)
 
-enum BlockID {
-	TILE_DIRT = 0,
-	TILE_GRASS,
-	TILE_AIR,
-	TILE_LOG,
-	TILE_UNBREAKABLE_ROCK,
-	NUM_TILES
-};
+#define CHUNK_AREA (CHUNK_LENGTH * CHUNK_LENGTH)
 
-typedef struct {
+// Tiles aren't stored as BlockIDs. Each chunk has a palette of the BlockIDs it
+// contains, and every tile is an index into that palette packed into 1, 2, 4
+// or 8 bits, whichever is the smallest that fits the palette. With 8 bits
+// every tile can be a different block, so the palette never needs more.
+//
+// A chunk where every tile is the same block uses 0 bits and allocates nothing:
+// palette points at `uniform` and indices at a shared zero byte. Its first
+// differing tile repacks it into 1 bit, and chunk_compact folds it back.
+struct Chunk {
 	// These are chunk coordinates (adjacent chunks increment each
 	// coordinate)
-	union {
-		struct {
-			int64_t cx, cy;
-		};
-		// This is just an alias to the bytes representing cx and cy.
-		const uint8_t cxy[16];
-	};
-	enum BlockID tiles[CHUNK_LENGTH][CHUNK_LENGTH];
-} *Chunk;
+	int64_t cx, cy;
+	// Bits per packed tile index
+	uint8_t bits;
+	// A combination of ChunkFlags
+	uint8_t flags;
+	// The number of palette entries in use, out of 1 << bits
+	uint16_t palette_len;
+	// The palette of a uniform chunk
+	uint16_t uniform;
+	// Both arrays share one allocation, which starts at palette
+	uint16_t *palette;
+	// Tiles in row-major order, with the lowest bits of each byte holding
+	// the leftmost tile
+	uint8_t *indices;
+	// Bit rx of solid[ry] is set if that tile is solid, kept in step with
+	// the tiles so that collision checks never have to decode them
+	uint16_t solid[CHUNK_LENGTH];
+	// When the chunk was last looked up in its world, as the world's
+	// stats.chunk_lookups at the time, so that the least recently used
+	// chunks can be unloaded first
+	uint64_t last_used;
+};
+
+typedef struct Chunk *Chunk;
+
+enum ChunkFlags {
+	// Tiles changed since the chunk was last compacted
+	CHUNK_UNCOMPACTED = 1 << 0,
+	// Tiles changed since the renderer last drew the chunk, which it
+	// clears after drawing it again
+	CHUNK_RENDER_DIRTY = 1 << 1,
+	// The chunk is in its world's change list (see world_track_changes)
+	CHUNK_CHANGE_LISTED = 1 << 2,
+	// Tiles changed through the world since the chunk was generated or
+	// saved, so it has to be saved before it's unloaded
+	CHUNK_MODIFIED = 1 << 3,
+	// A save in progress is reading the chunk, so its tiles mustn't
+	// change and it mustn't be freed. Changing it through its world puts
+	// a copy in its place instead.
+	CHUNK_SHARED = 1 << 4,
+	// A shared chunk that a copy took the place of in its world, which the
+	// save frees once it's done with it
+	CHUNK_DETACHED = 1 << 5,
+};
+
+struct ChunkKey {
+	int64_t cx, cy;
+};
+
+TYPED_MAP_DECLARE(, ChunkMap, chunkmap, struct ChunkKey, Chunk)
+
+// Counters that are only ever incremented, for profiling
+struct WorldStats {
+	uint64_t chunk_lookups;
+	// Chunks folded back into the uniform representation
+	uint64_t chunks_folded;
+	// Shared chunks copied so that they could be changed
+	uint64_t chunks_unshared;
+};
 
 typedef struct {
-	HashMap chunkmap, entitymap;
+	ChunkMap chunkmap;
+	struct EntityPool entities;
+	struct WorldStats stats;
+	// Where world_compact_step left off
+	struct ChunkMapIterator compact_it;
+	// The chunks changed through the world since world_clear_changes, if
+	// world_track_changes was called
+	bool track_changes;
+	struct ChunkKey *changes;
+	size_t num_changes, changes_capacity;
 } *World;
 
-size_t hash_coordinate(int64_t, int64_t);
+// Remembers the chunk of the last block accessed, so that runs of accesses
+// within one chunk only look it up in the chunkmap once. Cursors are meant to
+// live for the length of one query, since they don't notice chunks being
+// added to the world behind their back.
+struct WorldCursor {
+	World world;
+	Chunk chunk;
+	int64_t cx, cy;
+	bool valid;
+};
+
+uint64_t chunk_key_hash(struct ChunkKey);
 
 Chunk chunk_new(int64_t cx, int64_t cy);
 void chunk_free(Chunk);
 void chunk_fill(Chunk, enum BlockID);
+int chunk_fill_rect(Chunk, int rx1, int ry1, int rx2, int ry2, enum BlockID);
+int chunk_set_tile(Chunk, int rx, int ry, enum BlockID);
+int chunk_set_tiles(Chunk, const uint16_t *tiles);
+int chunk_compact(Chunk);
+size_t chunk_memory(Chunk);
+Chunk chunk_copy(Chunk);
 
 World world_new(void);
 void world_free(World);
 Chunk world_get_chunk(World, int64_t cx, int64_t cy);
 int world_put_chunk(World, Chunk);
+int world_remove_chunk(World, Chunk);
+int world_compact_step(World, size_t max_chunks);
+void world_track_changes(World);
+void world_clear_changes(World);
 
 int world_set_block(World, int64_t x, int64_t y, enum BlockID);
 enum BlockID world_get_block(World, int64_t x, int64_t y);
+bool world_query_solid_aabb(World, int64_t x1, int64_t y1, int64_t x2,
+	int64_t y2);
+uint64_t world_query_solid_rows(World, int64_t x1, int64_t y1, int64_t x2,
+	int64_t y2);
+uint64_t world_query_solid_columns(World, int64_t x1, int64_t y1, int64_t x2,
+	int64_t y2);
+double world_query_free_shift_x(World, double x1, double y1, double x2,
+	double y2);
+double world_query_free_shift_y(World, double x1, double y1, double x2,
+	double y2);
 
-int world_put_entity(World, Entity);
+void world_cursor_init(struct WorldCursor *, World);
+int world_cursor_set_block(struct WorldCursor *, int64_t x, int64_t y,
+	enum BlockID);
+enum BlockID world_cursor_get_block(struct WorldCursor *, int64_t x, int64_t y);
 
 int world_generate_flat(World world);
 int world_fill_block(World world, int64_t x, int64_t y, int64_t w, int64_t h,
 	enum BlockID block);
 
+/**
+ * Checks whether every tile of a chunk is the same block, in which case it is
+ * chunk->uniform
+ * @param chunk The chunk
+ * @return Whether the chunk is uniform
+ */
+static inline bool chunk_is_uniform(Chunk chunk)
+{
+	return chunk->bits == 0;
+}
+
+/**
+ * Gets a tile of a chunk
+ * @param chunk The chunk
+ * @param rx The x-coordinate relative to the chunk
+ * @param ry The y-coordinate relative to the chunk
+ * @return The block ID
+ */
+static inline enum BlockID chunk_get_tile(Chunk chunk, int rx, int ry)
+{
+	unsigned bit = (ry * CHUNK_LENGTH + rx) * chunk->bits;
+	unsigned index = (chunk->indices[bit >> 3] >> (bit & 7)) &
+		((1u << chunk->bits) - 1);
+	return chunk->palette[index];
+}
+
 #endif // WORLD_H